@@ -0,0 +1,389 @@
+/*****************************************************************************
+ * histogram_bench.c : Kernel micro-benchmark for the histogram plugin
+ *****************************************************************************
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Times the fill, paint and blend stages of histogram.c, for every chroma
+ * and histogram type the filter supports, on synthetic 720p, 1080p and 4K
+ * pictures. The plugin is compiled in as is, against the stand-in vlc
+ * headers of this directory.
+ *
+ * Each stage is run for at least -m milliseconds, the median time of a
+ * call is reported:
+ *   fill : zero and fill the bins from the input picture
+ *   normalize: update_max and normalize the bins, log scale
+ *   paint: repaint the whole overlay from the normalized heights
+ *   blend: blend the overlay to the output picture
+ * ns/pixel and GB/s are given over the visible pixels and bytes of the
+ * picture the stage walks: the input picture for fill, the overlay for
+ * normalize, paint and blend.
+ *
+ * With -c the results are printed as CSV, one line per stage, to compare
+ * the kernels of two commits. -i caps the kernels like the simd option of
+ * the filter, eg. -i scalar to compare against the plain C code.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <strings.h>
+#include <time.h>
+
+#include "../histogram.c"
+
+#define BENCH_MAX_CALLS 4096 /**< Upper limit of timed calls per stage          */
+#define BENCH_MIN_CALLS 5    /**< Lower limit of timed calls per stage          */
+
+typedef struct {
+    const char*  name;
+    vlc_fourcc_t chroma;
+} bench_chroma_t;
+
+static const bench_chroma_t bench_chromas[] = {
+    { "I420",     VLC_CODEC_I420     },
+    { "YV12",     VLC_CODEC_YV12     },
+    { "I422",     VLC_CODEC_I422     },
+    { "YUYV",     VLC_CODEC_YUYV     },
+    { "RGB24",    VLC_CODEC_RGB24    },
+    { "RGB32",    VLC_CODEC_RGB32    },
+    { "GREY",     VLC_CODEC_GREY     },
+    { "NV12",     VLC_CODEC_NV12     },
+    { "I420_10L", VLC_CODEC_I420_10L },
+    { "P010",     VLC_CODEC_P010     },
+};
+
+typedef struct {
+    const char* name;
+    int         width,
+                height;
+} bench_size_t;
+
+static const bench_size_t bench_sizes[] = {
+    { "720p",  1280,  720 },
+    { "1080p", 1920, 1080 },
+    { "4K",    3840, 2160 },
+};
+
+static const char *const bench_types[] = { "Y", "RGB", "WAVE", "VEC" };
+
+/** The pictures and the histogram of one chroma/type/size combination */
+typedef struct {
+    histogram_t*      h;
+    picture_t*        p_in;
+    picture_t*        p_out;
+    histogram_pool_t* pool;
+    unsigned          cpu;
+} bench_t;
+
+typedef void (*f_stage)( bench_t* );
+
+static void bench_fill( bench_t *b )
+{
+    histogram_zero( b->h );
+    histogram_fill( b->h, b->p_in, b->pool );
+}
+
+static void bench_normalize( bench_t *b )
+{
+    histogram_update_max( b->h );
+    histogram_normalize( b->h, true, false );
+}
+
+static void bench_paint( bench_t *b )
+{
+    b->h->repaint = true;
+    histogram_paint( b->h );
+}
+
+static void bench_blend( bench_t *b )
+{
+    histogram_blend( b->h, b->p_out );
+}
+
+static int64_t bench_now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_cmp( const void *a, const void *b )
+{
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/** Run the stage for min_ns (one warm up call first), return the median ns per call */
+static int64_t bench_run( f_stage stage, bench_t *b, int64_t min_ns, int *calls )
+{
+    static int64_t times[BENCH_MAX_CALLS];
+    int n = 0;
+
+    stage( b );
+
+    int64_t start = bench_now(), end = start;
+    while (n < BENCH_MAX_CALLS && (n < BENCH_MIN_CALLS || end - start < min_ns)) {
+        int64_t t = end;
+        stage( b );
+        end = bench_now();
+        times[n++] = end - t;
+    }
+
+    qsort( times, n, sizeof(int64_t), bench_cmp );
+    *calls = n;
+
+    return times[n/2];
+}
+
+/**
+ * Fill the visible area with a diagonal gradient and some noise.
+ * 16-bit samples get 10-bit values, at the bit position of the chroma.
+ */
+static void bench_synthesize( picture_t *p_pic )
+{
+    uint32_t seed = 0x9e3779b9;
+    const int hbd_shift = histogram_hbd_shift( p_pic->format.i_chroma );
+
+    for (int i=0; i<p_pic->i_planes; i++) {
+        plane_t *p = &p_pic->p[i];
+        for (int y=0; y<p->i_visible_lines; y++) {
+            uint8_t *row = p->p_pixels + y*p->i_pitch;
+            uint16_t *row16 = (uint16_t*)row;
+            for (int x=0; x<p->i_visible_pitch; x++) {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                uint8_t value = x*192/p->i_visible_pitch +
+                                y*64/p->i_visible_lines + (seed >> 27);
+                if (hbd_shift < 0)
+                    row[x] = value;
+                else if (x % 2 == 0)
+                    row16[x/2] = ((value << 2) | (seed >> 30)) << hbd_shift;
+            }
+        }
+    }
+}
+
+static void picture_Size( const picture_t *p_pic, int64_t *pixels, int64_t *bytes )
+{
+    const plane_t *p = &p_pic->p[0];
+
+    *pixels = (int64_t)p->i_visible_lines * (p->i_visible_pitch / p->i_pixel_pitch);
+    *bytes  = 0;
+    for (int i=0; i<p_pic->i_planes; i++)
+        *bytes += (int64_t)p_pic->p[i].i_visible_lines * p_pic->p[i].i_visible_pitch;
+}
+
+static void bench_report( bool csv, const bench_chroma_t *chroma, histo_type_e type,
+                          const bench_size_t *size, const char *stage, int threads,
+                          unsigned cpu, int calls, int64_t ns, const picture_t *p_pic )
+{
+    int64_t pixels, bytes;
+    picture_Size( p_pic, &pixels, &bytes );
+
+    double ns_pixel = (double)ns / pixels,
+           gb_s     = (double)bytes / ns;
+
+    if (csv)
+        printf("%s,%s,%d,%d,%s,%d,%s,%d,%lld,%.4f,%.3f\n",
+               chroma->name, bench_types[type], size->width, size->height,
+               stage, threads, histogram_cpu_name( cpu ), calls, (long long)ns,
+               ns_pixel, gb_s);
+    else
+        printf("%-8s %-4s %-6s %-9s %10.1f %10.3f %8.2f\n",
+               chroma->name, bench_types[type], size->name, stage,
+               ns / 1000.0, ns_pixel, gb_s);
+}
+
+/** Benchmark the stages of one combination, return false if it is not supported */
+static bool bench_one( bool csv, const bench_chroma_t *chroma, histo_type_e type,
+                       const bench_size_t *size, histogram_pool_t *pool, int threads,
+                       unsigned cpu, int64_t min_ns )
+{
+    if (histogram_check_codec( type, chroma->chroma ) != HIST_SUCCESS)
+        return false;
+
+    bench_t b = { .h = NULL, .pool = pool, .cpu = cpu };
+    video_format_t fmt;
+    int status, calls;
+    int64_t ns;
+
+    video_format_Init( &fmt, chroma->chroma );
+    fmt.i_width  = fmt.i_visible_width  = size->width;
+    fmt.i_height = fmt.i_visible_height = size->height;
+
+    b.p_in  = picture_NewFromFormat( &fmt );
+    b.p_out = picture_NewFromFormat( &fmt );
+    video_format_Clean( &fmt );
+    if (b.p_in == NULL || b.p_out == NULL) {
+        fprintf(stderr, "Unable to allocate %s %dx%d pictures\n",
+                chroma->name, size->width, size->height);
+        status = HIST_ERROR;
+        goto out;
+    }
+    bench_synthesize( b.p_in );
+    picture_CopyPixels( b.p_out, b.p_in );
+
+    status = histogram_init( &b.h, b.p_in, type );
+    if (status == HIST_SUCCESS)
+        status = histogram_set_codec( b.h, chroma->chroma, b.cpu );
+    if (status != HIST_SUCCESS) {
+        fprintf(stderr, "Unable to create histogram '%s' for %s\n",
+                bench_types[type], chroma->name);
+        goto out;
+    }
+
+    ns = bench_run( bench_fill, &b, min_ns, &calls );
+    bench_report( csv, chroma, type, size, "fill", threads, cpu, calls, ns, b.p_in );
+
+    /*the raw counts are kept, normalize can run over them again*/
+    ns = bench_run( bench_normalize, &b, min_ns, &calls );
+    bench_report( csv, chroma, type, size, "normalize", threads, cpu, calls, ns, b.h->p_overlay );
+
+    /*paint and blend what a real picture would show*/
+    histogram_update_max( b.h );
+    histogram_normalize( b.h, false, false );
+
+    ns = bench_run( bench_paint, &b, min_ns, &calls );
+    bench_report( csv, chroma, type, size, "paint", threads, cpu, calls, ns, b.h->p_overlay );
+
+    ns = bench_run( bench_blend, &b, min_ns, &calls );
+    bench_report( csv, chroma, type, size, "blend", threads, cpu, calls, ns, b.h->p_overlay );
+
+out:
+    histogram_free( &b.h );
+    if (b.p_in)  picture_Release( b.p_in );
+    if (b.p_out) picture_Release( b.p_out );
+
+    return true;
+}
+
+static void usage( const char *psz_name )
+{
+    fprintf(stderr,
+            "Usage: %s [-c] [-i simd] [-t threads] [-m msec] [-s WxH] [chroma...]\n"
+            "  -c        print CSV\n"
+            "  -i simd   kernels: auto (default), avx512, avx2, ssse3, sse2 or scalar\n"
+            "  -t n      fill with n threads (default 1, 0: one per cpu)\n"
+            "  -m msec   minimum run time of each stage (default 200)\n"
+            "  -s WxH    only benchmark this picture size\n"
+            "  chroma    only benchmark these chromas, out of:\n"
+            "            I420 YV12 I422 YUYV RGB24 RGB32 GREY NV12 I420_10L P010\n",
+            psz_name);
+}
+
+int main( int argc, char **argv )
+{
+    bool csv = false;
+    int threads = 1, msec = 200, opt;
+    const char *psz_simd = "auto";
+    char custom_name[32];
+    bench_size_t custom = { custom_name, 0, 0 };
+
+    while ((opt = getopt( argc, argv, "ci:t:m:s:h" )) != -1) {
+        switch (opt) {
+            case 'c':
+                csv = true;
+                break;
+            case 'i':
+                psz_simd = optarg;
+                break;
+            case 't':
+                threads = atoi( optarg );
+                break;
+            case 'm':
+                msec = atoi( optarg );
+                break;
+            case 's':
+                if (sscanf( optarg, "%dx%d", &custom.width, &custom.height ) != 2 ||
+                    custom.width < 2 || custom.height < 2) {
+                    usage( argv[0] );
+                    return 1;
+                }
+                snprintf(custom_name, sizeof custom_name, "%dx%d", custom.width, custom.height);
+                break;
+            default:
+                usage( argv[0] );
+                return 1;
+        }
+    }
+
+    for (int i=optind; i<argc; i++) {
+        bool found = false;
+        for (size_t c=0; c<sizeof(bench_chromas)/sizeof(bench_chromas[0]); c++)
+            found |= !strcasecmp( argv[i], bench_chromas[c].name );
+        if (!found) {
+            fprintf(stderr, "Unknown chroma '%s'\n", argv[i]);
+            usage( argv[0] );
+            return 1;
+        }
+    }
+
+    unsigned cpu;
+    if (histogram_cpu_detect( psz_simd, &cpu ) != HIST_SUCCESS) {
+        fprintf(stderr, "Unknown simd value '%s'\n", psz_simd);
+        usage( argv[0] );
+        return 1;
+    }
+
+    /*the fill threads, as set up by Open()*/
+    histogram_pool_t *pool = NULL;
+    if (threads <= 0)
+        threads = vlc_GetCPUCount();
+    if (threads > HISTOGRAM_MAX_THREADS)
+        threads = HISTOGRAM_MAX_THREADS;
+    if (threads > 1) {
+        pool = histogram_pool_new( threads );
+        if (pool == NULL) {
+            fprintf(stderr, "Unable to start %d fill threads\n", threads);
+            return 1;
+        }
+    }
+
+    const bench_size_t *sizes = bench_sizes;
+    size_t num_sizes = sizeof(bench_sizes)/sizeof(bench_sizes[0]);
+    if (custom.width > 0) {
+        sizes = &custom;
+        num_sizes = 1;
+    }
+
+    if (csv)
+        printf("chroma,type,width,height,stage,threads,simd,calls,ns_per_call,ns_per_pixel,gb_per_s\n");
+    else {
+        printf("%s kernels, %d fill thread(s)\n", histogram_cpu_name( cpu ), threads);
+        printf("%-8s %-4s %-6s %-9s %10s %10s %8s\n",
+               "chroma", "type", "size", "stage", "us/call", "ns/pixel", "GB/s");
+    }
+
+    for (size_t c=0; c<sizeof(bench_chromas)/sizeof(bench_chromas[0]); c++) {
+        bool selected = optind == argc;
+        for (int i=optind; i<argc; i++)
+            selected |= !strcasecmp( argv[i], bench_chromas[c].name );
+        if (!selected)
+            continue;
+
+        for (int type=HISTO_Y; type<=HISTO_VECTORSCOPE; type++)
+            for (size_t s=0; s<num_sizes; s++)
+                if (!bench_one( csv, &bench_chromas[c], type, &sizes[s],
+                                pool, threads, cpu, (int64_t)msec * 1000000 ))
+                    break;
+    }
+
+    if (pool)
+        histogram_pool_delete( pool );
+
+    return 0;
+}
@@ -0,0 +1,358 @@
+/*****************************************************************************
+ * histogram_test.c : Fill checks for the histogram plugin
+ *****************************************************************************
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Checks that the views histogram_fill() reads through land on the right
+ * samples, on pictures of odd width and height:
+ *   roi : the region of interest gives the counts of a copy of the rectangle
+ *   pool: the slices of the worker pool give the counts of a single fill
+ *   stats: the out of range luma counts, whatever the overlay width
+ *   scale: the fixed point heights, within one pixel of the float ones
+ * Built like histogram_bench, against the stand-in vlc headers of this
+ * directory. Returns non zero and prints the failed combinations on error.
+ *****************************************************************************/
+
+#include "../histogram.c"
+
+typedef struct {
+    const char*  name;
+    vlc_fourcc_t chroma;
+} test_chroma_t;
+
+static const test_chroma_t test_chromas[] = {
+    { "I420",     VLC_CODEC_I420     },
+    { "I422",     VLC_CODEC_I422     },
+    { "YUYV",     VLC_CODEC_YUYV     },
+    { "RGB24",    VLC_CODEC_RGB24    },
+    { "NV12",     VLC_CODEC_NV12     },
+    { "I420_10L", VLC_CODEC_I420_10L },
+    { "P010",     VLC_CODEC_P010     },
+};
+
+static const int test_sizes[][2] = { { 853, 480 }, { 854, 481 }, { 853, 481 } };
+
+/*32 and 256 overlay bins*/
+static const int test_stats_sizes[][2] = { { 80, 72 }, { 853, 481 } };
+
+static const char *const test_types[] = { "Y", "RGB", "WAVE", "VEC" };
+
+static picture_t *test_picture( vlc_fourcc_t chroma, int width, int height )
+{
+    video_format_t fmt;
+
+    video_format_Init( &fmt, chroma );
+    fmt.i_width  = fmt.i_visible_width  = width;
+    fmt.i_height = fmt.i_visible_height = height;
+    picture_t *p_pic = picture_NewFromFormat( &fmt );
+    video_format_Clean( &fmt );
+
+    return p_pic;
+}
+
+/** Noise, 16-bit samples get 10-bit values at the bit position of the chroma */
+static void test_synthesize( picture_t *p_pic )
+{
+    uint32_t seed = 0x9e3779b9;
+    const int hbd_shift = histogram_hbd_shift( p_pic->format.i_chroma );
+
+    for (int i=0; i<p_pic->i_planes; i++) {
+        plane_t *p = &p_pic->p[i];
+        for (int y=0; y<p->i_visible_lines; y++) {
+            uint8_t *row = p->p_pixels + y*p->i_pitch;
+            for (int x=0; x<p->i_visible_pitch; x++) {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                if (hbd_shift < 0)
+                    row[x] = seed >> 24;
+                else if (x % 2 == 0)
+                    ((uint16_t*)row)[x/2] = (seed >> 22) << hbd_shift;
+            }
+        }
+    }
+}
+
+/**
+ * Copy the rectangle x, y of p_src to p_dst, which has the size of the
+ * rectangle. Even sized, so its planes give the subsampling exactly.
+ */
+static void test_crop( picture_t *p_dst, const picture_t *p_src, int x, int y )
+{
+    const plane_t *d0 = &p_dst->p[0];
+
+    for (int i=0; i<p_dst->i_planes; i++) {
+        const plane_t *s = &p_src->p[i];
+        plane_t *d = &p_dst->p[i];
+        const int x_div = (d0->i_visible_pitch / d0->i_pixel_pitch) /
+                          (d->i_visible_pitch / d->i_pixel_pitch),
+                  y_div = d0->i_visible_lines / d->i_visible_lines;
+
+        for (int row=0; row<d->i_visible_lines; row++)
+            memcpy( d->p_pixels + row*d->i_pitch,
+                    s->p_pixels + (y/y_div + row)*s->i_pitch + x/x_div*s->i_pixel_pitch,
+                    d->i_visible_pitch );
+    }
+}
+
+static histogram_t *test_histogram( const picture_t *p_pic, histo_type_e type, vlc_fourcc_t chroma,
+                                    unsigned cpu )
+{
+    histogram_t *h = NULL;
+
+    if (histogram_init( &h, (picture_t*)p_pic, type ) != HIST_SUCCESS)
+        return NULL;
+    if (histogram_set_codec( h, chroma, cpu ) != HIST_SUCCESS)
+        histogram_free( &h );
+
+    return h;
+}
+
+/** Count the bins of a and b that differ, -1 if a histogram is missing */
+static int test_compare( const histogram_t *a, const histogram_t *b )
+{
+    if (a == NULL || b == NULL)
+        return -1;
+
+    int diff = 0;
+    for (int c=0; c<a->num_channels; c++)
+        for (int i=0; i<a->num_raw_bins; i++)
+            diff += a->bins[c][i] != b->bins[c][i];
+
+    return diff;
+}
+
+/** The region of interest against a copy of the same rectangle */
+static int test_roi( const test_chroma_t *chroma, histo_type_e type, picture_t *p_in,
+                     unsigned cpu )
+{
+    /*odd origin, aligned down to 214,100 by histogram_roi_view()*/
+    const int x = 215, y = 101, width = 300, height = 200;
+    picture_t *p_crop = test_picture( chroma->chroma, width, height );
+    if (p_crop == NULL)
+        return -1;
+    test_crop( p_crop, p_in, x & ~1, y & ~1 );
+
+    histogram_t *h_roi  = test_histogram( p_in, type, chroma->chroma, cpu ),
+                *h_crop = test_histogram( p_crop, type, chroma->chroma, cpu );
+    if (h_roi && h_crop) {
+        h_roi->roi.x = x;
+        h_roi->roi.y = y;
+        h_roi->roi.width  = width;
+        h_roi->roi.height = height;
+        histogram_zero( h_roi );
+        histogram_fill( h_roi, p_in, NULL );
+        histogram_zero( h_crop );
+        histogram_fill( h_crop, p_crop, NULL );
+    }
+    int diff = test_compare( h_roi, h_crop );
+
+    histogram_free( &h_roi );
+    histogram_free( &h_crop );
+    picture_Release( p_crop );
+
+    return diff;
+}
+
+/** The slices of a worker pool against a single fill */
+static int test_pool( const test_chroma_t *chroma, histo_type_e type, picture_t *p_in,
+                      unsigned cpu, histogram_pool_t *pool )
+{
+    histogram_t *h_pool   = test_histogram( p_in, type, chroma->chroma, cpu ),
+                *h_single = test_histogram( p_in, type, chroma->chroma, cpu );
+    if (h_pool && h_single) {
+        histogram_zero( h_pool );
+        histogram_fill( h_pool, p_in, pool );
+        histogram_zero( h_single );
+        histogram_fill( h_single, p_in, NULL );
+    }
+    int diff = test_compare( h_pool, h_single );
+
+    histogram_free( &h_pool );
+    histogram_free( &h_single );
+
+    return diff;
+}
+
+/** The under/over counts of a Y histogram against a count of the luma plane */
+static int test_stats( const test_chroma_t *chroma, picture_t *p_in, unsigned cpu )
+{
+    const plane_t *p = &p_in->p[Y_PLANE];
+    const int hbd_shift = histogram_hbd_shift( chroma->chroma ),
+              unit      = hbd_shift < 0 ? 1 : 4,
+              width     = p->i_visible_pitch / p->i_pixel_pitch;
+    uint64_t under = 0, over = 0;
+
+    for (int y=0; y<p->i_visible_lines; y++)
+        for (int x=0; x<width; x++) {
+            const uint8_t *row = p->p_pixels + y*p->i_pitch;
+            const int value = hbd_shift < 0 ? row[x] : ((const uint16_t*)row)[x] >> hbd_shift;
+            under += value < VIDEO_BLACK_LEVEL * unit;
+            over  += value > VIDEO_WHITE_LEVEL * unit;
+        }
+
+    histogram_t *h = test_histogram( p_in, HISTO_Y, chroma->chroma, cpu );
+    histogram_stats_t stats;
+    int diff = -1;
+    if (h) {
+        histogram_zero( h );
+        histogram_fill( h, p_in, NULL );
+        if (histogram_stats( h, &stats ) == HIST_SUCCESS)
+            diff = (stats.channel[Y].under != under) + (stats.channel[Y].over != over);
+    }
+    histogram_free( &h );
+
+    return diff;
+}
+
+static const uint32_t test_scale_tops[] = { 49, 99, 254, 1023, 4095 };
+static const uint32_t test_scale_maxs[] = { 1, 2, 3, 10, 255, 1000, 65535, 1000003, 33177600,
+                                            0x7FFFFFFF, 0xFFFFFFFF };
+static const char *const test_simd_levels[] = { "scalar", "sse2", "avx2" };
+
+#define TEST_SCALE_COUNTS 4099
+
+/**
+ * The heights of the counts up to max against log10f()/float division,
+ * at most one pixel apart, and against the scalar kernels, equal.
+ * Every count for small maxima, both ends then spread ones for large ones,
+ * the ends first so that the SIMD kernels get them, not their scalar tails.
+ */
+static int test_scale( const char *psz_simd, uint32_t top, uint32_t max, bool log )
+{
+    unsigned cpu;
+    uint32_t counts[TEST_SCALE_COUNTS], heights[TEST_SCALE_COUNTS], ref[TEST_SCALE_COUNTS];
+    histogram_t h_simd, h_c;
+    int n = 0, diff = 0;
+
+    histogram_cpu_detect( psz_simd, &cpu );
+    h_simd.scale_rows = histogram_scale_rows( cpu );
+    h_c.scale_rows    = histogram_scale_rows( 0 );
+
+    if (max < TEST_SCALE_COUNTS - 3) {
+        for (uint32_t c=0; c<=max; c++)
+            counts[n++] = c;
+    } else {
+        counts[n++] = 0;
+        counts[n++] = 1;
+        counts[n++] = max - 1;
+        counts[n++] = max;
+        for (int k=1; k<TEST_SCALE_COUNTS - 3; k++)
+            counts[n++] = (uint64_t)max * k / (TEST_SCALE_COUNTS - 3);
+    }
+
+    const histogram_scale_t s_simd = histogram_scale_init( &h_simd, max, top, log ),
+                            s_c    = histogram_scale_init( &h_c, max, top, log );
+    histogram_scale( &s_simd, counts, heights, n );
+    histogram_scale( &s_c, counts, ref, n );
+
+    for (int i=0; i<n; i++) {
+        const float f = log ? log10f( (float)counts[i] + 1 ) * top / log10f( (float)max + 1 )
+                            : (float)counts[i] * top / max;
+        const int32_t expected = f < top ? (int32_t)f : (int32_t)top;
+        diff += heights[i] != ref[i] || heights[i] > top ||
+                abs( (int32_t)heights[i] - expected ) > 1;
+    }
+
+    return diff;
+}
+
+int main( void )
+{
+    unsigned cpu;
+    int failed = 0, runs = 0;
+
+    histogram_cpu_detect( "auto", &cpu );
+    histogram_pool_t *pool = histogram_pool_new( 4 );
+    if (pool == NULL) {
+        fprintf(stderr, "Unable to start the worker pool\n");
+        return 1;
+    }
+
+    for (size_t c=0; c<sizeof(test_chromas)/sizeof(test_chromas[0]); c++)
+        for (size_t s=0; s<sizeof(test_sizes)/sizeof(test_sizes[0]); s++) {
+            const test_chroma_t *chroma = &test_chromas[c];
+            picture_t *p_in = test_picture( chroma->chroma, test_sizes[s][0], test_sizes[s][1] );
+            if (p_in == NULL) {
+                fprintf(stderr, "Unable to allocate %s %dx%d\n",
+                        chroma->name, test_sizes[s][0], test_sizes[s][1]);
+                failed++;
+                continue;
+            }
+            test_synthesize( p_in );
+
+            for (int t=0; t<(int)(sizeof(test_types)/sizeof(test_types[0])); t++) {
+                if (histogram_check_codec( t, chroma->chroma ) != HIST_SUCCESS)
+                    continue;
+
+                int roi_diff  = test_roi( chroma, t, p_in, cpu ),
+                    pool_diff = test_pool( chroma, t, p_in, cpu, pool );
+                runs++;
+                if (roi_diff != 0 || pool_diff != 0) {
+                    printf("FAIL %-8s %-4s %dx%d: roi %d, pool %d bins differ\n",
+                           chroma->name, test_types[t], test_sizes[s][0], test_sizes[s][1],
+                           roi_diff, pool_diff);
+                    failed++;
+                }
+            }
+            picture_Release( p_in );
+        }
+
+    /*Chromas with a luma plane*/
+    for (size_t c=0; c<sizeof(test_chromas)/sizeof(test_chromas[0]); c++)
+        for (size_t s=0; s<sizeof(test_stats_sizes)/sizeof(test_stats_sizes[0]); s++) {
+            const test_chroma_t *chroma = &test_chromas[c];
+            const int width = test_stats_sizes[s][0], height = test_stats_sizes[s][1];
+            picture_t *p_in = test_picture( chroma->chroma, width, height );
+            if (p_in == NULL) {
+                fprintf(stderr, "Unable to allocate %s %dx%d\n", chroma->name, width, height);
+                failed++;
+                continue;
+            }
+            if (p_in->i_planes > 1) {
+                test_synthesize( p_in );
+                int stats_diff = test_stats( chroma, p_in, cpu );
+                runs++;
+                if (stats_diff != 0) {
+                    printf("FAIL %-8s Y    %dx%d: stats %d counts differ\n",
+                           chroma->name, width, height, stats_diff);
+                    failed++;
+                }
+            }
+            picture_Release( p_in );
+        }
+
+    for (size_t l=0; l<sizeof(test_simd_levels)/sizeof(test_simd_levels[0]); l++)
+        for (size_t t=0; t<sizeof(test_scale_tops)/sizeof(test_scale_tops[0]); t++)
+            for (size_t m=0; m<sizeof(test_scale_maxs)/sizeof(test_scale_maxs[0]); m++)
+                for (int log=0; log<2; log++) {
+                    int scale_diff = test_scale( test_simd_levels[l], test_scale_tops[t],
+                                                 test_scale_maxs[m], log );
+                    runs++;
+                    if (scale_diff != 0) {
+                        printf("FAIL scale %-6s %-6s top %u max %u: %d heights differ\n",
+                               test_simd_levels[l], log ? "log" : "linear",
+                               test_scale_tops[t], test_scale_maxs[m], scale_diff);
+                        failed++;
+                    }
+                }
+
+    histogram_pool_delete( pool );
+    printf("%d combinations, %d failed\n", runs, failed);
+
+    return failed != 0;
+}
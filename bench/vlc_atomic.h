@@ -0,0 +1,21 @@
+/*****************************************************************************
+ * vlc_atomic.h : Stand-in for the vlc atomic variables
+ *****************************************************************************/
+
+#ifndef HISTOGRAM_BENCH_VLC_ATOMIC_H
+#define HISTOGRAM_BENCH_VLC_ATOMIC_H 1
+
+#include <vlc_common.h>
+
+static inline uintptr_t vlc_atomic_get( const vlc_atomic_t *atom )
+{
+    return __atomic_load_n( &atom->u, __ATOMIC_SEQ_CST );
+}
+
+static inline uintptr_t vlc_atomic_set( vlc_atomic_t *atom, uintptr_t v )
+{
+    __atomic_store_n( &atom->u, v, __ATOMIC_SEQ_CST );
+    return v;
+}
+
+#endif
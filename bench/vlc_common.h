@@ -0,0 +1,191 @@
+/*****************************************************************************
+ * vlc_common.h : Stand-in for the vlc core API used by histogram.c
+ *****************************************************************************
+ * Only the types, macros and functions the histogram plugin uses, with the
+ * layout of vlc 2.0. This lets histogram_bench build the plugin kernels
+ * without the vlc development files, see vlc_stubs.c.
+ *****************************************************************************/
+
+#ifndef HISTOGRAM_BENCH_VLC_COMMON_H
+#define HISTOGRAM_BENCH_VLC_COMMON_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef int64_t  mtime_t;
+typedef uint32_t vlc_fourcc_t;
+
+#define VLC_FOURCC( a, b, c, d ) \
+        ( ((uint32_t)a) | ( ((uint32_t)b) << 8 ) \
+           | ( ((uint32_t)c) << 16 ) | ( ((uint32_t)d) << 24 ) )
+
+#define VLC_SUCCESS         0
+#define VLC_EGENERIC       -666
+#define VLC_ENOMEM         -1
+
+#define VLC_UNUSED(x) (void)(x)
+#define VLC_TS_INVALID INT64_C(0)
+#define CLOCK_FREQ INT64_C(1000000)
+
+#define __MIN(a, b) ( ((a) < (b)) ? (a) : (b) )
+#define __MAX(a, b) ( ((a) > (b)) ? (a) : (b) )
+#define likely(p)   __builtin_expect(!!(p), 1)
+#define unlikely(p) __builtin_expect(!!(p), 0)
+
+/*****************************************************************************
+ * Codecs
+ *****************************************************************************/
+#define VLC_CODEC_YV9   VLC_FOURCC('Y','V','U','9')
+#define VLC_CODEC_YV12  VLC_FOURCC('Y','V','1','2')
+#define VLC_CODEC_I420  VLC_FOURCC('I','4','2','0')
+#define VLC_CODEC_J420  VLC_FOURCC('J','4','2','0')
+#define VLC_CODEC_I422  VLC_FOURCC('I','4','2','2')
+#define VLC_CODEC_J422  VLC_FOURCC('J','4','2','2')
+#define VLC_CODEC_I444  VLC_FOURCC('I','4','4','4')
+#define VLC_CODEC_J444  VLC_FOURCC('J','4','4','4')
+#define VLC_CODEC_YUVA  VLC_FOURCC('Y','U','V','A')
+#define VLC_CODEC_NV12  VLC_FOURCC('N','V','1','2')
+#define VLC_CODEC_NV21  VLC_FOURCC('N','V','2','1')
+#define VLC_CODEC_GREY  VLC_FOURCC('G','R','E','Y')
+#define VLC_CODEC_YUYV  VLC_FOURCC('Y','U','Y','2')
+#define VLC_CODEC_YVYU  VLC_FOURCC('Y','V','Y','U')
+#define VLC_CODEC_UYVY  VLC_FOURCC('U','Y','V','Y')
+#define VLC_CODEC_VYUY  VLC_FOURCC('V','Y','U','Y')
+#define VLC_CODEC_CYUV  VLC_FOURCC('c','y','u','v')
+#define VLC_CODEC_RGB24 VLC_FOURCC('R','V','2','4')
+#define VLC_CODEC_RGB32 VLC_FOURCC('R','V','3','2')
+#define VLC_CODEC_RGBA  VLC_FOURCC('R','G','B','A')
+#define VLC_CODEC_I420_10L VLC_FOURCC('I','0','A','L')
+#define VLC_CODEC_I420_12L VLC_FOURCC('I','0','C','L')
+#define VLC_CODEC_I422_10L VLC_FOURCC('I','2','A','L')
+#define VLC_CODEC_I422_12L VLC_FOURCC('I','2','C','L')
+#define VLC_CODEC_P010     VLC_FOURCC('P','0','1','0')
+
+/*****************************************************************************
+ * Pictures
+ *****************************************************************************/
+enum { Y_PLANE = 0, U_PLANE = 1, V_PLANE = 2, A_PLANE = 3 };
+#define PICTURE_PLANE_MAX 5
+
+typedef struct
+{
+    vlc_fourcc_t i_chroma;
+    unsigned int i_width, i_height;
+    unsigned int i_x_offset, i_y_offset;
+    unsigned int i_visible_width, i_visible_height;
+    unsigned int i_bits_per_pixel;
+    unsigned int i_sar_num, i_sar_den;
+    uint32_t     i_rmask, i_gmask, i_bmask;
+    int          i_rrshift, i_lrshift;
+    int          i_rgshift, i_lgshift;
+    int          i_rbshift, i_lbshift;
+} video_format_t;
+typedef video_format_t video_frame_format_t;
+
+typedef struct
+{
+    int          i_cat;
+    vlc_fourcc_t i_codec;
+    video_format_t video;
+} es_format_t;
+
+typedef struct plane_t
+{
+    uint8_t *p_pixels;
+    int i_lines, i_pitch, i_pixel_pitch;
+    int i_visible_lines, i_visible_pitch;
+} plane_t;
+
+typedef struct { volatile uintptr_t u; } vlc_atomic_t;
+
+typedef struct picture_t picture_t;
+struct picture_t
+{
+    video_frame_format_t format;
+    plane_t      p[PICTURE_PLANE_MAX];
+    int          i_planes;
+    mtime_t      date;
+    bool         b_force, b_progressive, b_top_field_first;
+    unsigned int i_nb_fields;
+    struct
+    {
+        vlc_atomic_t refcount;
+        void (*pf_destroy)( picture_t * );
+    } gc;
+    picture_t   *p_next;
+};
+
+void video_format_Init( video_format_t *, vlc_fourcc_t );
+static inline void video_format_Clean( video_format_t *p_fmt ) { VLC_UNUSED(p_fmt); }
+
+picture_t *picture_NewFromFormat( const video_format_t * );
+void picture_Release( picture_t * );
+void picture_CopyPixels( picture_t *p_dst, const picture_t *p_src );
+void picture_CopyProperties( picture_t *p_dst, const picture_t *p_src );
+
+static inline picture_t *picture_Hold( picture_t *p_picture )
+{
+    __atomic_add_fetch( &p_picture->gc.refcount.u, 1, __ATOMIC_SEQ_CST );
+    return p_picture;
+}
+
+static inline bool picture_IsReferenced( picture_t *p_picture )
+{
+    return __atomic_load_n( &p_picture->gc.refcount.u, __ATOMIC_SEQ_CST ) > 1;
+}
+
+static inline void picture_Copy( picture_t *p_dst, const picture_t *p_src )
+{
+    picture_CopyPixels( p_dst, p_src );
+    picture_CopyProperties( p_dst, p_src );
+}
+
+/*****************************************************************************
+ * Objects and messages
+ *****************************************************************************/
+typedef struct vlc_object_t vlc_object_t;
+struct vlc_object_t
+{
+    const char   *psz_object_type;
+    vlc_object_t *p_libvlc;
+};
+#define VLC_OBJECT( x ) ((vlc_object_t *)(x))
+
+typedef struct config_chain_t config_chain_t;
+void config_ChainParse( void *, const char *psz_prefix,
+                        const char *const *ppsz_options, config_chain_t * );
+
+#define msg_Info( p_this, ... ) \
+        (VLC_UNUSED(p_this), fprintf( stderr, __VA_ARGS__ ), fputc( '\n', stderr ))
+#define msg_Err     msg_Info
+#define msg_Warn    msg_Info
+#define msg_Dbg( p_this, ... ) VLC_UNUSED(p_this)
+
+/*****************************************************************************
+ * Threads
+ *****************************************************************************/
+typedef pthread_mutex_t vlc_mutex_t;
+typedef pthread_cond_t  vlc_cond_t;
+typedef pthread_t       vlc_thread_t;
+
+#define VLC_THREAD_PRIORITY_LOW 0
+
+#define vlc_mutex_init( m )     pthread_mutex_init( m, NULL )
+#define vlc_mutex_destroy( m )  pthread_mutex_destroy( m )
+#define vlc_mutex_lock( m )     pthread_mutex_lock( m )
+#define vlc_mutex_unlock( m )   pthread_mutex_unlock( m )
+#define vlc_cond_init( c )      pthread_cond_init( c, NULL )
+#define vlc_cond_destroy( c )   pthread_cond_destroy( c )
+#define vlc_cond_wait( c, m )   pthread_cond_wait( c, m )
+#define vlc_cond_signal( c )    pthread_cond_signal( c )
+#define vlc_cond_broadcast( c ) pthread_cond_broadcast( c )
+#define vlc_join( t, r )        pthread_join( t, r )
+
+int vlc_clone( vlc_thread_t *, void *(*)( void * ), void *, int );
+mtime_t mdate( void );
+
+#endif
@@ -0,0 +1,19 @@
+/*****************************************************************************
+ * vlc_cpu.h : Stand-in for the vlc cpu detection
+ *****************************************************************************/
+
+#ifndef HISTOGRAM_BENCH_VLC_CPU_H
+#define HISTOGRAM_BENCH_VLC_CPU_H 1
+
+#define CPU_CAPABILITY_MMX     (1<<3)
+#define CPU_CAPABILITY_SSE     (1<<6)
+#define CPU_CAPABILITY_SSE2    (1<<7)
+#define CPU_CAPABILITY_SSE3    (1<<8)
+#define CPU_CAPABILITY_SSSE3   (1<<9)
+#define CPU_CAPABILITY_SSE4_1  (1<<10)
+#define CPU_CAPABILITY_SSE4_2  (1<<11)
+
+unsigned vlc_CPU( void );
+unsigned vlc_GetCPUCount( void );
+
+#endif
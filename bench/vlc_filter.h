@@ -0,0 +1,26 @@
+/*****************************************************************************
+ * vlc_filter.h : Stand-in for the vlc video filter object
+ *****************************************************************************/
+
+#ifndef HISTOGRAM_BENCH_VLC_FILTER_H
+#define HISTOGRAM_BENCH_VLC_FILTER_H 1
+
+#include <vlc_common.h>
+
+typedef struct filter_sys_t filter_sys_t;
+typedef struct filter_t filter_t;
+
+struct filter_t
+{
+    vlc_object_t    obj;
+    vlc_object_t   *p_libvlc;
+    es_format_t     fmt_in;
+    es_format_t     fmt_out;
+    config_chain_t *p_cfg;
+    picture_t *   ( * pf_video_filter ) ( filter_t *, picture_t * );
+    filter_sys_t   *p_sys;
+};
+
+picture_t *filter_NewPicture( filter_t * );
+
+#endif
@@ -0,0 +1,19 @@
+/*****************************************************************************
+ * vlc_image.h : Stand-in for the vlc image handler
+ *****************************************************************************
+ * There are no converters, image_Convert() always fails.
+ *****************************************************************************/
+
+#ifndef HISTOGRAM_BENCH_VLC_IMAGE_H
+#define HISTOGRAM_BENCH_VLC_IMAGE_H 1
+
+#include <vlc_common.h>
+
+typedef struct image_handler_t image_handler_t;
+
+image_handler_t *image_HandlerCreate( void * );
+void image_HandlerDelete( image_handler_t * );
+picture_t *image_Convert( image_handler_t *, picture_t *,
+                          video_format_t *, video_format_t * );
+
+#endif
@@ -0,0 +1,35 @@
+/*****************************************************************************
+ * vlc_plugin.h : Stand-in for the vlc module descriptor macros
+ *****************************************************************************
+ * The descriptor compiles to an unused function that only references the
+ * callbacks, histogram_bench has no module bank.
+ *****************************************************************************/
+
+#ifndef HISTOGRAM_BENCH_VLC_PLUGIN_H
+#define HISTOGRAM_BENCH_VLC_PLUGIN_H 1
+
+#define CAT_VIDEO             4
+#define SUBCAT_VIDEO_VFILTER  403
+
+#define vlc_module_begin()  static inline void vlc_module_descriptor( void ) {
+#define vlc_module_end()    }
+
+#define set_description( desc )
+#define set_shortname( name )
+#define set_category( cat )
+#define set_subcategory( subcat )
+#define set_capability( cap, score )
+#define add_shortcut( ... )
+#define set_callbacks( activate, deactivate ) \
+        VLC_UNUSED(activate); VLC_UNUSED(deactivate);
+
+#define add_bool( name, value, text, longtext, advc )
+#define add_integer( name, value, text, longtext, advc )
+#define add_integer_with_range( name, value, i_min, i_max, text, longtext, advc )
+#define add_float( name, value, text, longtext, advc )
+#define add_string( name, value, text, longtext, advc )
+#define change_integer_list( list, list_text )
+#define change_string_list( list, list_text, list_update_func )
+#define change_safe()
+
+#endif
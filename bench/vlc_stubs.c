@@ -0,0 +1,312 @@
+/*****************************************************************************
+ * vlc_stubs.c : Stand-in vlc core functions for histogram_bench
+ *****************************************************************************
+ * Pictures are allocated with the plane layout of the vlc picture
+ * allocator: 32 bytes aligned pitches and buffers, chroma planes
+ * subsampled as the fourcc says. Everything histogram.c calls outside of
+ * the picture and thread helpers is a no-op.
+ *****************************************************************************/
+
+#include <unistd.h>
+#include <time.h>
+
+#include <vlc_common.h>
+#include <vlc_variables.h>
+#include <vlc_image.h>
+#include <vlc_filter.h>
+#include <vlc_cpu.h>
+
+#define PICTURE_ALIGN 32
+
+/*****************************************************************************
+ * Pictures
+ *****************************************************************************/
+void video_format_Init( video_format_t *p_fmt, vlc_fourcc_t i_chroma )
+{
+    memset( p_fmt, 0, sizeof(*p_fmt) );
+    p_fmt->i_chroma = i_chroma;
+}
+
+static void picture_Destroy( picture_t *p_picture )
+{
+    for (int i=0; i<p_picture->i_planes; i++)
+        free( p_picture->p[i].p_pixels );
+    free( p_picture );
+}
+
+/** Allocate a plane of 'lines' rows, 'width' pixels of 'pixel_pitch' bytes */
+static int plane_Alloc( plane_t *p, int width, int lines, int pixel_pitch )
+{
+    void *p_pixels;
+
+    p->i_pixel_pitch   = pixel_pitch;
+    p->i_visible_pitch = width * pixel_pitch;
+    p->i_pitch         = (p->i_visible_pitch + PICTURE_ALIGN-1) & ~(PICTURE_ALIGN-1);
+    p->i_lines         = lines;
+    p->i_visible_lines = lines;
+
+    if (posix_memalign( &p_pixels, PICTURE_ALIGN, (size_t)p->i_pitch * lines ))
+        return VLC_ENOMEM;
+    memset( p_pixels, 0, (size_t)p->i_pitch * lines );
+    p->p_pixels = p_pixels;
+
+    return VLC_SUCCESS;
+}
+
+picture_t *picture_NewFromFormat( const video_format_t *p_fmt )
+{
+    const int w = p_fmt->i_width, h = p_fmt->i_height;
+    /*width, lines and pixel pitch of each plane*/
+    int planes[PICTURE_PLANE_MAX][3], i_planes;
+
+    switch (p_fmt->i_chroma) {
+        case VLC_CODEC_I420: case VLC_CODEC_J420: case VLC_CODEC_YV12:
+            i_planes = 3;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 1;
+            planes[1][0] = w/2; planes[1][1] = h/2; planes[1][2] = 1;
+            planes[2][0] = w/2; planes[2][1] = h/2; planes[2][2] = 1;
+            break;
+        case VLC_CODEC_I422: case VLC_CODEC_J422:
+            i_planes = 3;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 1;
+            planes[1][0] = w/2; planes[1][1] = h;   planes[1][2] = 1;
+            planes[2][0] = w/2; planes[2][1] = h;   planes[2][2] = 1;
+            break;
+        case VLC_CODEC_I444: case VLC_CODEC_J444: case VLC_CODEC_YUVA:
+            i_planes = p_fmt->i_chroma == VLC_CODEC_YUVA ? 4 : 3;
+            for (int i=0; i<i_planes; i++) {
+                planes[i][0] = w; planes[i][1] = h; planes[i][2] = 1;
+            }
+            break;
+        case VLC_CODEC_NV12: case VLC_CODEC_NV21:
+            i_planes = 2;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 1;
+            planes[1][0] = w/2; planes[1][1] = h/2; planes[1][2] = 2;
+            break;
+        case VLC_CODEC_I420_10L: case VLC_CODEC_I420_12L:
+            i_planes = 3;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 2;
+            planes[1][0] = w/2; planes[1][1] = h/2; planes[1][2] = 2;
+            planes[2][0] = w/2; planes[2][1] = h/2; planes[2][2] = 2;
+            break;
+        case VLC_CODEC_I422_10L: case VLC_CODEC_I422_12L:
+            i_planes = 3;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 2;
+            planes[1][0] = w/2; planes[1][1] = h;   planes[1][2] = 2;
+            planes[2][0] = w/2; planes[2][1] = h;   planes[2][2] = 2;
+            break;
+        case VLC_CODEC_P010:
+            i_planes = 2;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 2;
+            planes[1][0] = w/2; planes[1][1] = h/2; planes[1][2] = 4;
+            break;
+        case VLC_CODEC_GREY:
+            i_planes = 1;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 1;
+            break;
+        case VLC_CODEC_YUYV: case VLC_CODEC_YVYU:
+        case VLC_CODEC_UYVY: case VLC_CODEC_VYUY:
+            i_planes = 1;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 2;
+            break;
+        case VLC_CODEC_RGB24:
+            i_planes = 1;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 3;
+            break;
+        case VLC_CODEC_RGB32: case VLC_CODEC_RGBA:
+            i_planes = 1;
+            planes[0][0] = w;   planes[0][1] = h;   planes[0][2] = 4;
+            break;
+        default:
+            return NULL;
+    }
+
+    picture_t *p_picture = (picture_t*)calloc( 1, sizeof(picture_t) );
+    if (p_picture == NULL)
+        return NULL;
+
+    p_picture->format = *p_fmt;
+    p_picture->gc.refcount.u = 1;
+    p_picture->gc.pf_destroy = picture_Destroy;
+
+    for (int i=0; i<i_planes; i++) {
+        if (plane_Alloc( &p_picture->p[i], planes[i][0], planes[i][1], planes[i][2] )) {
+            picture_Destroy( p_picture );
+            return NULL;
+        }
+        p_picture->i_planes++;
+    }
+
+    return p_picture;
+}
+
+void picture_Release( picture_t *p_picture )
+{
+    if (__atomic_sub_fetch( &p_picture->gc.refcount.u, 1, __ATOMIC_SEQ_CST ) == 0)
+        p_picture->gc.pf_destroy( p_picture );
+}
+
+void picture_CopyPixels( picture_t *p_dst, const picture_t *p_src )
+{
+    for (int i=0; i<p_src->i_planes; i++) {
+        const plane_t *src = &p_src->p[i];
+        plane_t *dst = &p_dst->p[i];
+        const int lines = __MIN( src->i_visible_lines, dst->i_visible_lines ),
+                  pitch = __MIN( src->i_visible_pitch, dst->i_visible_pitch );
+
+        for (int y=0; y<lines; y++)
+            memcpy( dst->p_pixels + y*dst->i_pitch, src->p_pixels + y*src->i_pitch, pitch );
+    }
+}
+
+void picture_CopyProperties( picture_t *p_dst, const picture_t *p_src )
+{
+    p_dst->date = p_src->date;
+    p_dst->b_force = p_src->b_force;
+    p_dst->b_progressive = p_src->b_progressive;
+    p_dst->b_top_field_first = p_src->b_top_field_first;
+    p_dst->i_nb_fields = p_src->i_nb_fields;
+}
+
+picture_t *filter_NewPicture( filter_t *p_filter )
+{
+    return picture_NewFromFormat( &p_filter->fmt_out.video );
+}
+
+image_handler_t *image_HandlerCreate( void *p_this )
+{
+    VLC_UNUSED(p_this);
+    return NULL;
+}
+
+void image_HandlerDelete( image_handler_t *p_image )
+{
+    VLC_UNUSED(p_image);
+}
+
+picture_t *image_Convert( image_handler_t *p_image, picture_t *p_pic,
+                          video_format_t *p_fmt_in, video_format_t *p_fmt_out )
+{
+    VLC_UNUSED(p_image); VLC_UNUSED(p_pic);
+    VLC_UNUSED(p_fmt_in); VLC_UNUSED(p_fmt_out);
+    return NULL;
+}
+
+/*****************************************************************************
+ * Variables and configuration
+ *****************************************************************************/
+int var_Create( void *p_this, const char *psz_name, int i_type )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name); VLC_UNUSED(i_type);
+    return VLC_SUCCESS;
+}
+
+void var_Destroy( void *p_this, const char *psz_name )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name);
+}
+
+int var_AddCallback( void *p_this, const char *psz_name, vlc_callback_t cb, void *p_data )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name); VLC_UNUSED(cb); VLC_UNUSED(p_data);
+    return VLC_SUCCESS;
+}
+
+int var_DelCallback( void *p_this, const char *psz_name, vlc_callback_t cb, void *p_data )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name); VLC_UNUSED(cb); VLC_UNUSED(p_data);
+    return VLC_SUCCESS;
+}
+
+int var_SetBool( void *p_this, const char *psz_name, bool b )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name); VLC_UNUSED(b);
+    return VLC_SUCCESS;
+}
+
+int var_SetInteger( void *p_this, const char *psz_name, int64_t i )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name); VLC_UNUSED(i);
+    return VLC_SUCCESS;
+}
+
+int var_SetFloat( void *p_this, const char *psz_name, float f )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name); VLC_UNUSED(f);
+    return VLC_SUCCESS;
+}
+
+bool var_CreateGetBool( void *p_this, const char *psz_name )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name);
+    return false;
+}
+
+bool var_CreateGetBoolCommand( void *p_this, const char *psz_name )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name);
+    return false;
+}
+
+int64_t var_CreateGetInteger( void *p_this, const char *psz_name )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name);
+    return 0;
+}
+
+int64_t var_CreateGetIntegerCommand( void *p_this, const char *psz_name )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name);
+    return 0;
+}
+
+char *var_CreateGetString( void *p_this, const char *psz_name )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_name);
+    return strdup( "" );
+}
+
+void config_ChainParse( void *p_this, const char *psz_prefix,
+                        const char *const *ppsz_options, config_chain_t *p_cfg )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_prefix);
+    VLC_UNUSED(ppsz_options); VLC_UNUSED(p_cfg);
+}
+
+/*****************************************************************************
+ * Threads, clock and cpu
+ *****************************************************************************/
+int vlc_clone( vlc_thread_t *p_handle, void *(*entry)( void * ), void *p_data, int i_priority )
+{
+    VLC_UNUSED(i_priority);
+    return pthread_create( p_handle, NULL, entry, p_data );
+}
+
+mtime_t mdate( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (mtime_t)ts.tv_sec * CLOCK_FREQ + ts.tv_nsec / 1000;
+}
+
+unsigned vlc_CPU( void )
+{
+    unsigned i_capabilities = 0;
+#if defined(__i386__) || defined(__x86_64__)
+    if (__builtin_cpu_supports( "mmx" ))    i_capabilities |= CPU_CAPABILITY_MMX;
+    if (__builtin_cpu_supports( "sse" ))    i_capabilities |= CPU_CAPABILITY_SSE;
+    if (__builtin_cpu_supports( "sse2" ))   i_capabilities |= CPU_CAPABILITY_SSE2;
+    if (__builtin_cpu_supports( "sse3" ))   i_capabilities |= CPU_CAPABILITY_SSE3;
+    if (__builtin_cpu_supports( "ssse3" ))  i_capabilities |= CPU_CAPABILITY_SSSE3;
+    if (__builtin_cpu_supports( "sse4.1" )) i_capabilities |= CPU_CAPABILITY_SSE4_1;
+    if (__builtin_cpu_supports( "sse4.2" )) i_capabilities |= CPU_CAPABILITY_SSE4_2;
+#endif
+    return i_capabilities;
+}
+
+unsigned vlc_GetCPUCount( void )
+{
+    long count = sysconf( _SC_NPROCESSORS_ONLN );
+    return count > 0 ? (unsigned)count : 1;
+}
@@ -0,0 +1,42 @@
+/*****************************************************************************
+ * vlc_variables.h : Stand-in for the vlc object variables
+ *****************************************************************************
+ * Variables are not stored, every variable reads as 0/false/"".
+ *****************************************************************************/
+
+#ifndef HISTOGRAM_BENCH_VLC_VARIABLES_H
+#define HISTOGRAM_BENCH_VLC_VARIABLES_H 1
+
+#include <vlc_common.h>
+
+#define VLC_VAR_BOOL        0x0020
+#define VLC_VAR_INTEGER     0x0030
+#define VLC_VAR_FLOAT       0x0050
+#define VLC_VAR_ISCOMMAND   0x2000
+#define VLC_VAR_DOINHERIT   0x8000
+
+typedef union
+{
+    int64_t  i_int;
+    bool     b_bool;
+    float    f_float;
+    char    *psz_string;
+} vlc_value_t;
+
+typedef int ( * vlc_callback_t ) ( vlc_object_t *, char const *,
+                                   vlc_value_t, vlc_value_t, void * );
+
+int var_Create( void *, const char *, int );
+void var_Destroy( void *, const char * );
+int var_AddCallback( void *, const char *, vlc_callback_t, void * );
+int var_DelCallback( void *, const char *, vlc_callback_t, void * );
+int var_SetBool( void *, const char *, bool );
+int var_SetInteger( void *, const char *, int64_t );
+int var_SetFloat( void *, const char *, float );
+bool var_CreateGetBool( void *, const char * );
+bool var_CreateGetBoolCommand( void *, const char * );
+int64_t var_CreateGetInteger( void *, const char * );
+int64_t var_CreateGetIntegerCommand( void *, const char * );
+char *var_CreateGetString( void *, const char * );
+
+#endif
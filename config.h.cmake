@@ -3,6 +3,9 @@
 
 @CONFIG_PNG_DEFINE@
 @CONFIG_DEBUG@
+@CONFIG_PROFILE@
 @CONFIG_ENDIAN_DEFINE@
+@CONFIG_SSE2_DEFINE@
+@CONFIG_AVX2_DEFINE@
 
 #endif /*CONFIG_H*/
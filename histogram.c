@@ -28,21 +28,35 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_variables.h>
+#include <vlc_atomic.h>
 
 #include <vlc_image.h>
 #include <vlc_keys.h>
 
 #include <vlc_filter.h>
+#include <vlc_cpu.h>
 
 #include <png.h>
 
 #include "config.h"
 
+#ifdef HAVE_SSE2_INTRINSICS
+#include <emmintrin.h>
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+#include <immintrin.h>
+#endif
+#ifdef HISTOGRAM_PROFILE
+#include <inttypes.h>
+#include <time.h>
+#endif
+
 #include "filter_picture.h"
 
 /*****************************************************************************
@@ -58,15 +72,80 @@ static void Close     ( vlc_object_t * );
 
 static picture_t *Filter( filter_t *, picture_t * );
 
-static int picture_YUVA_BlendToI420( picture_t *p_out, picture_t *p_histo, int x0, int y0 );
-static int picture_YUVA_BlendToI422( picture_t *p_out, picture_t *p_histo, int x0, int y0 );
-static int picture_YUVA_BlendToYUYV( picture_t *p_out, picture_t *p_histo, int x0, int y0 );
-static int picture_YUVA_BlendToYV12( picture_t *p_out, picture_t *p_histo, int x0, int y0 );
-static int picture_YUVA_BlendToYV16( picture_t *p_out, picture_t *p_histo, int x0, int y0 );
-static int picture_YUVA_BlendToY800( picture_t *p_out, picture_t *p_histo, int x0, int y0 );
-static int picture_RGBA_BlendToRGB24( picture_t *p_out, picture_t *p_histo, int x0, int y0 );
-static int picture_RGBA_BlendToRGB32( picture_t *p_out, picture_t *p_histo, int x0, int y0 );
+/**
+ * Row kernels of the blend functions, see histogram_blend_rows().
+ *
+ * o points to the output samples, pm/y/u/v/bgra to the premultiplied
+ * overlay samples and a to their alpha. n counts output samples, or
+ * overlay pixels for yuyv, rgb24 and rgb32, or output pairs for
+ * chroma4_uv.
+ */
+typedef struct {
+    void (*bytes)  ( uint8_t *o, const uint8_t *pm, const uint8_t *a, int n );
+    void (*chroma2)( uint8_t *o, const uint8_t *pm, const uint8_t *a, int n );
+    void (*chroma4)( uint8_t *o, const uint8_t *pm, int pm_pitch,
+                     const uint8_t *a, int a_pitch, int n );
+    void (*chroma4_uv)( uint8_t *o, const uint8_t *u, const uint8_t *v, int pm_pitch,
+                        const uint8_t *a, int a_pitch, int n );
+    void (*yuyv)   ( uint8_t *o, const uint8_t *y, const uint8_t *u,
+                     const uint8_t *v, const uint8_t *a, int n );
+    void (*rgb24)  ( uint8_t *o, const uint8_t *bgra, int n );
+    void (*rgb32)  ( uint8_t *o, const uint8_t *bgra, int n );
+} histogram_blend_rows_t;
+
+static const histogram_blend_rows_t* histogram_blend_rows( unsigned cpu );
+
+/**
+ * Row kernels of histogram_scale(), see histogram_scale_rows().
+ *
+ * Scale n counts of src to heights in dst, dst may be src: by a 32.32
+ * reciprocal recip, the counts or their histogram_log2().
+ */
+typedef struct {
+    void (*linear)( uint64_t recip, const uint32_t *src, uint32_t *dst, int n );
+    void (*log)   ( uint64_t recip, const uint32_t *src, uint32_t *dst, int n );
+} histogram_scale_rows_t;
+
+static const histogram_scale_rows_t* histogram_scale_rows( unsigned cpu );
+
+/** Columns [x0,x1) of an overlay row hold all its non transparent pixels */
+typedef struct {
+    int x0, x1;
+} histogram_span_t;
+
+/** A rectangle of the picture, in pixels of the first plane */
+typedef struct {
+    int x, y, width, height;
+} histogram_roi_t;
+
+static int picture_YUVA_BlendToI420( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_YUVA_BlendToI422( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_YUVA_BlendToYUYV( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_YUVA_BlendToNV12( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_YUVA_BlendToNV21( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_YUVA_BlendToYV12( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_YUVA_BlendToYV16( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_YUVA_BlendToY800( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_YUVA_BlendToY16( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                    const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_YUVA_BlendToYUV16( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_RGBA_BlendToRGB24( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
+static int picture_RGBA_BlendToRGB32( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                                     const histogram_span_t *spans, const histogram_blend_rows_t *rows );
 static picture_t* picture_CopyAndRelease(filter_t *p_filter, picture_t *p_pic);
+static picture_t* picture_MakeWritable( filter_t *p_filter, picture_t *p_pic );
+static void picture_PlaneShift( const picture_t *p_pic, int i, int *x_shift, int *y_shift );
+static void picture_CropView( picture_t *p_view, const picture_t *p_pic, int x, int y, int width, int height );
 static picture_t* picture_convertTo( vlc_fourcc_t i_chroma_out, picture_t *p_pic, filter_t *p_filter, int *new_picture );
 static picture_t* picture_RGB24_ConvertToOutputFmt( filter_t *p_filter, picture_t *p_bgr );
 static void picture_ZeroPixels( picture_t *p_pic );
@@ -92,6 +171,36 @@ static const int     BOTTOM_MARGIN          = 10;
 static const int     HISTOGRAM_HEIGHT       = 50;  /**< Default histogram height                        */
 static const int     HISTOGRAM_MIN_HEIGHT   = 50;  /**< Default histogram height                        */
 static const int     HISTOGRAM_ALPHA        = 150; /**< Default alpha value                             */
+static const int     WAVEFORM_HEIGHT        = 100; /**< Value levels of the waveform monitor            */
+static const int     WAVEFORM_MIN_GLOW      = 40;  /**< Brightness of the least counted waveform pixels */
+static const int     VECTORSCOPE_SIZE       = 128; /**< Cb/Cr cells per side of the vectorscope        */
+static const uint8_t GRATICULE_PIXEL_VALUE  = 70;  /**< The value of the vectorscope circle and axes    */
+static const int     PEAK_ALPHA             = 255; /**< Alpha value of the peak-hold line               */
+static const int     VIDEO_BLACK_LEVEL      = 16;  /**< Lowest luma of the video range, 8-bit scale    */
+static const int     VIDEO_WHITE_LEVEL      = 235; /**< Highest luma of the video range, 8-bit scale   */
+
+#define LUMA_SUB_HISTOGRAMS 4 /**< Interleaved sub-histograms used by the SIMD luma kernels */
+#define HISTOGRAM_RAW_BINS  1024 /**< Luma bins of high bit depth pictures (10-bit) */
+#define HISTOGRAM_8BIT_BINS 256  /**< Bins of 8-bit samples, one per value          */
+#define RGB_SUB_HISTOGRAMS  4 /**< Interleaved sub-histograms used by the RGB24/RGB32 kernels */
+#define HISTOGRAM_ALIGNED( n ) __attribute__((aligned(n)))
+
+#ifdef HAVE_SSE2_INTRINSICS
+#   define HISTOGRAM_SSE2_KERNEL( f ) f##_sse2
+#else
+#   define HISTOGRAM_SSE2_KERNEL( f ) NULL
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+#   define HISTOGRAM_AVX2_KERNEL( f ) f##_avx2
+#else
+#   define HISTOGRAM_AVX2_KERNEL( f ) NULL
+#endif
+
+/*Instruction sets the kernels may use, see histogram_cpu_detect()*/
+#define HISTOGRAM_CPU_SSE2   (1<<0)
+#define HISTOGRAM_CPU_SSSE3  (1<<1)
+#define HISTOGRAM_CPU_AVX2   (1<<2)
+#define HISTOGRAM_CPU_AVX512 (1<<3)
 
 /*Return values*/
 static const int     HIST_SUCCESS           = -0;
@@ -100,46 +209,321 @@ static const int     HIST_COLOR_UNSUPPORTED = -2;
 static const int     HIST_INPUT_ERROR       = -3;
 static const int     HIST_ERROR             = -4;
 
+typedef enum {
+    Y = 0, /**< Y-bins offset */
+    R = 0, /**< R-bins offset */
+    G = 1, /**< G-bins offset */
+    B = 2, /**< B-bins offset */
+} histo_channels_e;
+
+typedef enum {
+    HISTO_Y        = 0,
+    HISTO_RGB      = 1,
+    HISTO_WAVEFORM = 2, /**< Luma waveform monitor, see histogram_wave_set_codec() */
+    HISTO_VECTORSCOPE = 3, /**< Cb/Cr occupancy, see histogram_scope_set_codec() */
+} histo_type_e;
+
+typedef enum {
+    HISTO_SMOOTH_OFF    = 0,
+    HISTO_SMOOTH_EMA    = 1, /**< Exponential moving average of the counts     */
+    HISTO_SMOOTH_WINDOW = 2, /**< Average of the counts of the last N frames   */
+} histo_smooth_e;
+
 typedef struct histogram_t histogram_t;
+typedef struct histogram_yuv2rgb_t histogram_yuv2rgb_t;
+typedef struct histogram_smooth_t histogram_smooth_t;
+typedef struct histogram_peak_t histogram_peak_t;
 typedef int (*f_fill)( histogram_t*, const picture_t*);
 typedef int (*f_paint)( histogram_t*, picture_t*);
-typedef int (*f_blend)( picture_t*, picture_t*, int, int);
+typedef int (*f_blend)( picture_t*, picture_t*, int, int,
+                        const histogram_span_t*, const histogram_blend_rows_t* );
 
 struct histogram_t {
-    uint32_t*  bins[MAX_NUM_CHANNELS];
-    float      max[MAX_NUM_CHANNELS];
+    uint32_t*  bins[MAX_NUM_CHANNELS];    /**< Raw counts, kept by histogram_normalize() */
+    uint32_t*  heights[MAX_NUM_CHANNELS]; /**< Bar heights or intensities of the counts  */
+    uint32_t   max[MAX_NUM_CHANNELS]; /**< Largest count, then largest height        */
+    uint32_t*  painted[MAX_NUM_CHANNELS]; /**< Bar heights currently on the overlay   */
+    uint8_t*   dirty;            /**< Per column, bit c: repaint channel c          */
+    bool       repaint;          /**< The whole overlay must be painted             */
     int        x0,               /**< x offset from left of image                   */
                y0,               /**< y offset from bottom of image                 */
                height,           /**< histogram height in pixelsage                 */
                num_channels,     /**< #of channels (1: Y, 3: RGB)ge                 */
-               num_bins;         /**< The number of histogram binse                 */
+               num_bins,         /**< The number of histogram binse                 */
+               num_raw_bins,     /**< Bins filled per channel, >= num_bins          */
+               sample_shift,     /**< 16-bit sample to 10-bit value right shift     */
+               x_step,           /**< Sample every x_step column (fill units)       */
+               y_step,           /**< Sample every y_step row (fill units)          */
+               y_sampled;        /**< The input has every y_sampled row only        */
+    histo_type_e type;           /**< The histogram type                            */
     picture_t* p_overlay;        /**< A pointer to the histogram overlay picture    */
+    histogram_span_t* spans;     /**< Non transparent span of each overlay row      */
+    histogram_roi_t roi;         /**< Filled rectangle, width 0: the whole picture  */
+    int        grid_cols,        /**< Tiles per row of the grid, 1x1: no grid       */
+               grid_rows,        /**< Tiles per column of the grid                  */
+               cell_bins,        /**< Bins per tile, once normalized                */
+               cell_height;      /**< Max bar height of a tile, once normalized     */
+    uint32_t*  tiles[MAX_NUM_CHANNELS]; /**< Per tile bins, see histogram_tile()    */
+    uint32_t*  tile_heights[MAX_NUM_CHANNELS]; /**< Per tile bar heights, cell_bins each */
     f_fill     fill_func;
     f_paint    paint_func;
     f_blend    blend_func;
+    const histogram_blend_rows_t* blend_rows; /**< Row kernels of blend_func       */
+    const histogram_scale_rows_t* scale_rows; /**< Row kernels of histogram_normalize() */
+    histogram_yuv2rgb_t* yuv2rgb; /**< YUV->RGB bin lookup tables (RGB from YUV only) */
+    histogram_smooth_t* smooth;  /**< Temporal smoothing, NULL: off                 */
+    histogram_peak_t* peak;      /**< Peak-hold line, NULL: off                     */
+};
+
+/** Waveform and vectorscope: bins[Y] holds 2D counts, heights[Y] their intensities */
+static inline bool histogram_is_density( const histogram_t *h )
+{
+    return h->type == HISTO_WAVEFORM || h->type == HISTO_VECTORSCOPE;
+}
+
+#define SMOOTH_EMA_BITS   16     /**< Fraction bits of the moving average            */
+
+/**
+ * Temporal smoothing of the counts, see histogram_smooth().
+ *
+ * Each channel has size counts: the bins, then the tiles of the grid. The
+ * window keeps the counts of the last frames in a ring, and their sum, so
+ * a frame costs one add and one subtract per count whatever its length.
+ */
+struct histogram_smooth_t {
+    histo_smooth_e mode;
+    int       frames,            /**< Window length, or time constant of the EMA    */
+              filled,            /**< Frames smoothed so far, up to frames          */
+              next,              /**< Ring slot of the next frame                   */
+              size;              /**< Counts per channel                            */
+    unsigned  phase;             /**< Sampling phase of the next fill               */
+    int64_t*  ema[MAX_NUM_CHANNELS];  /**< Counts << SMOOTH_EMA_BITS                */
+    uint32_t* ring[MAX_NUM_CHANNELS]; /**< frames x size counts                     */
+    uint32_t* sum[MAX_NUM_CHANNELS];  /**< Sum of the ring                          */
+};
+
+/**
+ * Peak-hold state, see histogram_peak_hold().
+ *
+ * Every overlay bin has a monotonic deque of (frame, count) pairs: the
+ * counts decrease from the front to the back, and the front is the maximum
+ * of the last frames. Each count is pushed and popped at most once, so a
+ * frame costs O(1) amortized per bin, whatever the number of frames held.
+ */
+struct histogram_peak_t {
+    int       frames,            /**< Frames held                                   */
+              size;              /**< Bins per channel: num_bins                    */
+    uint32_t  frame;             /**< Number of the next frame                      */
+    uint32_t* heights[MAX_NUM_CHANNELS]; /**< Line heights of the held counts       */
+    uint32_t* count[MAX_NUM_CHANNELS]; /**< size deques of frames counts             */
+    uint32_t* stamp[MAX_NUM_CHANNELS]; /**< Frame number of each count              */
+    uint16_t* head[MAX_NUM_CHANNELS];  /**< Front slot of each deque                */
+    uint16_t* len[MAX_NUM_CHANNELS];   /**< Length of each deque                    */
+    uint32_t* held[MAX_NUM_CHANNELS];  /**< Held count of each bin                  */
+    uint32_t* painted[MAX_NUM_CHANNELS]; /**< Line heights currently on the overlay */
+};
+
+/** Statistics of the counts of one channel, values on the 8-bit scale */
+typedef struct {
+    float    mean,
+             stddev,
+             p1,                 /**< 1% of the pixels are at or below this value   */
+             p50,
+             p99;
+    uint64_t under,              /**< Pixels below black: crushed blacks            */
+             over;               /**< Pixels above white: clipped whites            */
+} histogram_channel_stats_t;
+
+/** Statistics of a histogram, see histogram_stats() */
+typedef struct {
+    histo_type_e type;           /**< HISTO_Y: channel[Y], HISTO_RGB: channel[R..B] */
+    histogram_channel_stats_t channel[MAX_NUM_CHANNELS];
+} histogram_stats_t;
+
+#define YUV2RGB_SCALEBITS 10     /**< Fixed point precision of yuv_to_rgb()          */
+#define YUV2RGB_OFFSET    512    /**< Offset of the first entry in yuv2rgb->bin[]     */
+#define YUV2RGB_RANGE     1536   /**< Covers every (y + chroma)>>SCALEBITS value      */
+
+/**
+ * Precomputed yuv_to_rgb() contributions.
+ *
+ * A sample converts to R/G/B bin indices with table loads and adds only:
+ * bin[(y[Y] + r_cr[V]) >> YUV2RGB_SCALEBITS] is the R bin of (Y,U,V).
+ * YUV2RGB_OFFSET is folded into y[], bin[] clamps to 0..255 and applies
+ * the right shift for the current num_bins.
+ */
+struct histogram_yuv2rgb_t {
+    int32_t y[256],
+            r_cr[256],
+            g_cb[256],
+            g_cr[256],
+            b_cb[256];
+    uint8_t bin[YUV2RGB_RANGE];
 };
 #ifdef HISTOGRAM_DEBUG
 static void dump_histogram( histogram_t *histo );
 #endif
 
-typedef enum {
-    Y = 0, /**< Y-bins offset */
-    R = 0, /**< R-bins offset */
-    G = 1, /**< G-bins offset */
-    B = 2, /**< B-bins offset */
-} histo_channels_e;
+#define HISTOGRAM_MAX_THREADS 16 /**< Upper limit for the fill worker pool          */
+
+typedef struct histogram_pool_t histogram_pool_t;
+
+/** A fill worker, owns a private copy of the histogram bins */
+typedef struct {
+    histogram_pool_t* pool;
+    vlc_thread_t      thread;
+    histogram_t       h;          /**< Shadow of the job histogram, with private bins*/
+    picture_t         slice;      /**< View on the rows this worker should fill      */
+    int               num_bins;   /**< Allocated size of h.bins[i]                   */
+    unsigned          generation; /**< Job this worker was given a slice of          */
+    int               status;     /**< Result of the fill of the slice               */
+} histogram_worker_t;
+
+/**
+ * Persistent pool of fill workers.
+ *
+ * histogram_pool_fill() splits the visible rows of the source picture in
+ * num_workers+1 slices. The calling thread fills the first slice directly
+ * into the histogram, the workers fill the rest into their private bins,
+ * which are then added to the histogram.
+ */
+struct histogram_pool_t {
+    vlc_mutex_t        lock;
+    vlc_cond_t         wait_job,    /**< Signaled when a new job is posted          */
+                       wait_done;   /**< Signaled when the last worker is done      */
+    unsigned           generation;  /**< Incremented for every posted job, only the
+                                         workers given a slice take it              */
+    int                pending,     /**< #of workers still busy with the job        */
+                       num_workers;
+    bool               quit;
+    histogram_worker_t workers[HISTOGRAM_MAX_THREADS-1];
+};
+
+static histogram_pool_t* histogram_pool_new( int num_threads );
+static void histogram_pool_delete( histogram_pool_t *pool );
+static int histogram_pool_fill( histogram_pool_t *pool, histogram_t *h, const picture_t *p_in );
 
+#ifdef HISTOGRAM_PROFILE
+/** The timed stages of Filter() */
 typedef enum {
-    HISTO_Y     = 0,
-    HISTO_RGB   = 1,
-} histo_type_e;
+    STAGE_COPY = 0,     /**< picture_MakeWritable()                          */
+    STAGE_FILL,         /**< histogram_zero() and histogram_fill()           */
+    STAGE_UPDATE_MAX,
+    STAGE_NORMALIZE,
+    STAGE_PAINT,
+    STAGE_BLEND,
+    NUM_STAGES
+} histo_stage_e;
+
+#define LATENCY_SUB_BITS 2   /**< Buckets per power of 2 = 1<<LATENCY_SUB_BITS */
+#define LATENCY_BUCKETS  160 /**< Up to 2^40ns (~18 minutes), then saturates   */
+
+/**
+ * Log bucketed latency histogram of one stage, in fixed memory.
+ *
+ * Every power of two of nanoseconds is split in 4 buckets, so a
+ * percentile is within 25% of the true value. The mean and max are exact.
+ */
+typedef struct {
+    uint32_t count[LATENCY_BUCKETS];
+    uint64_t n,
+             sum_ns,
+             max_ns;
+} histogram_latency_t;
+
+/**
+ * Stage latencies of a filter instance.
+ *
+ * Every stage is recorded by a single thread: the video filter thread, or
+ * the analysis thread for fill..paint in async mode.
+ */
+typedef struct {
+    histogram_latency_t stage[NUM_STAGES];
+} histogram_profile_t;
+
+static uint64_t histogram_profile_now( void );
+static void histogram_profile_record( histogram_profile_t *profile, histo_stage_e stage, uint64_t ns );
+static void histogram_profile_report( vlc_object_t *p_this, const histogram_profile_t *profile );
+
+/** Start timing in t, then record the time since the last PROFILE_* in stage */
+#define PROFILE_START( t ) uint64_t t = histogram_profile_now()
+#define PROFILE_LAP( profile, stage, t ) do { \
+        uint64_t now_ = histogram_profile_now(); \
+        histogram_profile_record( profile, stage, now_ - t ); \
+        t = now_; \
+    } while (0)
+#else
+#define PROFILE_START( t )
+#define PROFILE_LAP( profile, stage, t )
+#endif
+
+/** The settings a background analysis is run with */
+typedef struct {
+    histo_type_e type;
+    vlc_fourcc_t codec;
+    unsigned     cpu;
+    int          width,          /**< Visible size of the filtered pictures        */
+                 height;
+    int          x_step,
+                 y_step,
+                 y_sampled;      /**< Rows already sampled by the snapshot         */
+    histogram_roi_t roi;
+    int          grid_cols,
+                 grid_rows;
+    histo_smooth_e smooth;
+    int          smooth_frames,
+                 peak_frames;
+    bool         log,
+                 equalize,
+                 stats,          /**< Compute the statistics of the counts         */
+                 fill;           /**< false: normalize and paint the last counts   */
+} histogram_job_t;
+
+/**
+ * Background analysis thread.
+ *
+ * histogram_async_post() copies what the fill reads of a picture to a
+ * snapshot owned by the thread, which fills, normalizes and paints its own
+ * (back) histogram from it. The painted overlay is then copied to the
+ * overlay of the front histogram, the one the filter blends, so blending
+ * never waits for an analysis to complete. The filtered picture itself is
+ * never held, it stays writable and is blended in place.
+ */
+typedef struct {
+    vlc_mutex_t       lock;         /**< Protects busy and h_front->p_overlay       */
+    vlc_cond_t        wait;
+    vlc_thread_t      thread;
+    bool              busy;         /**< A job is posted or being analysed          */
+    picture_t*        p_snap;       /**< Input of the job, written only when idle   */
+    histogram_job_t   job;
+    histogram_t*      h_back;       /**< Private to the thread                      */
+    histogram_t*      h_front;      /**< Receives the completed overlays            */
+    histogram_stats_t stats;        /**< Statistics of the last completed job       */
+    bool              stats_ready;  /**< stats not taken yet                        */
+    histogram_pool_t* pool;         /**< Fill workers of the thread, or NULL        */
+#ifdef HISTOGRAM_PROFILE
+    histogram_profile_t* profile;   /**< Receives the fill..paint latencies         */
+#endif
+    bool              quit;
+} histogram_async_t;
+
+static histogram_async_t* histogram_async_new( histogram_pool_t *pool );
+static void histogram_async_delete( histogram_async_t *async );
+static void histogram_async_set_front( histogram_async_t *async, histogram_t *h );
+static bool histogram_async_post( histogram_async_t *async, const histogram_t *h, const picture_t *p_pic,
+                                  const histogram_job_t *job );
+static int histogram_async_blend( histogram_async_t *async, picture_t *p_out );
+static bool histogram_async_stats( histogram_async_t *async, histogram_stats_t *stats );
 
 static int histogram_check_codec( histo_type_e type, vlc_fourcc_t i_codec );
 
 static int histogram_init( histogram_t **h_in, picture_t *p_in, histo_type_e type );
-static int histogram_set_codec( histogram_t *h, vlc_fourcc_t i_codec );
+static int histogram_set_codec( histogram_t *h, vlc_fourcc_t i_codec, unsigned cpu );
 static int histogram_init_picture_yuva( histogram_t *h );
 static int histogram_init_picture_rgba( histogram_t *h );
+static int histogram_init_yuv2rgb( histogram_t *h );
+static int histogram_init_raw_bins( histogram_t *h, int num_raw_bins );
+static int histogram_hbd_shift( vlc_fourcc_t i_codec );
 static int histogram_rgb_fillFromRGB24( histogram_t *h, const picture_t *p_bgr );
 static int histogram_rgb_fillFromRGB32( histogram_t *h, const picture_t *p_bgr );
 static int histogram_rgb_fillFromI420( histogram_t *h_rgb, const picture_t *p_yuv );
@@ -147,15 +531,51 @@ static int histogram_rgb_fillFromI422( histogram_t *h_rgb, const picture_t *p_yu
 static int histogram_rgb_fillFromYUYV( histogram_t *h_rgb, const picture_t *p_yuv );
 static int histogram_rgb_fillFromYV12( histogram_t *h_rgb, const picture_t *p_yuv );
 static int histogram_rgb_fillFromYV16( histogram_t *h_rgb, const picture_t *p_yuv );
-static int histogram_rgb_fillFromRGB24_32( histogram_t *h, const picture_t *p_bgr, bool rgb24 );
 static int histogram_rgb_fillFromYUV420( histogram_t *h_rgb, const picture_t *p_yuv, bool switch_uv );
+static int histogram_rgb_fillFromNV12( histogram_t *h_rgb, const picture_t *p_yuv );
+static int histogram_rgb_fillFromNV21( histogram_t *h_rgb, const picture_t *p_yuv );
+static int histogram_rgb_fillFromSemiPlanar420( histogram_t *h_rgb, const picture_t *p_yuv, bool switch_uv );
+static int histogram_rgb_fillFromYUV16( histogram_t *h_rgb, const picture_t *p_yuv );
 static int histogram_yuv_fillFromRGB24( histogram_t *h, const picture_t *p_bgr );
 static int histogram_yuv_fillFromRGB32( histogram_t *h, const picture_t *p_bgr );
 static int histogram_yuv_fillFromYUVPlanar( histogram_t *h, const picture_t *p_yuv );
 static int histogram_yuv_fillFromYUYV( histogram_t *h, const picture_t *p_yuv );
+static int histogram_yuv_fillFromYUV16( histogram_t *h, const picture_t *p_yuv );
+#ifdef HAVE_SSE2_INTRINSICS
+static int histogram_yuv_fillFromYUVPlanar_sse2( histogram_t *h, const picture_t *p_yuv );
+static int histogram_yuv_fillFromYUYV_sse2( histogram_t *h, const picture_t *p_yuv );
+static int histogram_yuv_fillFromRGB24_sse2( histogram_t *h, const picture_t *p_bgr );
+static int histogram_yuv_fillFromRGB32_sse2( histogram_t *h, const picture_t *p_bgr );
+#endif
+#ifdef HAVE_AVX2_INTRINSICS
+static int histogram_yuv_fillFromYUVPlanar_avx2( histogram_t *h, const picture_t *p_yuv );
+static int histogram_yuv_fillFromYUYV_avx2( histogram_t *h, const picture_t *p_yuv );
+#endif
+static int histogram_cpu_detect( const char *psz_simd, unsigned *cpu );
+static const char* histogram_cpu_name( unsigned cpu );
+static f_fill histogram_luma_kernel( unsigned cpu, f_fill scalar, f_fill sse2, f_fill avx2 );
 static int histogram_update_max( histogram_t *h );
 static int histogram_free( histogram_t **h );
 static int histogram_normalize( histogram_t *h, bool log, bool equalize );
+static int histogram_set_grid( histogram_t *h, int cols, int rows );
+static int histogram_set_smooth( histogram_t *h, histo_smooth_e mode, int frames );
+static int histogram_smooth_mode( const char *psz_mode, histo_smooth_e *mode );
+static int histogram_smooth( histogram_t *h );
+static void histogram_smooth_free( histogram_smooth_t *s );
+static int histogram_set_peak_hold( histogram_t *h, int frames );
+static int histogram_peak_hold( histogram_t *h );
+static inline uint32_t histogram_fold( const histogram_t *h, int c, int b );
+static int histogram_stats( const histogram_t *h, histogram_stats_t *stats );
+static void histogram_peak_free( histogram_peak_t *p );
+static bool histogram_phase_view( const histogram_t *h, const picture_t *p_in, picture_t *p_view );
+static int histogram_grid_fill( histogram_t *h, const picture_t *p_in, histogram_pool_t *pool );
+static void histogram_grid_normalize( histogram_t *h, bool log, bool equalize );
+static int histogram_grid_paintToYUVA( histogram_t *h, picture_t *p_yuv );
+static int histogram_grid_paintToRGBA( histogram_t *h, picture_t *p_bgra );
+static int histogram_wave_set_codec( histogram_t *h, vlc_fourcc_t i_codec );
+static int histogram_scope_set_codec( histogram_t *h, vlc_fourcc_t i_codec );
+static void histogram_density_update_max( histogram_t *h );
+static int histogram_density_normalize( histogram_t *h, bool log );
 static int histogram_rgb_paintToRGBA( histogram_t *h, picture_t *p_bgr );
 static int histogram_rgb_paintToYUVA( histogram_t *histo, picture_t *p_yuv );
 static int histogram_yuv_paintToRGBA( histogram_t *h, picture_t *p_yuv );
@@ -163,17 +583,130 @@ static int histogram_yuv_paintToYUVA( histogram_t *h, picture_t *p_yuv );
 static int histogram_bins( int w );
 static int histogram_height_rgb( int h );
 static int histogram_height_yuv( int h );
-static int histogram_fill( histogram_t *h, const picture_t *p_in );
+static int histogram_height_waveform( int h );
+static int histogram_height_scope( int h );
+static int histogram_fill( histogram_t *h, const picture_t *p_in, histogram_pool_t *pool );
 static void histogram_zero( histogram_t *h );
 static int histogram_paint( histogram_t *h );
 static int histogram_blend( histogram_t *h, picture_t *p_out );
 
 static int KeyEvent( vlc_object_t *p_this, char const *psz_var,
                      vlc_value_t oldval, vlc_value_t newval, void *p_data );
+static int RoiCallback( vlc_object_t *p_this, char const *psz_var,
+                        vlc_value_t oldval, vlc_value_t newval, void *p_data );
+static int StatsCallback( vlc_object_t *p_this, char const *psz_var,
+                          vlc_value_t oldval, vlc_value_t newval, void *p_data );
+static void StatsPublish( filter_t *p_filter, const histogram_stats_t *stats );
 
 #define PDUMP( pic ) dump_picture( pic, #pic );
 #define DBG fprintf(stdout, "%s(): %03d survived!\n", __func__, __LINE__);
 #define N_( str ) str
+
+#define CFG_PREFIX "histogram-"
+
+#define SAMPLE_X_TEXT N_("Column sampling")
+#define SAMPLE_X_LONGTEXT N_("Only sample every Nth column of the picture " \
+                             "(every Nth chroma column for YUV pictures " \
+                             "in RGB mode).")
+#define SAMPLE_Y_TEXT N_("Row sampling")
+#define SAMPLE_Y_LONGTEXT N_("Only sample every Nth row of the picture " \
+                             "(every Nth chroma row for YUV pictures " \
+                             "in RGB mode).")
+
+#define RATE_TEXT N_("Refresh rate")
+#define RATE_LONGTEXT N_("Maximum number of histogram updates per second " \
+                         "of video, based on the picture timestamps. The " \
+                         "last histogram is still drawn on every frame. " \
+                         "0 updates on every frame, or as set with the " \
+                         "0-9 keys.")
+
+#define ASYNC_TEXT N_("Background analysis")
+#define ASYNC_LONGTEXT N_("Compute the histogram on a separate thread. " \
+                          "Frames are not delayed by the analysis, the " \
+                          "most recent histogram is drawn instead.")
+
+#define SIMD_TEXT N_("SIMD kernels")
+#define SIMD_LONGTEXT N_("Most capable instruction set the fill, normalize " \
+                         "and blend kernels may use, out of the ones the " \
+                         "cpu has. 'scalar' forces the plain C kernels, " \
+                         "eg. to compare their results or speed.")
+
+static const char *const ppsz_simd[] = {
+    "auto", "avx512", "avx2", "ssse3", "sse2", "scalar"
+};
+static const char *const ppsz_simd_text[] = {
+    N_("Auto"), "AVX-512", "AVX2", "SSSE3", "SSE2", N_("Scalar (no SIMD)")
+};
+
+#define THREADS_TEXT N_("Fill threads")
+#define THREADS_LONGTEXT N_("Number of threads used to fill the histogram. " \
+                            "1 fills on the video filter thread, 0 uses one " \
+                            "thread per cpu.")
+
+#define ROI_X_TEXT N_("Region left")
+#define ROI_X_LONGTEXT N_("Left edge of the region of interest, in pixels.")
+#define ROI_Y_TEXT N_("Region top")
+#define ROI_Y_LONGTEXT N_("Top edge of the region of interest, in pixels.")
+#define ROI_WIDTH_TEXT N_("Region width")
+#define ROI_WIDTH_LONGTEXT N_("Width of the region of interest, the histogram " \
+                              "only counts the pixels inside it. 0 counts " \
+                              "the whole picture.")
+#define ROI_HEIGHT_TEXT N_("Region height")
+#define ROI_HEIGHT_LONGTEXT N_("Height of the region of interest. 0 counts " \
+                               "the whole picture.")
+
+#define GRID_COLS_TEXT N_("Grid columns")
+#define GRID_COLS_LONGTEXT N_("Split the picture in a grid of zones and draw " \
+                              "a small histogram for each zone, eg. 3 or 4 " \
+                              "for exposure analysis. 1 draws the histogram " \
+                              "of the whole picture.")
+#define GRID_ROWS_TEXT N_("Grid rows")
+#define GRID_ROWS_LONGTEXT N_("Number of zone rows, see grid columns.")
+
+#define SMOOTH_TEXT N_("Temporal smoothing")
+#define SMOOTH_LONGTEXT N_("Average the histogram over the last frames, " \
+                           "against flicker on noisy or grainy video. " \
+                           "With the sample options, each frame samples " \
+                           "other pixels, so a window of sample-x times " \
+                           "sample-y frames counts every pixel once.")
+#define SMOOTH_FRAMES_TEXT N_("Smoothing frames")
+#define SMOOTH_FRAMES_LONGTEXT N_("Length of the window, or time constant " \
+                                  "of the moving average, in frames.")
+
+#define PEAK_HOLD_TEXT N_("Peak hold")
+#define PEAK_HOLD_LONGTEXT N_("Draw a line at the highest value of each " \
+                              "bar over the last n histogram updates, " \
+                              "to spot short clipping (0: off).")
+
+#define STATS_TEXT N_("Statistics")
+#define STATS_LONGTEXT N_("Publish the mean, standard deviation, " \
+                          "1/50/99 percentiles and clipped pixel counts " \
+                          "of each channel as the histogram-stats-* " \
+                          "variables, on every update. Can be changed " \
+                          "while playing.")
+
+static const char *const ppsz_smooth[] = {
+    "off", "ema", "window"
+};
+static const char *const ppsz_smooth_text[] = {
+    N_("Off"), N_("Exponential moving average"), N_("Window of frames")
+};
+
+static const char *const ppsz_filter_options[] = {
+    "threads", "sample-x", "sample-y", "rate", "async", "simd",
+    "roi-x", "roi-y", "roi-width", "roi-height", "grid-cols", "grid-rows",
+    "smooth", "smooth-frames", "peak-hold", "stats", NULL
+};
+
+/*The region of interest can also be changed while playing*/
+static const char *const ppsz_roi_vars[] = {
+    CFG_PREFIX "roi-x", CFG_PREFIX "roi-y", CFG_PREFIX "roi-width", CFG_PREFIX "roi-height"
+};
+
+/*Published statistics: histogram-stats-<channel>-<value>, see StatsPublish()*/
+static const char *const ppsz_stats_channels[] = { "y", "r", "g", "b" };
+static const char *const ppsz_stats_floats[]   = { "mean", "stddev", "p1", "p50", "p99" };
+static const char *const ppsz_stats_integers[] = { "under", "over" };
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -184,6 +717,40 @@ vlc_module_begin ()
     set_subcategory( SUBCAT_VIDEO_VFILTER )
     set_capability( "video filter2", 0 )
     add_shortcut( "histogram" )
+    add_integer_with_range( CFG_PREFIX "threads", 1, 0, HISTOGRAM_MAX_THREADS,
+                            THREADS_TEXT, THREADS_LONGTEXT, true )
+    add_integer_with_range( CFG_PREFIX "sample-x", 1, 1, 64,
+                            SAMPLE_X_TEXT, SAMPLE_X_LONGTEXT, false )
+    add_integer_with_range( CFG_PREFIX "sample-y", 1, 1, 64,
+                            SAMPLE_Y_TEXT, SAMPLE_Y_LONGTEXT, false )
+    add_integer_with_range( CFG_PREFIX "rate", 0, 0, 1000,
+                            RATE_TEXT, RATE_LONGTEXT, false )
+    add_bool( CFG_PREFIX "async", false,
+              ASYNC_TEXT, ASYNC_LONGTEXT, true )
+    add_string( CFG_PREFIX "simd", "auto",
+                SIMD_TEXT, SIMD_LONGTEXT, true )
+        change_string_list( ppsz_simd, ppsz_simd_text, NULL )
+    add_integer( CFG_PREFIX "roi-x", 0,
+                 ROI_X_TEXT, ROI_X_LONGTEXT, false )
+    add_integer( CFG_PREFIX "roi-y", 0,
+                 ROI_Y_TEXT, ROI_Y_LONGTEXT, false )
+    add_integer( CFG_PREFIX "roi-width", 0,
+                 ROI_WIDTH_TEXT, ROI_WIDTH_LONGTEXT, false )
+    add_integer( CFG_PREFIX "roi-height", 0,
+                 ROI_HEIGHT_TEXT, ROI_HEIGHT_LONGTEXT, false )
+    add_integer_with_range( CFG_PREFIX "grid-cols", 1, 1, 8,
+                            GRID_COLS_TEXT, GRID_COLS_LONGTEXT, false )
+    add_integer_with_range( CFG_PREFIX "grid-rows", 1, 1, 8,
+                            GRID_ROWS_TEXT, GRID_ROWS_LONGTEXT, false )
+    add_string( CFG_PREFIX "smooth", "off",
+                SMOOTH_TEXT, SMOOTH_LONGTEXT, false )
+        change_string_list( ppsz_smooth, ppsz_smooth_text, NULL )
+    add_integer_with_range( CFG_PREFIX "smooth-frames", 8, 2, 64,
+                            SMOOTH_FRAMES_TEXT, SMOOTH_FRAMES_LONGTEXT, false )
+    add_integer_with_range( CFG_PREFIX "peak-hold", 0, 0, 250,
+                            PEAK_HOLD_TEXT, PEAK_HOLD_LONGTEXT, false )
+    add_bool( CFG_PREFIX "stats", false,
+              STATS_TEXT, STATS_LONGTEXT, false )
     set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -197,12 +764,31 @@ struct filter_sys_t
 {
     bool            equalize,    /**< equalize histogram channels                   */
                     log,         /**< Weather to use a logarithmic scale            */
-                    draw;        /**< Whether to draw the histogramscale            */
+                    draw,        /**< Whether to draw the histogramscale            */
+                    norm_equalize, /**< equalize of the last normalization          */
+                    norm_log;    /**< log of the last normalization                 */
     histo_type_e    type;        /**< Toggle between Y or RGB histograme            */
     int             frame_id,    /**< The frame ID (count from '0')                 */
-                    n_skip;      /**< Skip (the histogram calculations) by n frames */
+                    n_skip,      /**< Skip (the histogram calculations) by n frames */
+                    x_step,      /**< Sample every x_step column                    */
+                    y_step,      /**< Sample every y_step row                       */
+                    rate,        /**< Max #of histogram updates per second, or 0    */
+                    grid_cols,   /**< Zones per row, 1x1: whole picture histogram   */
+                    grid_rows,   /**< Zones per column                              */
+                    smooth_frames, /**< Frames averaged by the smoothing            */
+                    peak_frames; /**< Updates held by the peak line, 0: off         */
+    histo_smooth_e  smooth;      /**< Temporal smoothing of the counts              */
+    mtime_t         last_update; /**< Date of the picture of the last update        */
+    histogram_roi_t roi;         /**< Region of interest, width 0: whole picture    */
+    vlc_atomic_t    stats;       /**< Publish the statistics, read without lock     */
     vlc_mutex_t     lock;        /**< To lock for read/write on picture             */
     histogram_t*    p_histo;     /**< The histogram                                 */
+    histogram_pool_t* p_pool;    /**< Fill workers, NULL to fill on this thread     */
+    unsigned        cpu;         /**< HISTOGRAM_CPU_* the kernels may use           */
+    histogram_async_t* p_async;  /**< Background analysis, NULL to analyse inline   */
+#ifdef HISTOGRAM_PROFILE
+    histogram_profile_t profile; /**< Stage latencies, reported on Close            */
+#endif
 };
 
 /*****************************************************************************
@@ -224,14 +810,98 @@ static int Open( vlc_object_t *p_this )
     p_filter->p_sys->equalize   = false;
     p_filter->p_sys->log        = false;
     p_filter->p_sys->draw       = true;
+    p_filter->p_sys->norm_equalize = false;
+    p_filter->p_sys->norm_log   = false;
     p_filter->p_sys->type       = HISTO_RGB;
     p_filter->p_sys->frame_id   = 0;
     p_filter->p_sys->n_skip     = 0;
     p_filter->p_sys->p_histo    = NULL;
+    p_filter->p_sys->p_pool     = NULL;
+    p_filter->p_sys->p_async    = NULL;
+
+    config_ChainParse( p_filter, CFG_PREFIX, ppsz_filter_options, p_filter->p_cfg );
+
+    /*kernels: detect the cpu once, capped by the simd option*/
+    char *psz_simd = var_CreateGetString( p_filter, CFG_PREFIX "simd" );
+    if (histogram_cpu_detect( psz_simd, &p_filter->p_sys->cpu ) != HIST_SUCCESS)
+        msg_Warn( p_filter, "Unknown simd value '%s', using auto", psz_simd );
+    msg_Dbg( p_filter, "Using %s kernels", histogram_cpu_name( p_filter->p_sys->cpu ) );
+    free( psz_simd );
+
+    /*fill threads*/
+    int i_threads = var_CreateGetInteger( p_filter, CFG_PREFIX "threads" );
+    if (i_threads == 0)
+        i_threads = vlc_GetCPUCount();
+    if (i_threads > HISTOGRAM_MAX_THREADS)
+        i_threads = HISTOGRAM_MAX_THREADS;
+    if (i_threads > 1) {
+        p_filter->p_sys->p_pool = histogram_pool_new( i_threads );
+        if (p_filter->p_sys->p_pool == NULL)
+            msg_Warn( p_filter, "Unable to start %d fill threads", i_threads );
+    }
+
+    /*spatial sampling*/
+    p_filter->p_sys->x_step = __MAX( 1, var_CreateGetInteger( p_filter, CFG_PREFIX "sample-x" ) );
+    p_filter->p_sys->y_step = __MAX( 1, var_CreateGetInteger( p_filter, CFG_PREFIX "sample-y" ) );
+
+    /*refresh rate*/
+    p_filter->p_sys->rate = __MAX( 0, var_CreateGetInteger( p_filter, CFG_PREFIX "rate" ) );
+    p_filter->p_sys->last_update = VLC_TS_INVALID;
+
+    /*zone grid*/
+    p_filter->p_sys->grid_cols = __MAX( 1, var_CreateGetInteger( p_filter, CFG_PREFIX "grid-cols" ) );
+    p_filter->p_sys->grid_rows = __MAX( 1, var_CreateGetInteger( p_filter, CFG_PREFIX "grid-rows" ) );
+
+    /*temporal smoothing*/
+    char *psz_smooth = var_CreateGetString( p_filter, CFG_PREFIX "smooth" );
+    if (histogram_smooth_mode( psz_smooth, &p_filter->p_sys->smooth ) != HIST_SUCCESS)
+        msg_Warn( p_filter, "Unknown smooth value '%s', using off", psz_smooth );
+    free( psz_smooth );
+    p_filter->p_sys->smooth_frames = __MAX( 2, var_CreateGetInteger( p_filter, CFG_PREFIX "smooth-frames" ) );
+    p_filter->p_sys->peak_frames = __MAX( 0, var_CreateGetInteger( p_filter, CFG_PREFIX "peak-hold" ) );
+
+    /*background analysis, the thread owns the fill workers*/
+    if (var_CreateGetBool( p_filter, CFG_PREFIX "async" )) {
+        p_filter->p_sys->p_async = histogram_async_new( p_filter->p_sys->p_pool );
+        if (p_filter->p_sys->p_async == NULL)
+            msg_Warn( p_filter, "Unable to start the analysis thread" );
+    }
+
+#ifdef HISTOGRAM_PROFILE
+    memset( &p_filter->p_sys->profile, 0, sizeof(histogram_profile_t) );
+    if (p_filter->p_sys->p_async)
+        p_filter->p_sys->p_async->profile = &p_filter->p_sys->profile;
+#endif
 
     /*create mutex*/
     vlc_mutex_init( &p_filter->p_sys->lock );
 
+    /*region of interest, adjustable while playing*/
+    int *roi[4] = { &p_filter->p_sys->roi.x, &p_filter->p_sys->roi.y,
+                    &p_filter->p_sys->roi.width, &p_filter->p_sys->roi.height };
+    for (int i=0; i<4; i++) {
+        *roi[i] = __MAX( 0, var_CreateGetIntegerCommand( p_filter, ppsz_roi_vars[i] ) );
+        var_AddCallback( p_filter, ppsz_roi_vars[i], RoiCallback, p_filter->p_sys );
+    }
+
+    /*statistics, only computed while somebody asks for them*/
+    char psz_var[64];
+    for (size_t c=0; c<sizeof(ppsz_stats_channels)/sizeof(ppsz_stats_channels[0]); c++) {
+        for (size_t i=0; i<sizeof(ppsz_stats_floats)/sizeof(ppsz_stats_floats[0]); i++) {
+            snprintf( psz_var, sizeof(psz_var), CFG_PREFIX "stats-%s-%s",
+                      ppsz_stats_channels[c], ppsz_stats_floats[i] );
+            var_Create( p_filter, psz_var, VLC_VAR_FLOAT );
+        }
+        for (size_t i=0; i<sizeof(ppsz_stats_integers)/sizeof(ppsz_stats_integers[0]); i++) {
+            snprintf( psz_var, sizeof(psz_var), CFG_PREFIX "stats-%s-%s",
+                      ppsz_stats_channels[c], ppsz_stats_integers[i] );
+            var_Create( p_filter, psz_var, VLC_VAR_INTEGER );
+        }
+    }
+    vlc_atomic_set( &p_filter->p_sys->stats,
+                    var_CreateGetBoolCommand( p_filter, CFG_PREFIX "stats" ) );
+    var_AddCallback( p_filter, CFG_PREFIX "stats", StatsCallback, p_filter->p_sys );
+
     /*add key-pressed callback*/
     var_AddCallback( p_filter->p_libvlc, "key-pressed", KeyEvent, p_this );
 
@@ -251,6 +921,26 @@ static void Close( vlc_object_t *p_this )
 {
     filter_t *p_filter = (filter_t*)p_this;
 
+    /*remove the region of interest callbacks*/
+    for (int i=0; i<4; i++)
+        var_DelCallback( p_filter, ppsz_roi_vars[i], RoiCallback, p_filter->p_sys );
+    var_DelCallback( p_filter, CFG_PREFIX "stats", StatsCallback, p_filter->p_sys );
+
+    /*remove the published statistics*/
+    char psz_var[64];
+    for (size_t c=0; c<sizeof(ppsz_stats_channels)/sizeof(ppsz_stats_channels[0]); c++) {
+        for (size_t i=0; i<sizeof(ppsz_stats_floats)/sizeof(ppsz_stats_floats[0]); i++) {
+            snprintf( psz_var, sizeof(psz_var), CFG_PREFIX "stats-%s-%s",
+                      ppsz_stats_channels[c], ppsz_stats_floats[i] );
+            var_Destroy( p_filter, psz_var );
+        }
+        for (size_t i=0; i<sizeof(ppsz_stats_integers)/sizeof(ppsz_stats_integers[0]); i++) {
+            snprintf( psz_var, sizeof(psz_var), CFG_PREFIX "stats-%s-%s",
+                      ppsz_stats_channels[c], ppsz_stats_integers[i] );
+            var_Destroy( p_filter, psz_var );
+        }
+    }
+
     /*destroy mutex*/
     vlc_mutex_destroy( &p_filter->p_sys->lock );
 
@@ -260,6 +950,14 @@ static void Close( vlc_object_t *p_this )
         var_DelCallback( p_filter->p_libvlc, "key-pressed", KeyEvent, p_this );
     }
 
+    /*stop the analysis thread, then the fill threads*/
+    histogram_async_delete( p_filter->p_sys->p_async );
+    histogram_pool_delete( p_filter->p_sys->p_pool );
+
+#ifdef HISTOGRAM_PROFILE
+    histogram_profile_report( p_this, &p_filter->p_sys->profile );
+#endif
+
     /*free private data*/
     histogram_free( &p_filter->p_sys->p_histo );
     free(p_filter->p_sys);
@@ -270,9 +968,10 @@ static void Close( vlc_object_t *p_this )
  *****************************************************************************/
 static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
 {
-    bool draw, log, equalize,
+    bool draw, log, equalize, stats,
          fill = true, paint = true, blend = true;
     histo_type_e type;
+    histogram_roi_t roi;
     int frame_id, n_skip;
     int status = HIST_SUCCESS;
 
@@ -287,74 +986,153 @@ static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
         type = p_sys->type;
         frame_id = p_sys->frame_id++;
         n_skip = p_sys->n_skip;
+        roi = p_sys->roi;
     vlc_mutex_unlock( &p_sys->lock );
+    stats = vlc_atomic_get( &p_sys->stats ) != 0;
+
+    /*Hidden histogram, pass the picture through untouched*/
+    if (!draw)
+        return p_pic;
 
-    if (frame_id%(n_skip+1) != 0) {
+    if (p_sys->rate > 0) {
+        /*Update only when 1/rate seconds of video have elapsed (or on a seek back)*/
+        mtime_t date = p_pic->date;
+        if (date > VLC_TS_INVALID && p_sys->last_update > VLC_TS_INVALID &&
+            date >= p_sys->last_update &&
+            date - p_sys->last_update < CLOCK_FREQ / p_sys->rate) {
+            fill = false;
+            paint = false;
+        } else
+            p_sys->last_update = date;
+    } else if (frame_id%(n_skip+1) != 0) {
         fill = false;
         paint = false;
     }
-    /*In any case, create a simple copy of input*/
-    picture_t *p_outpic = picture_CopyAndRelease(p_filter, p_pic);
 
+    /*Do we support the input codec?*/
     int codec = p_filter->fmt_in.i_codec;
-    if (draw) {
-        switch (type) {
-            case HISTO_RGB:
-                /*Do we support the input codec?*/
-                status = histogram_check_codec( HISTO_RGB, codec );
-                if (status != HIST_SUCCESS)
-                    break;
-
-                /*Create an RGB histogram*/
-                if (p_sys->p_histo == NULL || p_sys->p_histo->num_channels != 3) {
-                    /*Delete the old histogram  / Create a new RGB histogram*/
-                    histogram_free( &p_sys->p_histo );
-
-                    status =  histogram_init( &p_sys->p_histo, p_pic, HISTO_RGB );
-                    status += histogram_set_codec( p_sys->p_histo, codec );
-                }
-                if (fill) {
-                    histogram_zero( p_sys->p_histo );
-                    histogram_fill( p_sys->p_histo, p_outpic );
-                    histogram_update_max( p_sys->p_histo );
-                    histogram_normalize( p_sys->p_histo, log, equalize );
-                }
-                if (paint) histogram_paint( p_sys->p_histo );
-                if (blend) histogram_blend( p_sys->p_histo, p_outpic );
-                break;
-            case HISTO_Y:
-                /*Do we support the input codec?*/
-                status = histogram_check_codec( HISTO_Y, codec );
-                if (status != HIST_SUCCESS)
-                    break;
-
-                /*Create a Luminance histogram*/
-                if (p_sys->p_histo == NULL || p_sys->p_histo->num_channels != 1) {
-                    /*Delete the old histogram  / Create a new Y histogram*/
-                    histogram_free( &p_sys->p_histo );
-
-                    status =  histogram_init( &p_sys->p_histo, p_pic, HISTO_Y );
-                    status += histogram_set_codec( p_sys->p_histo, codec );
-                }
-                if (fill) {
-                    histogram_zero( p_sys->p_histo );
-                    histogram_fill( p_sys->p_histo, p_outpic );
-                    histogram_update_max( p_sys->p_histo );
-                    histogram_normalize( p_sys->p_histo, log, equalize );
-                }
-                if (paint) histogram_paint( p_sys->p_histo );
-                if (blend) histogram_blend( p_sys->p_histo, p_outpic );
-                break;
-            default:
-                status = HIST_INPUT_ERROR;
-                break;
-        }
+    status = histogram_check_codec( type, codec );
+
+    /*(Re)create the histogram when the type changed*/
+    if (status == HIST_SUCCESS &&
+        (p_sys->p_histo == NULL || p_sys->p_histo->type != type)) {
+        if (p_sys->p_async)
+            histogram_async_set_front( p_sys->p_async, NULL );
+        histogram_free( &p_sys->p_histo );
+
+        status = histogram_init( &p_sys->p_histo, p_pic, type );
+        if (status == HIST_SUCCESS)
+            status = histogram_set_codec( p_sys->p_histo, codec, p_sys->cpu );
+        if (status == HIST_SUCCESS &&
+            histogram_set_grid( p_sys->p_histo, p_sys->grid_cols, p_sys->grid_rows ) != HIST_SUCCESS)
+            msg_Warn( p_filter, "Unable to draw a %dx%d grid, drawing the whole picture",
+                      p_sys->grid_cols, p_sys->grid_rows );
+        if (status == HIST_SUCCESS &&
+            histogram_set_smooth( p_sys->p_histo, p_sys->smooth, p_sys->smooth_frames ) != HIST_SUCCESS)
+            msg_Warn( p_filter, "Unable to smooth the histogram" );
+        if (status == HIST_SUCCESS &&
+            histogram_set_peak_hold( p_sys->p_histo, p_sys->peak_frames ) != HIST_SUCCESS)
+            msg_Warn( p_filter, "No peak hold for this histogram type or grid" );
+        if (status == HIST_SUCCESS) {
+            p_sys->p_histo->x_step = p_sys->x_step;
+            p_sys->p_histo->y_step = p_sys->y_step;
+            /*Never blend an overlay that was not painted yet*/
+            fill = true;
+            paint = true;
+            if (p_sys->p_async) {
+                picture_ZeroPixels( p_sys->p_histo->p_overlay );
+                histogram_async_set_front( p_sys->p_async, p_sys->p_histo );
+            }
+        } else
+            histogram_free( &p_sys->p_histo );
     }
 
-    if (status != HIST_SUCCESS)
+    if (status != HIST_SUCCESS) {
         msg_Warn(p_filter,
                  "Unable to create histogram '%d' for codec '%4.4s'",
                  type, (char *)&codec);
+        return p_pic;
+    }
+
+    /*A log or equalize toggle is drawn at once, from the last counts*/
+    const bool renormalize = !fill &&
+        (log != p_sys->norm_log || equalize != p_sys->norm_equalize);
+
+    if (p_sys->p_async) {
+        /*Analyse in the background, if the thread is idle, and draw the last result*/
+        if (fill || renormalize) {
+            histogram_job_t job = {
+                .type = type, .codec = codec, .cpu = p_sys->cpu,
+                .width = p_pic->p[0].i_visible_pitch / p_pic->p[0].i_pixel_pitch,
+                .height = p_pic->p[0].i_visible_lines,
+                .x_step = p_sys->x_step, .y_step = p_sys->y_step, .y_sampled = 1,
+                .roi = roi, .grid_cols = p_sys->grid_cols, .grid_rows = p_sys->grid_rows,
+                .smooth = p_sys->smooth, .smooth_frames = p_sys->smooth_frames,
+                .peak_frames = p_sys->peak_frames,
+                .log = log, .equalize = equalize, .stats = stats, .fill = fill,
+            };
+            if (histogram_async_post( p_sys->p_async, p_sys->p_histo, p_pic, &job )) {
+                p_sys->norm_log      = log;
+                p_sys->norm_equalize = equalize;
+            }
+        }
+        histogram_stats_t st;
+        if (stats && histogram_async_stats( p_sys->p_async, &st ))
+            StatsPublish( p_filter, &st );
+        if (!blend)
+            return p_pic;
+
+        /*The thread has its own copy, blend in place unless somebody else holds the picture*/
+        PROFILE_START( t );
+        picture_t *p_outpic = picture_MakeWritable( p_filter, p_pic );
+        PROFILE_LAP( &p_sys->profile, STAGE_COPY, t );
+        if (p_outpic) {
+            histogram_async_blend( p_sys->p_async, p_outpic );
+            PROFILE_LAP( &p_sys->profile, STAGE_BLEND, t );
+        }
+
+        return p_outpic;
+    }
+
+    /*The histogram is filled from the input, before anything is blended*/
+    PROFILE_START( t );
+    if (fill) {
+        p_sys->p_histo->roi = roi;
+        histogram_zero( p_sys->p_histo );
+        histogram_fill( p_sys->p_histo, p_pic, p_sys->p_pool );
+        histogram_smooth( p_sys->p_histo );
+        histogram_peak_hold( p_sys->p_histo );
+        PROFILE_LAP( &p_sys->profile, STAGE_FILL, t );
+        histogram_stats_t st;
+        if (stats && histogram_stats( p_sys->p_histo, &st ) == HIST_SUCCESS)
+            StatsPublish( p_filter, &st );
+        histogram_update_max( p_sys->p_histo );
+        PROFILE_LAP( &p_sys->profile, STAGE_UPDATE_MAX, t );
+        histogram_normalize( p_sys->p_histo, log, equalize );
+        PROFILE_LAP( &p_sys->profile, STAGE_NORMALIZE, t );
+    } else if (renormalize) {
+        histogram_update_max( p_sys->p_histo );
+        histogram_normalize( p_sys->p_histo, log, equalize );
+        PROFILE_LAP( &p_sys->profile, STAGE_NORMALIZE, t );
+        paint = true;
+    }
+    p_sys->norm_log      = log;
+    p_sys->norm_equalize = equalize;
+    if (paint) {
+        histogram_paint( p_sys->p_histo );
+        PROFILE_LAP( &p_sys->profile, STAGE_PAINT, t );
+    }
+
+    if (!blend)
+        return p_pic;
+
+    /*Blend in place, unless somebody else holds the picture*/
+    picture_t *p_outpic = picture_MakeWritable( p_filter, p_pic );
+    PROFILE_LAP( &p_sys->profile, STAGE_COPY, t );
+    if (p_outpic) {
+        histogram_blend( p_sys->p_histo, p_outpic );
+        PROFILE_LAP( &p_sys->profile, STAGE_BLEND, t );
+    }
 
     return p_outpic;
 }
@@ -430,7 +1208,9 @@ static int KeyEvent( vlc_object_t *p_this, char const *psz_var,
             p_sys->log = false;
             break;
         case KEY_ENTER:
-            p_sys->type = (p_sys->type == HISTO_Y ? HISTO_RGB : HISTO_Y);
+            p_sys->type = (p_sys->type == HISTO_Y        ? HISTO_RGB :
+                           p_sys->type == HISTO_RGB      ? HISTO_WAVEFORM :
+                           p_sys->type == HISTO_WAVEFORM ? HISTO_VECTORSCOPE : HISTO_Y);
             break;
         case '/':
             p_sys->equalize = !p_sys->equalize;
@@ -450,6 +1230,75 @@ static int KeyEvent( vlc_object_t *p_this, char const *psz_var,
     return VLC_SUCCESS;
 }
 
+/*****************************************************************************
+ * RoiCallback: the region of interest variables changed
+ *****************************************************************************/
+static int RoiCallback( vlc_object_t *p_this, char const *psz_var,
+                        vlc_value_t oldval, vlc_value_t newval, void *p_data )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(oldval);
+
+    filter_sys_t *p_sys = (filter_sys_t *)p_data;
+    int value = __MAX( 0, newval.i_int );
+
+    vlc_mutex_lock( &p_sys->lock );
+    if (!strcmp( psz_var, CFG_PREFIX "roi-x" ))
+        p_sys->roi.x = value;
+    else if (!strcmp( psz_var, CFG_PREFIX "roi-y" ))
+        p_sys->roi.y = value;
+    else if (!strcmp( psz_var, CFG_PREFIX "roi-width" ))
+        p_sys->roi.width = value;
+    else if (!strcmp( psz_var, CFG_PREFIX "roi-height" ))
+        p_sys->roi.height = value;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+ * StatsCallback: the statistics were switched on or off
+ *****************************************************************************
+ * The flag is atomic so that Filter() can test it without the lock.
+ *****************************************************************************/
+static int StatsCallback( vlc_object_t *p_this, char const *psz_var,
+                          vlc_value_t oldval, vlc_value_t newval, void *p_data )
+{
+    VLC_UNUSED(p_this); VLC_UNUSED(psz_var); VLC_UNUSED(oldval);
+
+    filter_sys_t *p_sys = (filter_sys_t *)p_data;
+    vlc_atomic_set( &p_sys->stats, newval.b_bool );
+
+    return VLC_SUCCESS;
+}
+
+/**
+ * Publish the statistics as the histogram-stats-<channel>-<value> variables
+ * of the filter: y for the Y histogram, r, g and b for the RGB histogram.
+ */
+static void StatsPublish( filter_t *p_filter, const histogram_stats_t *stats )
+{
+    const int first = stats->type == HISTO_RGB ? 1 : 0,
+              count = stats->type == HISTO_RGB ? 3 : 1;
+    char psz_var[64];
+
+    for (int c=0; c<count; c++) {
+        const histogram_channel_stats_t *s = &stats->channel[c];
+        const float floats[] = { s->mean, s->stddev, s->p1, s->p50, s->p99 };
+        const uint64_t integers[] = { s->under, s->over };
+
+        for (size_t i=0; i<sizeof(floats)/sizeof(floats[0]); i++) {
+            snprintf( psz_var, sizeof(psz_var), CFG_PREFIX "stats-%s-%s",
+                      ppsz_stats_channels[first + c], ppsz_stats_floats[i] );
+            var_SetFloat( p_filter, psz_var, floats[i] );
+        }
+        for (size_t i=0; i<sizeof(integers)/sizeof(integers[0]); i++) {
+            snprintf( psz_var, sizeof(psz_var), CFG_PREFIX "stats-%s-%s",
+                      ppsz_stats_channels[first + c], ppsz_stats_integers[i] );
+            var_SetInteger( p_filter, psz_var, integers[i] );
+        }
+    }
+}
+
 /**
  * Return a new image, with different format.
  *
@@ -574,6 +1423,26 @@ static int histogram_height_yuv( int height )
     return free_height > HISTOGRAM_HEIGHT ? HISTOGRAM_HEIGHT : free_height;
 }
 
+/** Like histogram_height_yuv(), with WAVEFORM_HEIGHT value levels at most */
+static int histogram_height_waveform( int height )
+{
+    int free_height = (height - 2*BOTTOM_MARGIN);
+    if (free_height < HISTOGRAM_MIN_HEIGHT)
+        return HIST_ERROR;
+
+    return free_height > WAVEFORM_HEIGHT ? WAVEFORM_HEIGHT : free_height;
+}
+
+/** Like histogram_height_yuv(), with VECTORSCOPE_SIZE cells at most */
+static int histogram_height_scope( int height )
+{
+    int free_height = (height - 2*BOTTOM_MARGIN);
+    if (free_height < HISTOGRAM_MIN_HEIGHT)
+        return HIST_ERROR;
+
+    return free_height > VECTORSCOPE_SIZE ? VECTORSCOPE_SIZE : free_height;
+}
+
 int histogram_init( histogram_t **h_in, picture_t *p_in, histo_type_e type )
 {
     if (h_in == NULL || p_in == NULL || *h_in != NULL)
@@ -589,16 +1458,32 @@ int histogram_init( histogram_t **h_in, picture_t *p_in, histo_type_e type )
             num_channels = 3;
             height = histogram_height_rgb( p_in->p[0].i_visible_lines);
             break;
+        case HISTO_WAVEFORM:
+            num_channels = 1;
+            height = histogram_height_waveform( p_in->p[0].i_visible_lines);
+            break;
+        case HISTO_VECTORSCOPE:
+            num_channels = 1;
+            height = histogram_height_scope( p_in->p[0].i_visible_lines);
+            break;
         default: /*TODO*/
             return HIST_INPUT_ERROR;
     }
-    num_bins = histogram_bins( p_in->p[0].i_visible_pitch );
+    num_bins = histogram_bins( p_in->p[0].i_visible_pitch / p_in->p[0].i_pixel_pitch );
+
+    /*The vectorscope is square, and even for the overlay*/
+    if (type == HISTO_VECTORSCOPE)
+        num_bins = height = __MIN( num_bins, height ) & ~1;
 
     histogram_t *h_out = (histogram_t*)malloc( sizeof(histogram_t) );
 
     for (int i=0; i<MAX_NUM_CHANNELS; i++) {
         h_out->bins[i] = NULL;
-        h_out->max[i] = 0.0F;
+        h_out->heights[i] = NULL;
+        h_out->tiles[i] = NULL;
+        h_out->tile_heights[i] = NULL;
+        h_out->painted[i] = NULL;
+        h_out->max[i] = 0;
     }
     h_out->x0 = LEFT_MARGIN;
     h_out->y0 = BOTTOM_MARGIN;
@@ -607,13 +1492,34 @@ int histogram_init( histogram_t **h_in, picture_t *p_in, histo_type_e type )
     for (int i=0; i<num_channels; i++) {
         h_out->bins[i] = (uint32_t*)calloc( num_bins, sizeof(uint32_t) );
         memset( h_out->bins[i],   0, num_bins*sizeof(uint32_t) );
+        h_out->heights[i] = (uint32_t*)calloc( num_bins, sizeof(uint32_t) );
+        h_out->painted[i] = (uint32_t*)calloc( num_bins, sizeof(uint32_t) );
     }
+    h_out->dirty        = (uint8_t*)calloc( num_bins+1, sizeof(uint8_t) );
+    h_out->repaint      = true;
+    h_out->type         = type;
     h_out->num_channels = num_channels;
     h_out->num_bins     = num_bins;
+    h_out->num_raw_bins = num_bins;
+    h_out->sample_shift = 0;
+    h_out->x_step       = 1;
+    h_out->y_step       = 1;
+    h_out->y_sampled    = 1;
     h_out->p_overlay    = NULL;
+    h_out->spans        = NULL;
+    memset( &h_out->roi, 0, sizeof(histogram_roi_t) );
+    h_out->grid_cols    = 1;
+    h_out->grid_rows    = 1;
+    h_out->cell_bins    = 0;
+    h_out->cell_height  = 0;
     h_out->fill_func    = NULL;
     h_out->paint_func   = NULL;
     h_out->blend_func   = NULL;
+    h_out->blend_rows   = NULL;
+    h_out->scale_rows   = histogram_scale_rows( 0 );
+    h_out->yuv2rgb      = NULL;
+    h_out->smooth       = NULL;
+    h_out->peak         = NULL;
 
     *h_in = h_out;
 
@@ -625,9 +1531,15 @@ int histogram_check_codec( histo_type_e type, vlc_fourcc_t i_codec )
 {
     int status = HIST_ERROR;
 
+    /*16-bit YUV, for both histograms*/
+    if (histogram_hbd_shift( i_codec ) >= 0)
+        return type == HISTO_Y || type == HISTO_RGB || type == HISTO_WAVEFORM ||
+               type == HISTO_VECTORSCOPE ? HIST_SUCCESS : HIST_CODEC_UNSUPPORTED;
+
     switch (type) {
         case HISTO_Y:
-        /*Check for Luminance histogram*/
+        case HISTO_WAVEFORM:
+        /*Check for Luminance histogram, or waveform*/
         switch (i_codec) {
             /*  Since we only need use the Y-plane, we can work with any:
             *   a) Planar YUV, b) with 8-bits on Y-plane c) and NxN sampling on Y-plane
@@ -660,6 +1572,8 @@ int histogram_check_codec( histo_type_e type, vlc_fourcc_t i_codec )
             case VLC_CODEC_I420:
             case VLC_CODEC_J420:
             case VLC_CODEC_YV12:
+            case VLC_CODEC_NV12:
+            case VLC_CODEC_NV21:
             case VLC_CODEC_RGB24:
             case VLC_CODEC_RGB32:
             case VLC_CODEC_YUYV:
@@ -673,6 +1587,27 @@ int histogram_check_codec( histo_type_e type, vlc_fourcc_t i_codec )
         }
         break;
 
+        case HISTO_VECTORSCOPE:
+        /*Check for vectorscope: YUV with chroma, read as is*/
+        switch (i_codec) {
+            case VLC_CODEC_I422:
+            case VLC_CODEC_J422:
+            case VLC_CODEC_I420:
+            case VLC_CODEC_J420:
+            case VLC_CODEC_YV12:
+            case VLC_CODEC_NV12:
+            case VLC_CODEC_NV21:
+            case VLC_CODEC_YUYV:
+                status = HIST_SUCCESS;
+                break;
+            case VLC_CODEC_GREY:
+                status = HIST_COLOR_UNSUPPORTED;
+                break;
+            default:
+                status = HIST_CODEC_UNSUPPORTED;
+        }
+        break;
+
         default:
             status = HIST_CODEC_UNSUPPORTED;
     }
@@ -680,11 +1615,48 @@ int histogram_check_codec( histo_type_e type, vlc_fourcc_t i_codec )
     return status;
 }
 
-/**Depending on the (I/O) codec, set the fill/paint/blend functions.*/
-int histogram_set_codec( histogram_t *h, vlc_fourcc_t i_codec )
+/**
+ * Depending on the (I/O) codec, set the fill/paint/blend functions.
+ *
+ * The fill, scale and blend kernels are the best ones for cpu (HISTOGRAM_CPU_*).
+ */
+int histogram_set_codec( histogram_t *h, vlc_fourcc_t i_codec, unsigned cpu )
 {
     int status = HIST_SUCCESS;
 
+    h->blend_rows = histogram_blend_rows( cpu );
+    h->scale_rows = histogram_scale_rows( cpu );
+
+    if (h->type == HISTO_WAVEFORM)
+        return histogram_wave_set_codec( h, i_codec );
+    if (h->type == HISTO_VECTORSCOPE)
+        return histogram_scope_set_codec( h, i_codec );
+
+    /*Count every value of the samples, histogram_normalize() folds the counts to
+      the overlay width: the statistics do not depend on the picture width*/
+    const bool hbd_luma = histogram_hbd_shift( i_codec ) >= 0 && h->num_channels == 1;
+    status = histogram_init_raw_bins( h, hbd_luma ? HISTOGRAM_RAW_BINS : HISTOGRAM_8BIT_BINS );
+    if (status != HIST_SUCCESS)
+        return status;
+
+    /*High bit depth YUV: luma is counted with 10 bits, there are no SIMD kernels*/
+    if (histogram_hbd_shift( i_codec ) >= 0) {
+        h->sample_shift = histogram_hbd_shift( i_codec );
+        if (h->num_channels == 1) {
+            h->fill_func  = histogram_yuv_fillFromYUV16;
+            h->paint_func = histogram_yuv_paintToYUVA;
+            h->blend_func = picture_YUVA_BlendToY16;
+        } else {
+            h->fill_func  = histogram_rgb_fillFromYUV16;
+            h->paint_func = histogram_rgb_paintToYUVA;
+            h->blend_func = picture_YUVA_BlendToYUV16;
+            status = histogram_init_yuv2rgb( h );
+        }
+        if (status == HIST_SUCCESS)
+            status = histogram_init_picture_yuva( h );
+        return status;
+    }
+
     /*NOTE: If you add/remove codecs, remember to update histogram_check_codec()*/
     if (h->num_channels == 1) {
         /*Create a Luminance histogram*/
@@ -702,28 +1674,36 @@ int histogram_set_codec( histogram_t *h, vlc_fourcc_t i_codec )
             case VLC_CODEC_NV12:
             case VLC_CODEC_NV21:
             case VLC_CODEC_GREY:  /*Y800,Y8*/
-                h->fill_func  = &histogram_yuv_fillFromYUVPlanar;
+                h->fill_func  = histogram_luma_kernel( cpu, histogram_yuv_fillFromYUVPlanar,
+                                                       HISTOGRAM_SSE2_KERNEL( histogram_yuv_fillFromYUVPlanar ),
+                                                       HISTOGRAM_AVX2_KERNEL( histogram_yuv_fillFromYUVPlanar ) );
                 h->paint_func = &histogram_yuv_paintToYUVA;
                 h->blend_func = &picture_YUVA_BlendToY800;
-                histogram_init_picture_yuva( h );
+                status = histogram_init_picture_yuva( h );
                 break;
             case VLC_CODEC_YUYV:
-                h->fill_func  = histogram_yuv_fillFromYUYV;
+                h->fill_func  = histogram_luma_kernel( cpu, histogram_yuv_fillFromYUYV,
+                                                       HISTOGRAM_SSE2_KERNEL( histogram_yuv_fillFromYUYV ),
+                                                       HISTOGRAM_AVX2_KERNEL( histogram_yuv_fillFromYUYV ) );
                 h->paint_func = histogram_yuv_paintToYUVA;
                 h->blend_func = picture_YUVA_BlendToYUYV;
-                histogram_init_picture_yuva( h );
+                status = histogram_init_picture_yuva( h );
                 break;
             case VLC_CODEC_RGB24:
-                h->fill_func  = histogram_yuv_fillFromRGB24;
+                h->fill_func  = histogram_luma_kernel( cpu, histogram_yuv_fillFromRGB24,
+                                                       HISTOGRAM_SSE2_KERNEL( histogram_yuv_fillFromRGB24 ),
+                                                       NULL );
                 h->paint_func = histogram_yuv_paintToRGBA;
                 h->blend_func = picture_RGBA_BlendToRGB24;
-                histogram_init_picture_rgba( h );
+                status = histogram_init_picture_rgba( h );
                 break;
             case VLC_CODEC_RGB32:
-                h->fill_func  = histogram_yuv_fillFromRGB32;
+                h->fill_func  = histogram_luma_kernel( cpu, histogram_yuv_fillFromRGB32,
+                                                       HISTOGRAM_SSE2_KERNEL( histogram_yuv_fillFromRGB32 ),
+                                                       NULL );
                 h->paint_func = histogram_yuv_paintToRGBA;
                 h->blend_func = picture_RGBA_BlendToRGB32;
-                histogram_init_picture_rgba( h );
+                status = histogram_init_picture_rgba( h );
                 break;
             default:              /*TODO*/
                 status = HIST_CODEC_UNSUPPORTED;
@@ -736,38 +1716,62 @@ int histogram_set_codec( histogram_t *h, vlc_fourcc_t i_codec )
                 h->fill_func  = histogram_rgb_fillFromI422;
                 h->paint_func = histogram_rgb_paintToYUVA;
                 h->blend_func = picture_YUVA_BlendToI422;
-                histogram_init_picture_yuva( h );
+                status = histogram_init_picture_yuva( h );
+                if (status == HIST_SUCCESS)
+                    status = histogram_init_yuv2rgb( h );
                 break;
             case VLC_CODEC_I420:
             case VLC_CODEC_J420:
                 h->fill_func  = histogram_rgb_fillFromI420;
                 h->paint_func = histogram_rgb_paintToYUVA;
                 h->blend_func = picture_YUVA_BlendToI420;
-                histogram_init_picture_yuva( h );
+                status = histogram_init_picture_yuva( h );
+                if (status == HIST_SUCCESS)
+                    status = histogram_init_yuv2rgb( h );
                 break;
             case VLC_CODEC_YV12:
                 h->fill_func  = histogram_rgb_fillFromYV12;
                 h->paint_func = histogram_rgb_paintToYUVA;
                 h->blend_func = picture_YUVA_BlendToYV12;
-                histogram_init_picture_yuva( h );
+                status = histogram_init_picture_yuva( h );
+                if (status == HIST_SUCCESS)
+                    status = histogram_init_yuv2rgb( h );
+                break;
+            case VLC_CODEC_NV12:
+                h->fill_func  = histogram_rgb_fillFromNV12;
+                h->paint_func = histogram_rgb_paintToYUVA;
+                h->blend_func = picture_YUVA_BlendToNV12;
+                status = histogram_init_picture_yuva( h );
+                if (status == HIST_SUCCESS)
+                    status = histogram_init_yuv2rgb( h );
+                break;
+            case VLC_CODEC_NV21:
+                h->fill_func  = histogram_rgb_fillFromNV21;
+                h->paint_func = histogram_rgb_paintToYUVA;
+                h->blend_func = picture_YUVA_BlendToNV21;
+                status = histogram_init_picture_yuva( h );
+                if (status == HIST_SUCCESS)
+                    status = histogram_init_yuv2rgb( h );
                 break;
             case VLC_CODEC_YUYV:
                 h->fill_func  = histogram_rgb_fillFromYUYV;
                 h->paint_func = histogram_rgb_paintToYUVA;
                 h->blend_func = picture_YUVA_BlendToYUYV;
-                histogram_init_picture_yuva( h );
+                status = histogram_init_picture_yuva( h );
+                if (status == HIST_SUCCESS)
+                    status = histogram_init_yuv2rgb( h );
                 break;
             case VLC_CODEC_RGB24:
                 h->fill_func  = histogram_rgb_fillFromRGB24;
                 h->paint_func = histogram_rgb_paintToRGBA;
                 h->blend_func = picture_RGBA_BlendToRGB24;
-                histogram_init_picture_rgba( h );
+                status = histogram_init_picture_rgba( h );
                 break;
             case VLC_CODEC_RGB32:
                 h->fill_func  = histogram_rgb_fillFromRGB32;
                 h->paint_func = histogram_rgb_paintToRGBA;
                 h->blend_func = picture_RGBA_BlendToRGB32;
-                histogram_init_picture_rgba( h );
+                status = histogram_init_picture_rgba( h );
                 break;
             case VLC_CODEC_GREY:
                 status = HIST_COLOR_UNSUPPORTED;
@@ -780,6 +1784,65 @@ int histogram_set_codec( histogram_t *h, vlc_fourcc_t i_codec )
     return status;
 }
 
+/**
+ * Return the right shift from a sample of a 16-bit YUV codec to its 10-bit
+ * value, or -1 if the codec does not have 16-bit samples.
+ *
+ * The codecs are missing from older vlc headers, hence the #ifdefs.
+ */
+int histogram_hbd_shift( vlc_fourcc_t i_codec )
+{
+    switch (i_codec) {
+#ifdef VLC_CODEC_I420_10L
+        case VLC_CODEC_I420_10L:
+#endif
+#ifdef VLC_CODEC_I422_10L
+        case VLC_CODEC_I422_10L:
+#endif
+            return 0;
+#ifdef VLC_CODEC_I420_12L
+        case VLC_CODEC_I420_12L:
+#endif
+#ifdef VLC_CODEC_I422_12L
+        case VLC_CODEC_I422_12L:
+#endif
+            return 2;
+#ifdef VLC_CODEC_P010
+        case VLC_CODEC_P010: /*10 bits, MSB aligned*/
+            return 6;
+#endif
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Fill num_raw_bins bins per channel instead of num_bins.
+ *
+ * histogram_update_max() and histogram_normalize() reduce them to the
+ * overlay width, num_raw_bins should be num_bins times a power of 2.
+ */
+int histogram_init_raw_bins( histogram_t *h, int num_raw_bins )
+{
+    for (int i=0; i<h->num_channels; i++) {
+        uint32_t *bins = (uint32_t*)realloc( h->bins[i], num_raw_bins*sizeof(uint32_t) );
+        if (bins == NULL)
+            return HIST_ERROR;
+        memset( bins, 0, num_raw_bins*sizeof(uint32_t) );
+        h->bins[i] = bins;
+
+        /*The waveform and vectorscope have an intensity per raw bin*/
+        uint32_t *heights = (uint32_t*)realloc( h->heights[i], num_raw_bins*sizeof(uint32_t) );
+        if (heights == NULL)
+            return HIST_ERROR;
+        memset( heights, 0, num_raw_bins*sizeof(uint32_t) );
+        h->heights[i] = heights;
+    }
+    h->num_raw_bins = num_raw_bins;
+
+    return HIST_SUCCESS;
+}
+
 /**Create the YUVA histogram overlay picture.*/
 int histogram_init_picture_yuva( histogram_t *h )
 {
@@ -808,7 +1871,10 @@ int histogram_init_picture_yuva( histogram_t *h )
     dump_format(&fmt_yuva);
 #endif
     h->p_overlay = picture_NewFromFormat( &fmt_yuva );
+    h->spans = (histogram_span_t*)calloc( fmt_yuva.i_height, sizeof(histogram_span_t) );
     video_format_Clean( &fmt_yuva );
+    if (!h->p_overlay || !h->spans)
+        status = HIST_ERROR;
 
     return status;
 }
@@ -841,30 +1907,79 @@ int histogram_init_picture_rgba( histogram_t *h )
     dump_format(&fmt_rgba);
 #endif
     h->p_overlay = picture_NewFromFormat( &fmt_rgba );
+    h->spans = (histogram_span_t*)calloc( fmt_rgba.i_height, sizeof(histogram_span_t) );
     video_format_Clean( &fmt_rgba );
+    if (!h->p_overlay || !h->spans)
+        status = HIST_ERROR;
 
     return status;
 }
 
 /**
- * Fill an RGB histogram, directly from a YUV4:2:2 picture.
- * Supports I422/J422 & YV16 codecs.
+ * Build the YUV->RGB bin lookup tables, one bin per 8-bit value.
  *
- * Normally, since each line on the UV plane is 2x subsampled, it should be
- * upsampled first (up-convertion to YUV4:4:4).
- * Since we favour speed for accuracy, the Y-plane is downsampled instead.
- * The loss of information should be negligible.
+ * The tables reproduce yuv_to_rgb() from filter_picture.h exactly, so the
+ * binning does not change; only the multiplies, clamps and shifts move out
+ * of the per-sample loop.
  */
-int histogram_rgb_fillFromYUV422( histogram_t *h_rgb, const picture_t *p_yuv, bool switch_uv )
+int histogram_init_yuv2rgb( histogram_t *h )
 {
-    if (!h_rgb || !p_yuv)
-        return HIST_INPUT_ERROR;
+#   define ONE_HALF  (1 << (YUV2RGB_SCALEBITS - 1))
+#   define FIX(x)    ((int) ((x) * (1<<YUV2RGB_SCALEBITS) + 0.5))
+    if (h->yuv2rgb == NULL)
+        h->yuv2rgb = (histogram_yuv2rgb_t*)malloc( sizeof(histogram_yuv2rgb_t) );
+    if (h->yuv2rgb == NULL)
+        return HIST_ERROR;
 
-    int u_plane, v_plane;
-    u_plane = switch_uv ? V_PLANE : U_PLANE;
-    v_plane = switch_uv ? U_PLANE : V_PLANE;
-    int r,g,b;
-    int y_pitch = p_yuv->p[Y_PLANE].i_pitch,
+    histogram_yuv2rgb_t *lut = h->yuv2rgb;
+
+    for (int i=0; i<256; i++) {
+        int c = i - 128;
+        lut->y[i]    = (i - 16) * FIX(255.0/219.0) + (YUV2RGB_OFFSET << YUV2RGB_SCALEBITS);
+        lut->r_cr[i] = FIX(1.40200*255.0/224.0) * c + ONE_HALF;
+        lut->g_cb[i] = - FIX(0.34414*255.0/224.0) * c;
+        lut->g_cr[i] = - FIX(0.71414*255.0/224.0) * c + ONE_HALF;
+        lut->b_cb[i] = FIX(1.77200*255.0/224.0) * c + ONE_HALF;
+    }
+    for (int i=0; i<YUV2RGB_RANGE; i++)
+        lut->bin[i] = vlc_uint8( i - YUV2RGB_OFFSET );
+#undef FIX
+#undef ONE_HALF
+
+    return HIST_SUCCESS;
+}
+
+/** Bin one YUV sample into the R/G/B histograms through the lookup tables */
+static inline void histogram_rgb_binYUV( histogram_t *h_rgb, const histogram_yuv2rgb_t *lut,
+                                         uint8_t y, uint8_t u, uint8_t v )
+{
+    const int32_t yc = lut->y[y];
+    h_rgb->bins[R][lut->bin[(yc + lut->r_cr[v]) >> YUV2RGB_SCALEBITS]]++;
+    h_rgb->bins[G][lut->bin[(yc + lut->g_cb[u] + lut->g_cr[v]) >> YUV2RGB_SCALEBITS]]++;
+    h_rgb->bins[B][lut->bin[(yc + lut->b_cb[u]) >> YUV2RGB_SCALEBITS]]++;
+}
+
+/**
+ * Fill an RGB histogram, directly from a YUV4:2:2 picture.
+ * Supports I422/J422 & YV16 codecs.
+ *
+ * Normally, since each line on the UV plane is 2x subsampled, it should be
+ * upsampled first (up-convertion to YUV4:4:4).
+ * Since we favour speed for accuracy, the Y-plane is downsampled instead.
+ * The loss of information should be negligible.
+ */
+int histogram_rgb_fillFromYUV422( histogram_t *h_rgb, const picture_t *p_yuv, bool switch_uv )
+{
+    if (!h_rgb || !p_yuv)
+        return HIST_INPUT_ERROR;
+
+    int u_plane, v_plane;
+    u_plane = switch_uv ? V_PLANE : U_PLANE;
+    v_plane = switch_uv ? U_PLANE : V_PLANE;
+    int w_sample = h_rgb->x_step,
+        h_sample = h_rgb->y_step;
+    const histogram_yuv2rgb_t *lut = h_rgb->yuv2rgb;
+    int y_pitch = p_yuv->p[Y_PLANE].i_pitch,
         u_pitch = p_yuv->p[u_plane].i_pitch,
         v_pitch = p_yuv->p[v_plane].i_pitch,
         y_visible_pitch = p_yuv->p[Y_PLANE].i_visible_pitch;
@@ -873,21 +1988,17 @@ int histogram_rgb_fillFromYUV422( histogram_t *h_rgb, const picture_t *p_yuv, bo
             *u_start = p_yuv->p[u_plane].p_pixels,
             *v_start = p_yuv->p[v_plane].p_pixels,
             *y = y_start, *u = u_start, *v = v_start;
-    int shift = 8 - (int)round( log2(h_rgb->num_bins) ); /**< Right shift for pixel values when num_bins < 256 */
 
     while (y < y_end) {
         uint8_t *y_end_line = y+y_visible_pitch,
-                *y_next_line = y+y_pitch,
-                *u_next_line = u+u_pitch,
-                *v_next_line = v+v_pitch;
+                *y_next_line = y+h_sample*y_pitch,
+                *u_next_line = u+h_sample*u_pitch,
+                *v_next_line = v+h_sample*v_pitch;
         while (y < y_end_line) {
-            yuv_to_rgb( &r, &g, &b, *y, *u, *v );
-            h_rgb->bins[R][r>>shift]++;
-            h_rgb->bins[G][g>>shift]++;
-            h_rgb->bins[B][b>>shift]++;
-            y+=2;
-            u++;
-            v++;
+            histogram_rgb_binYUV( h_rgb, lut, *y, *u, *v );
+            y+=2*w_sample;
+            u+=w_sample;
+            v+=w_sample;
         }
         y = y_next_line;
         u = u_next_line;
@@ -902,22 +2013,18 @@ int histogram_rgb_fillFromYUYV( histogram_t *h_rgb, const picture_t *p_yuv )
     if (!h_rgb || !p_yuv)
         return HIST_INPUT_ERROR;
 
-    int r,g,b;
-    int shift = 8 - (int)round( log2(h_rgb->num_bins) );
+    const histogram_yuv2rgb_t *lut = h_rgb->yuv2rgb;
     int pitch         = p_yuv->p[Y_PLANE].i_pitch,
         visible_pitch = p_yuv->p[Y_PLANE].i_visible_pitch;
     uint8_t *p_pixel = p_yuv->p[Y_PLANE].p_pixels,
             *p_end   = p_pixel + pitch * p_yuv->p[Y_PLANE].i_visible_lines;
 
-    while (p_pixel != p_end) {
+    while (p_pixel < p_end) {
         uint8_t *p_end_line  = p_pixel+visible_pitch,
-                *p_next_line = p_pixel+pitch;
-        while (p_pixel != p_end_line) {
-            yuv_to_rgb( &r, &g, &b, *p_pixel, *(p_pixel+1), *(p_pixel+3) );
-            h_rgb->bins[R][r>>shift]++;
-            h_rgb->bins[G][g>>shift]++;
-            h_rgb->bins[B][b>>shift]++;
-            p_pixel+=4; /*Move to next macro-pixel*/
+                *p_next_line = p_pixel+h_rgb->y_step*pitch;
+        while (p_pixel < p_end_line) {
+            histogram_rgb_binYUV( h_rgb, lut, *p_pixel, *(p_pixel+1), *(p_pixel+3) );
+            p_pixel+=4*h_rgb->x_step; /*Move to next sampled macro-pixel*/
         }
         p_pixel = p_next_line;
     }
@@ -937,8 +2044,8 @@ int histogram_rgb_fillFromYUYV( histogram_t *h_rgb, const picture_t *p_yuv )
  * Since we favour speed for accuracy, the Y-plane is downsampled instead.
  * The loss of information should be negligible.
  *
- * This function supports sampling on every ith row and jth column (w_sample, h_sample),
- * but the functionality is not actually used. */
+ * Sampling is done on every h_rgb->y_step chroma row and h_rgb->x_step
+ * chroma column, so the luma samples stay co-sited with the chroma. */
 int histogram_rgb_fillFromYUV420( histogram_t *h_rgb, const picture_t *p_yuv, bool switch_uv )
 {
     if (!h_rgb || !p_yuv)
@@ -947,9 +2054,9 @@ int histogram_rgb_fillFromYUV420( histogram_t *h_rgb, const picture_t *p_yuv, bo
     int u_plane, v_plane;
     u_plane = switch_uv ? V_PLANE : U_PLANE;
     v_plane = switch_uv ? U_PLANE : V_PLANE;
-    int w_sample = 1,
-        h_sample = 1,
-        r,g,b;
+    int w_sample = h_rgb->x_step,
+        h_sample = h_rgb->y_step;
+    const histogram_yuv2rgb_t *lut = h_rgb->yuv2rgb;
     int y_pitch = p_yuv->p[Y_PLANE].i_pitch,
         u_pitch = p_yuv->p[u_plane].i_pitch,
         v_pitch = p_yuv->p[v_plane].i_pitch,
@@ -959,7 +2066,6 @@ int histogram_rgb_fillFromYUV420( histogram_t *h_rgb, const picture_t *p_yuv, bo
             *u_start = p_yuv->p[u_plane].p_pixels,
             *v_start = p_yuv->p[v_plane].p_pixels,
             *y = y_start, *u = u_start, *v = v_start;
-    int shift = 8 - (int)round( log2(h_rgb->num_bins) ); /**< Right shift for pixel values when num_bins < 256 */
 
     while (y < y_end) {
         uint8_t *y_end_line = y+y_visible_pitch,
@@ -967,10 +2073,7 @@ int histogram_rgb_fillFromYUV420( histogram_t *h_rgb, const picture_t *p_yuv, bo
                 *u_next_line = u+h_sample*u_pitch,
                 *v_next_line = v+h_sample*v_pitch;
         while (y < y_end_line) {
-            yuv_to_rgb( &r, &g, &b, *y, *u, *v );
-            h_rgb->bins[R][r>>shift]++;
-            h_rgb->bins[G][g>>shift]++;
-            h_rgb->bins[B][b>>shift]++;
+            histogram_rgb_binYUV( h_rgb, lut, *y, *u, *v );
             y+=2*w_sample;
             u+=w_sample;
             v+=w_sample;
@@ -983,6 +2086,58 @@ int histogram_rgb_fillFromYUV420( histogram_t *h_rgb, const picture_t *p_yuv, bo
     return HIST_SUCCESS;
 }
 
+/**
+ * Fill an RGB histogram, directly from a semi-planar YUV4:2:0 picture.
+ * Supports NV12 & NV21 codecs.
+ *
+ * The Y-plane is followed by a single chroma plane of interleaved U,V
+ * (NV12) or V,U (NV21) pairs, read in place. Sampled as in
+ * histogram_rgb_fillFromYUV420(): on every h_rgb->y_step chroma row and
+ * h_rgb->x_step chroma column.
+ */
+int histogram_rgb_fillFromSemiPlanar420( histogram_t *h_rgb, const picture_t *p_yuv, bool switch_uv )
+{
+    if (!h_rgb || !p_yuv)
+        return HIST_INPUT_ERROR;
+
+    const int u_offset = switch_uv ? 1 : 0,
+              v_offset = switch_uv ? 0 : 1;
+    int w_sample = h_rgb->x_step,
+        h_sample = h_rgb->y_step;
+    const histogram_yuv2rgb_t *lut = h_rgb->yuv2rgb;
+    int y_pitch  = p_yuv->p[Y_PLANE].i_pitch,
+        uv_pitch = p_yuv->p[1].i_pitch,
+        y_visible_pitch = p_yuv->p[Y_PLANE].i_visible_pitch;
+    uint8_t *y_start = p_yuv->p[Y_PLANE].p_pixels,
+            *y_end = y_start + y_pitch * p_yuv->p[Y_PLANE].i_visible_lines,
+            *y = y_start, *uv = p_yuv->p[1].p_pixels;
+
+    while (y < y_end) {
+        uint8_t *y_end_line = y+y_visible_pitch,
+                *y_next_line = y+2*h_sample*y_pitch,
+                *uv_next_line = uv+h_sample*uv_pitch;
+        while (y < y_end_line) {
+            histogram_rgb_binYUV( h_rgb, lut, *y, uv[u_offset], uv[v_offset] );
+            y+=2*w_sample;
+            uv+=2*w_sample;
+        }
+        y = y_next_line;
+        uv = uv_next_line;
+    }
+
+    return HIST_SUCCESS;
+}
+
+int histogram_rgb_fillFromNV12( histogram_t *h_rgb, const picture_t *p_yuv )
+{
+    return histogram_rgb_fillFromSemiPlanar420( h_rgb, p_yuv, false );
+}
+
+int histogram_rgb_fillFromNV21( histogram_t *h_rgb, const picture_t *p_yuv )
+{
+    return histogram_rgb_fillFromSemiPlanar420( h_rgb, p_yuv, true );
+}
+
 int histogram_rgb_fillFromI422( histogram_t *h_rgb, const picture_t *p_yuv )
 {
     return histogram_rgb_fillFromYUV422( h_rgb, p_yuv, false );
@@ -1003,36 +2158,120 @@ int histogram_rgb_fillFromYV12( histogram_t *h_rgb, const picture_t *p_yuv )
     return histogram_rgb_fillFromYUV420( h_rgb, p_yuv, true );
 }
 
-int histogram_rgb_fillFromRGB24( histogram_t *h, const picture_t *p_bgr )
+/*
+ * The RGB24/RGB32 kernels load whole words and count into RGB_SUB_HISTOGRAMS
+ * interleaved histograms: sub[s][value] holds the R, G and B counters of
+ * value in 16 bytes, 4 values per cache line, instead of 3 separate arrays.
+ * Consecutive pixels go to different sub-histograms, which breaks the
+ * increment chains of flat areas. The 16KB total stays in L1.
+ */
+typedef uint32_t histogram_rgb_sub_t[256][4];
+
+#ifdef HISTOGRAM_LITTLE_ENDIAN
+#   define WORD_BYTE( w, i ) (((w) >> (8*(i))) & 0xFF)
+#else /*BIG_ENDIAN*/
+#   define WORD_BYTE( w, i ) (((w) >> (24-8*(i))) & 0xFF)
+#endif /*HISTOGRAM_LITTLE_ENDIAN*/
+
+/** Load 4 bytes, WORD_BYTE( w, i ) is p[i] */
+static inline uint32_t load_word( const uint8_t *p )
 {
-    return histogram_rgb_fillFromRGB24_32( h, p_bgr, true );
+    uint32_t w;
+    memcpy( &w, p, sizeof(w) );
+    return w;
 }
 
-int histogram_rgb_fillFromRGB32( histogram_t *h, const picture_t *p_bgr )
+static inline void rgb_count( histogram_rgb_sub_t sub, uint32_t b, uint32_t g, uint32_t r )
+{
+    sub[b][B]++;
+    sub[g][G]++;
+    sub[r][R]++;
+}
+
+/** Add the sub-histograms to the per channel bins */
+static void histogram_rgb_merge( histogram_t *h, histogram_rgb_sub_t sub[RGB_SUB_HISTOGRAMS] )
 {
-    return histogram_rgb_fillFromRGB24_32( h, p_bgr, false );
+    for (int v=0; v<256; v++)
+        for (int c=0; c<3; c++) {
+            uint32_t sum = 0;
+            for (int s=0; s<RGB_SUB_HISTOGRAMS; s++)
+                sum += sub[s][v][c];
+            h->bins[c][v] += sum;
+        }
 }
 
-int histogram_rgb_fillFromRGB24_32( histogram_t *h, const picture_t *p_bgr, bool rgb24 )
+/**
+ * Fill an RGB histogram from a RGB24 (BGR) picture.
+ *
+ * Without column sampling, 4 pixels are read as 3 words.
+ */
+int histogram_rgb_fillFromRGB24( histogram_t *h, const picture_t *p_bgr )
 {
     if (!h)
         return HIST_INPUT_ERROR;
 
-    int bytes = rgb24 ? 3 : 4;
+    HISTOGRAM_ALIGNED( 64 ) histogram_rgb_sub_t sub[RGB_SUB_HISTOGRAMS];
+    memset( sub, 0, sizeof(sub) );
+
+    const int step = 3*h->x_step;
     int pitch = p_bgr->p[RGB_PLANE].i_pitch,                    /**< buffer line size in bytes          */
         visible_pitch = p_bgr->p[RGB_PLANE].i_visible_pitch;    /**< buffer line size in bytes (visible)*/
-    uint8_t *start = p_bgr->p[RGB_PLANE].p_pixels,
-            *end = start + pitch * p_bgr->p[RGB_PLANE].i_visible_lines;
+    const uint8_t *start = p_bgr->p[RGB_PLANE].p_pixels,
+                  *end = start + pitch * p_bgr->p[RGB_PLANE].i_visible_lines;
+
+    for (const uint8_t *line = start; line < end; line += h->y_step*pitch) {
+        const uint8_t *pel = line, *end_visible = line+visible_pitch;
+        if (step == 3)
+            for (; pel+12 <= end_visible; pel+=12) {
+                uint32_t w0 = load_word( pel ),
+                         w1 = load_word( pel+4 ),
+                         w2 = load_word( pel+8 );
+                rgb_count( sub[0], WORD_BYTE( w0, 0 ), WORD_BYTE( w0, 1 ), WORD_BYTE( w0, 2 ) );
+                rgb_count( sub[1], WORD_BYTE( w0, 3 ), WORD_BYTE( w1, 0 ), WORD_BYTE( w1, 1 ) );
+                rgb_count( sub[2], WORD_BYTE( w1, 2 ), WORD_BYTE( w1, 3 ), WORD_BYTE( w2, 0 ) );
+                rgb_count( sub[3], WORD_BYTE( w2, 1 ), WORD_BYTE( w2, 2 ), WORD_BYTE( w2, 3 ) );
+            }
+        for (int s=0; pel < end_visible; pel+=step, s=(s+1)%RGB_SUB_HISTOGRAMS)
+            rgb_count( sub[s], pel[0], pel[1], pel[2] );
+    }
+    histogram_rgb_merge( h, sub );
 
-    int shift = 8 - (int)round( log2(h->num_bins) ); /**< Right shift for pixel values when num_bins < 256 */
-    for (uint8_t *line = start; line != end; line += pitch) {
-        const uint8_t const *end_visible = line+visible_pitch;
-        for (uint8_t *pel = line; pel != end_visible; pel+=bytes) {
-            h->bins[B][pel[0]>>shift]++;
-            h->bins[G][pel[1]>>shift]++;
-            h->bins[R][pel[2]>>shift]++;
+    return HIST_SUCCESS;
+}
+
+/** Fill an RGB histogram from a RGB32 (BGRX) picture, one word per pixel. */
+int histogram_rgb_fillFromRGB32( histogram_t *h, const picture_t *p_bgr )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    HISTOGRAM_ALIGNED( 64 ) histogram_rgb_sub_t sub[RGB_SUB_HISTOGRAMS];
+    memset( sub, 0, sizeof(sub) );
+
+    const int step = 4*h->x_step;
+    int pitch = p_bgr->p[RGB_PLANE].i_pitch,                    /**< buffer line size in bytes          */
+        visible_pitch = p_bgr->p[RGB_PLANE].i_visible_pitch;    /**< buffer line size in bytes (visible)*/
+    const uint8_t *start = p_bgr->p[RGB_PLANE].p_pixels,
+                  *end = start + pitch * p_bgr->p[RGB_PLANE].i_visible_lines;
+
+    for (const uint8_t *line = start; line < end; line += h->y_step*pitch) {
+        const uint8_t *pel = line, *end_visible = line+visible_pitch;
+        for (; pel+3*step < end_visible; pel+=4*step) {
+            uint32_t w0 = load_word( pel ),
+                     w1 = load_word( pel+step ),
+                     w2 = load_word( pel+2*step ),
+                     w3 = load_word( pel+3*step );
+            rgb_count( sub[0], WORD_BYTE( w0, 0 ), WORD_BYTE( w0, 1 ), WORD_BYTE( w0, 2 ) );
+            rgb_count( sub[1], WORD_BYTE( w1, 0 ), WORD_BYTE( w1, 1 ), WORD_BYTE( w1, 2 ) );
+            rgb_count( sub[2], WORD_BYTE( w2, 0 ), WORD_BYTE( w2, 1 ), WORD_BYTE( w2, 2 ) );
+            rgb_count( sub[3], WORD_BYTE( w3, 0 ), WORD_BYTE( w3, 1 ), WORD_BYTE( w3, 2 ) );
+        }
+        for (int s=0; pel < end_visible; pel+=step, s++) {
+            uint32_t w = load_word( pel );
+            rgb_count( sub[s], WORD_BYTE( w, 0 ), WORD_BYTE( w, 1 ), WORD_BYTE( w, 2 ) );
         }
     }
+    histogram_rgb_merge( h, sub );
 
     return HIST_SUCCESS;
 }
@@ -1047,11 +2286,10 @@ int histogram_yuv_fillFromYUVPlanar( histogram_t *h, const picture_t *p_yuv )
     uint8_t *start = p_yuv->p[Y_PLANE].p_pixels,
             *end = start + pitch * p_yuv->p[Y_PLANE].i_visible_lines;
 
-    int shift = 8 - (int)round( log2(h->num_bins) ); /**< Right shift for pixel values when num_bins < 256 */
-    for (uint8_t *line = start; line != end; line += pitch) {
+    for (uint8_t *line = start; line < end; line += h->y_step*pitch) {
         const uint8_t const *end_visible = line+visible_pitch;
-        for (uint8_t *pel = line; pel != end_visible; pel++)
-            h->bins[Y][(*pel)>>shift]++;
+        for (uint8_t *pel = line; pel < end_visible; pel+=h->x_step)
+            h->bins[Y][*pel]++;
     }
 
     return HIST_SUCCESS;
@@ -1067,11 +2305,10 @@ int histogram_yuv_fillFromYUVPacked( histogram_t *h, const picture_t *p_yuv, int
     uint8_t *start = p_yuv->p[Y_PLANE].p_pixels + yoffset,
             *end = start + pitch * p_yuv->p[Y_PLANE].i_visible_lines;
 
-    int shift = 8 - (int)round( log2(h->num_bins) );
-    for (uint8_t *line = start; line != end; line += pitch) {
+    for (uint8_t *line = start; line < end; line += h->y_step*pitch) {
         const uint8_t const *end_visible = line+visible_pitch;
-        for (uint8_t *pel = line; pel != end_visible; pel+=step)
-            h->bins[Y][(*pel)>>shift]++;
+        for (uint8_t *pel = line; pel < end_visible; pel+=h->x_step*step)
+            h->bins[Y][*pel]++;
     }
 
     return HIST_SUCCESS;
@@ -1093,12 +2330,11 @@ int histogram_yuv_fillFromRGB24_32( histogram_t *h, const picture_t *p_bgr, bool
     uint8_t *start = p_bgr->p[RGB_PLANE].p_pixels,
             *end = start + pitch * p_bgr->p[RGB_PLANE].i_visible_lines;
 
-    int shift = 8 - (int)round( log2(h->num_bins) ); /**< Right shift for pixel values when num_bins < 256  */
-    for (uint8_t *line = start; line != end; line += pitch) {
+    for (uint8_t *line = start; line < end; line += h->y_step*pitch) {
         const uint8_t const *end_visible = line+visible_pitch;
-        for (uint8_t *pel = line; pel != end_visible; pel+=bytes) {
+        for (uint8_t *pel = line; pel < end_visible; pel+=h->x_step*bytes) {
             uint8_t y = ( ( (  66 * pel[2] + 129 * pel[1] +  25 * pel[0] + 128 ) >> 8 ) + 16 );
-            h->bins[Y][y>>shift]++;
+            h->bins[Y][y]++;
         }
     }
 
@@ -1115,361 +2351,3390 @@ int histogram_yuv_fillFromRGB32( histogram_t *h, const picture_t *p_bgr )
     return histogram_yuv_fillFromRGB24_32( h, p_bgr, false );
 }
 
-int histogram_fill( histogram_t *h, const picture_t *p_in )
+/*****************************************************************************
+ * High bit depth fill
+ *****************************************************************************
+ * I420/I422 10L and 12L have the samples in the low bits of 16-bit words,
+ * P010 in the high bits. histogram_t::sample_shift brings a sample to 10
+ * bits, so 12-bit pictures lose their 2 least significant bits.
+ *****************************************************************************/
+
+/**
+ * Fill a Luminance histogram from the Y-plane of a 16-bit YUV picture.
+ *
+ * Counts HISTOGRAM_RAW_BINS bins, the overlay width is only applied by
+ * histogram_normalize(). Out of range samples go to the last bin.
+ */
+int histogram_yuv_fillFromYUV16( histogram_t *h, const picture_t *p_yuv )
 {
-    return h->fill_func( h, p_in );
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    const plane_t *p = &p_yuv->p[Y_PLANE];
+    const int width = p->i_visible_pitch / 2,
+              shift = h->sample_shift,
+              last  = h->num_raw_bins - 1;
+    uint32_t *bins = h->bins[Y];
+
+    for (int y = 0; y < p->i_visible_lines; y += h->y_step) {
+        const uint16_t *line = (const uint16_t*)(p->p_pixels + y*p->i_pitch);
+        for (int x = 0; x < width; x += h->x_step) {
+            int value = line[x] >> shift;
+            bins[value < last ? value : last]++;
+        }
+    }
+
+    return HIST_SUCCESS;
 }
 
-void histogram_zero( histogram_t *h )
+/** The 8 most significant bits of a 16-bit sample, clamped to 255 */
+static inline uint8_t sample16_to_8( uint16_t sample, int shift )
 {
-    for (int i=0; i<h->num_channels; i++)
-        memset( h->bins[i], 0, h->num_bins*sizeof(uint32_t) );
+    int value = sample >> shift;
+    return value < 255 ? value : 255;
 }
 
-int histogram_update_max( histogram_t *h )
+/**
+ * Fill an RGB histogram, directly from a 16-bit YUV4:2:0/4:2:2 picture.
+ * Supports I420/I422 10L & 12L (planar) and P010 (semi-planar).
+ *
+ * As for 8-bit pictures, the Y-plane is downsampled to the chroma. Each
+ * sample goes through the yuv2rgb tables with its 8 most significant bits:
+ * the RGB channels are counted with 8 bits.
+ */
+int histogram_rgb_fillFromYUV16( histogram_t *h_rgb, const picture_t *p_yuv )
+{
+    if (!h_rgb || !p_yuv)
+        return HIST_INPUT_ERROR;
+
+    const bool semi_planar = p_yuv->i_planes == 2;
+    const plane_t *py = &p_yuv->p[Y_PLANE],
+                  *pu = &p_yuv->p[U_PLANE],
+                  *pv = &p_yuv->p[semi_planar ? U_PLANE : V_PLANE];
+    const int c_step  = semi_planar ? 2 : 1,   /**< P010 interleaves U and V  */
+              c_width = pu->i_visible_pitch / (2*c_step),
+              y_lines = pu->i_visible_lines < py->i_visible_lines ? 2 : 1, /**< per chroma line */
+              shift   = h_rgb->sample_shift + 2;
+    const histogram_yuv2rgb_t *lut = h_rgb->yuv2rgb;
+
+    for (int r = 0; r < pu->i_visible_lines; r += h_rgb->y_step) {
+        const uint16_t *y = (const uint16_t*)(py->p_pixels + r*y_lines*py->i_pitch),
+                       *u = (const uint16_t*)(pu->p_pixels + r*pu->i_pitch),
+                       *v = (const uint16_t*)(pv->p_pixels + r*pv->i_pitch) + (semi_planar ? 1 : 0);
+        for (int x = 0; x < c_width; x += h_rgb->x_step)
+            histogram_rgb_binYUV( h_rgb, lut, sample16_to_8( y[2*x], shift ),
+                                  sample16_to_8( u[c_step*x], shift ),
+                                  sample16_to_8( v[c_step*x], shift ) );
+    }
+
+    return HIST_SUCCESS;
+}
+
+/*****************************************************************************
+ * CPU dispatch
+ *****************************************************************************
+ * The instruction sets are detected once, when the filter opens, and the
+ * result is handed to histogram_set_codec(), which installs the best fill,
+ * scale and blend kernels in the histogram. There are SSE2 and AVX2 kernels:
+ * SSSE3 cpus run the SSE2 ones, AVX-512 cpus the AVX2 ones.
+ * The SIMD code is compiled with target attributes, so a generic build
+ * still uses AVX2 where the cpu has it.
+ *****************************************************************************/
+
+/** The simd option values, from the most to the least capable */
+static const struct {
+    const char* psz_name;
+    unsigned    cpu;
+} simd_levels[] = {
+    { "avx512", HISTOGRAM_CPU_SSE2 | HISTOGRAM_CPU_SSSE3 | HISTOGRAM_CPU_AVX2 | HISTOGRAM_CPU_AVX512 },
+    { "avx2",   HISTOGRAM_CPU_SSE2 | HISTOGRAM_CPU_SSSE3 | HISTOGRAM_CPU_AVX2 },
+    { "ssse3",  HISTOGRAM_CPU_SSE2 | HISTOGRAM_CPU_SSSE3 },
+    { "sse2",   HISTOGRAM_CPU_SSE2 },
+    { "scalar", 0 },
+};
+
+/**
+ * Detect the instruction sets of the running cpu, capped by psz_simd.
+ *
+ * psz_simd is one of the simd option values, "auto" or NULL for no cap.
+ * Returns HIST_INPUT_ERROR for an unknown value, cpu is not capped then.
+ */
+int histogram_cpu_detect( const char *psz_simd, unsigned *cpu )
+{
+    unsigned detected = 0;
+
+#if defined(__i386__) || defined(__x86_64__)
+    /*vlc_CPU() honours the --no-sse2 etc. options of vlc*/
+    unsigned caps = vlc_CPU();
+    if (caps & CPU_CAPABILITY_SSE2)
+        detected |= HISTOGRAM_CPU_SSE2;
+    if ((detected & HISTOGRAM_CPU_SSE2) && (caps & CPU_CAPABILITY_SSSE3))
+        detected |= HISTOGRAM_CPU_SSSE3;
+#ifdef HAVE_AVX2_INTRINSICS
+    /*but knows nothing newer than SSE4*/
+    if ((detected & HISTOGRAM_CPU_SSSE3) && __builtin_cpu_supports( "avx2" ))
+        detected |= HISTOGRAM_CPU_AVX2;
+    if ((detected & HISTOGRAM_CPU_AVX2) && __builtin_cpu_supports( "avx512bw" ))
+        detected |= HISTOGRAM_CPU_AVX512;
+#endif
+#endif
+
+    *cpu = detected;
+    if (psz_simd == NULL || *psz_simd == '\0' || !strcmp( psz_simd, "auto" ))
+        return HIST_SUCCESS;
+
+    for (size_t i=0; i<sizeof(simd_levels)/sizeof(simd_levels[0]); i++)
+        if (!strcmp( psz_simd, simd_levels[i].psz_name )) {
+            *cpu = detected & simd_levels[i].cpu;
+            return HIST_SUCCESS;
+        }
+
+    return HIST_INPUT_ERROR;
+}
+
+/**
+ * The name of the kernels histogram_set_codec() installs for cpu: avx2,
+ * sse2 or scalar, like histogram_luma_kernel() and histogram_blend_rows()
+ * pick them. avx512 and ssse3 cpus are named after the kernels they run.
+ */
+const char* histogram_cpu_name( unsigned cpu )
+{
+#ifdef HAVE_AVX2_INTRINSICS
+    if (cpu & HISTOGRAM_CPU_AVX2)
+        return "avx2";
+#endif
+#ifdef HAVE_SSE2_INTRINSICS
+    if (cpu & HISTOGRAM_CPU_SSE2)
+        return "sse2";
+#endif
+    VLC_UNUSED(cpu);
+    return "scalar";
+}
+
+/*****************************************************************************
+ * SIMD luma kernels
+ *****************************************************************************
+ * Counting runs of identical values into a single bin array stalls on the
+ * store-to-load forwarding of the previous increment. The kernels below
+ * spread consecutive samples over LUMA_SUB_HISTOGRAMS interleaved, cache-line
+ * aligned sub-histograms of 256 bins, and merge them into h->bins[Y] once per
+ * frame. The results are identical to the scalar fill functions.
+ * Row sampling is supported, column sampling falls back to the scalar code.
+ *****************************************************************************/
+
+/** Pick the fastest luma kernel cpu (HISTOGRAM_CPU_*) can run. */
+f_fill histogram_luma_kernel( unsigned cpu, f_fill scalar, f_fill sse2, f_fill avx2 )
+{
+#ifdef HAVE_AVX2_INTRINSICS
+    if (avx2 && (cpu & HISTOGRAM_CPU_AVX2))
+        return avx2;
+#else
+    VLC_UNUSED(avx2);
+#endif
+#ifdef HAVE_SSE2_INTRINSICS
+    if (sse2 && (cpu & HISTOGRAM_CPU_SSE2))
+        return sse2;
+#else
+    VLC_UNUSED(sse2);
+#endif
+    return scalar;
+}
+
+#if defined(HAVE_SSE2_INTRINSICS) || defined(HAVE_AVX2_INTRINSICS)
+/** Sum the sub-histograms into h->bins[Y]. */
+static void histogram_luma_merge( histogram_t *h, uint32_t sub[LUMA_SUB_HISTOGRAMS][256] )
+{
+    for (int v=0; v<256; v++) {
+        uint32_t sum = 0;
+        for (int s=0; s<LUMA_SUB_HISTOGRAMS; s++)
+            sum += sub[s][v];
+        h->bins[Y][v] += sum;
+    }
+}
+
+/** Count the four bytes of a 32-bit word, one per sub-histogram. */
+static inline void luma_count_word( uint32_t sub[LUMA_SUB_HISTOGRAMS][256], uint32_t w )
+{
+    sub[0][w & 0xFF]++;
+    sub[1][(w >> 8) & 0xFF]++;
+    sub[2][(w >> 16) & 0xFF]++;
+    sub[3][w >> 24]++;
+}
+#endif
+
+#ifdef HAVE_SSE2_INTRINSICS
+static inline void luma_count_sse2( uint32_t sub[LUMA_SUB_HISTOGRAMS][256], __m128i v )
+{
+    luma_count_word( sub, _mm_cvtsi128_si32( v ) );
+    luma_count_word( sub, _mm_cvtsi128_si32( _mm_srli_si128( v, 4 ) ) );
+    luma_count_word( sub, _mm_cvtsi128_si32( _mm_srli_si128( v, 8 ) ) );
+    luma_count_word( sub, _mm_cvtsi128_si32( _mm_srli_si128( v, 12 ) ) );
+}
+
+/** Convert 4 BGRx pixels (one per 32-bit lane) to 4 luma values. */
+static inline __m128i luma_from_bgrx_sse2( __m128i px )
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i coeff = _mm_setr_epi16( 25, 129, 66, 0, 25, 129, 66, 0 );
+    const __m128i round = _mm_set1_epi32( 128 );
+    __m128i lo = _mm_madd_epi16( _mm_unpacklo_epi8( px, zero ), coeff ); /* b+g,r of px0,px1 */
+    __m128i hi = _mm_madd_epi16( _mm_unpackhi_epi8( px, zero ), coeff ); /* b+g,r of px2,px3 */
+    __m128i even = _mm_unpacklo_epi64( _mm_shuffle_epi32( lo, _MM_SHUFFLE(2,0,2,0) ),
+                                       _mm_shuffle_epi32( hi, _MM_SHUFFLE(2,0,2,0) ) );
+    __m128i odd  = _mm_unpacklo_epi64( _mm_shuffle_epi32( lo, _MM_SHUFFLE(3,1,3,1) ),
+                                       _mm_shuffle_epi32( hi, _MM_SHUFFLE(3,1,3,1) ) );
+    __m128i y = _mm_add_epi32( _mm_add_epi32( even, odd ), round );
+    return _mm_add_epi32( _mm_srli_epi32( y, 8 ), _mm_set1_epi32( 16 ) );
+}
+
+/** Count 4 luma values held in 32-bit lanes. */
+static inline void luma_count_dwords_sse2( uint32_t sub[LUMA_SUB_HISTOGRAMS][256], __m128i y )
+{
+    __m128i packed = _mm_packus_epi16( _mm_packs_epi32( y, y ), y );
+    luma_count_word( sub, _mm_cvtsi128_si32( packed ) );
+}
+
+int histogram_yuv_fillFromYUVPlanar_sse2( histogram_t *h, const picture_t *p_yuv )
 {
     if (!h)
         return HIST_INPUT_ERROR;
 
-    /*Reset max[i]*/
-    for (int i=0; i<MAX_NUM_CHANNELS; i++)
-        h->max[i] = 0.0F;
+    /*Skipped columns defeat the vector loads*/
+    if (h->x_step > 1)
+        return histogram_yuv_fillFromYUVPlanar( h, p_yuv );
 
-    /*Get maximum bin value for each color*/
-    uint32_t value;
-    for (int i=0; i<h->num_channels; i++)
-        for (int b=0; b<h->num_bins; b++) {
-            value = h->bins[i][b];
-            if (value > h->max[i]) h->max[i] = value;
+    HISTOGRAM_ALIGNED( 64 ) uint32_t sub[LUMA_SUB_HISTOGRAMS][256];
+    memset( sub, 0, sizeof(sub) );
+
+    int pitch = p_yuv->p[Y_PLANE].i_pitch,
+        visible_pitch = p_yuv->p[Y_PLANE].i_visible_pitch;
+    const uint8_t *start = p_yuv->p[Y_PLANE].p_pixels,
+                  *end = start + pitch * p_yuv->p[Y_PLANE].i_visible_lines;
+
+    for (const uint8_t *line = start; line < end; line += h->y_step*pitch) {
+        const uint8_t *pel = line, *end_visible = line+visible_pitch;
+        for (; pel+16 <= end_visible; pel+=16)
+            luma_count_sse2( sub, _mm_loadu_si128( (const __m128i*)pel ) );
+        for (int s=0; pel != end_visible; pel++, s=(s+1)%LUMA_SUB_HISTOGRAMS)
+            sub[s][*pel]++;
+    }
+    histogram_luma_merge( h, sub );
+
+    return HIST_SUCCESS;
+}
+
+int histogram_yuv_fillFromYUYV_sse2( histogram_t *h, const picture_t *p_yuv )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    /*Skipped columns defeat the vector loads*/
+    if (h->x_step > 1)
+        return histogram_yuv_fillFromYUYV( h, p_yuv );
+
+    HISTOGRAM_ALIGNED( 64 ) uint32_t sub[LUMA_SUB_HISTOGRAMS][256];
+    memset( sub, 0, sizeof(sub) );
+
+    const __m128i mask = _mm_set1_epi16( 0x00FF );
+    int pitch = p_yuv->p[Y_PLANE].i_pitch,
+        visible_pitch = p_yuv->p[Y_PLANE].i_visible_pitch;
+    const uint8_t *start = p_yuv->p[Y_PLANE].p_pixels,
+                  *end = start + pitch * p_yuv->p[Y_PLANE].i_visible_lines;
+
+    for (const uint8_t *line = start; line < end; line += h->y_step*pitch) {
+        const uint8_t *pel = line, *end_visible = line+visible_pitch;
+        for (; pel+32 <= end_visible; pel+=32) {
+            __m128i a = _mm_and_si128( _mm_loadu_si128( (const __m128i*)pel ), mask );
+            __m128i b = _mm_and_si128( _mm_loadu_si128( (const __m128i*)(pel+16) ), mask );
+            luma_count_sse2( sub, _mm_packus_epi16( a, b ) );
         }
+        for (int s=0; pel != end_visible; pel+=2, s=(s+1)%LUMA_SUB_HISTOGRAMS)
+            sub[s][*pel]++;
+    }
+    histogram_luma_merge( h, sub );
 
     return HIST_SUCCESS;
 }
 
-int histogram_free( histogram_t **h )
+int histogram_yuv_fillFromRGB24_sse2( histogram_t *h, const picture_t *p_bgr )
 {
-    if (!h || !*h)
-        return HIST_SUCCESS;
+    if (!h)
+        return HIST_INPUT_ERROR;
 
-    for (int i=0; i<MAX_NUM_CHANNELS; i++)
-        free( (*h)->bins[i] );
-    picture_Release( (*h)->p_overlay );
+    /*Skipped columns defeat the vector loads*/
+    if (h->x_step > 1)
+        return histogram_yuv_fillFromRGB24( h, p_bgr );
+
+    HISTOGRAM_ALIGNED( 64 ) uint32_t sub[LUMA_SUB_HISTOGRAMS][256];
+    memset( sub, 0, sizeof(sub) );
+
+    const __m128i mask = _mm_set1_epi32( 0x00FFFFFF );
+    int pitch = p_bgr->p[RGB_PLANE].i_pitch,
+        visible_pitch = p_bgr->p[RGB_PLANE].i_visible_pitch;
+    const uint8_t *start = p_bgr->p[RGB_PLANE].p_pixels,
+                  *end = start + pitch * p_bgr->p[RGB_PLANE].i_visible_lines;
+
+    for (const uint8_t *line = start; line < end; line += h->y_step*pitch) {
+        const uint8_t *pel = line, *end_visible = line+visible_pitch;
+        /*Load 16 bytes, use the first 12 (4 pixels)*/
+        for (; pel+16 <= end_visible; pel+=12) {
+            __m128i v = _mm_loadu_si128( (const __m128i*)pel );
+            __m128i px01 = _mm_unpacklo_epi32( v, _mm_srli_si128( v, 3 ) );
+            __m128i px23 = _mm_unpacklo_epi32( _mm_srli_si128( v, 6 ), _mm_srli_si128( v, 9 ) );
+            __m128i px = _mm_and_si128( _mm_unpacklo_epi64( px01, px23 ), mask );
+            luma_count_dwords_sse2( sub, luma_from_bgrx_sse2( px ) );
+        }
+        for (int s=0; pel != end_visible; pel+=3, s=(s+1)%LUMA_SUB_HISTOGRAMS) {
+            uint8_t y = ( ( (  66 * pel[2] + 129 * pel[1] +  25 * pel[0] + 128 ) >> 8 ) + 16 );
+            sub[s][y]++;
+        }
+    }
+    histogram_luma_merge( h, sub );
 
-    free( *h );
-    *h = NULL;
+    return HIST_SUCCESS;
+}
+
+int histogram_yuv_fillFromRGB32_sse2( histogram_t *h, const picture_t *p_bgr )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    /*Skipped columns defeat the vector loads*/
+    if (h->x_step > 1)
+        return histogram_yuv_fillFromRGB32( h, p_bgr );
+
+    HISTOGRAM_ALIGNED( 64 ) uint32_t sub[LUMA_SUB_HISTOGRAMS][256];
+    memset( sub, 0, sizeof(sub) );
+
+    const __m128i mask = _mm_set1_epi32( 0x00FFFFFF );
+    int pitch = p_bgr->p[RGB_PLANE].i_pitch,
+        visible_pitch = p_bgr->p[RGB_PLANE].i_visible_pitch;
+    const uint8_t *start = p_bgr->p[RGB_PLANE].p_pixels,
+                  *end = start + pitch * p_bgr->p[RGB_PLANE].i_visible_lines;
+
+    for (const uint8_t *line = start; line < end; line += h->y_step*pitch) {
+        const uint8_t *pel = line, *end_visible = line+visible_pitch;
+        for (; pel+16 <= end_visible; pel+=16) {
+            __m128i px = _mm_and_si128( _mm_loadu_si128( (const __m128i*)pel ), mask );
+            luma_count_dwords_sse2( sub, luma_from_bgrx_sse2( px ) );
+        }
+        for (int s=0; pel != end_visible; pel+=4, s=(s+1)%LUMA_SUB_HISTOGRAMS) {
+            uint8_t y = ( ( (  66 * pel[2] + 129 * pel[1] +  25 * pel[0] + 128 ) >> 8 ) + 16 );
+            sub[s][y]++;
+        }
+    }
+    histogram_luma_merge( h, sub );
+
+    return HIST_SUCCESS;
+}
+#endif /*HAVE_SSE2_INTRINSICS*/
+
+#ifdef HAVE_AVX2_INTRINSICS
+__attribute__((target("avx2")))
+static inline void luma_count_avx2( uint32_t sub[LUMA_SUB_HISTOGRAMS][256], __m256i v )
+{
+    __m128i lo = _mm256_castsi256_si128( v ),
+            hi = _mm256_extracti128_si256( v, 1 );
+    luma_count_word( sub, _mm_cvtsi128_si32( lo ) );
+    luma_count_word( sub, _mm_extract_epi32( lo, 1 ) );
+    luma_count_word( sub, _mm_extract_epi32( lo, 2 ) );
+    luma_count_word( sub, _mm_extract_epi32( lo, 3 ) );
+    luma_count_word( sub, _mm_cvtsi128_si32( hi ) );
+    luma_count_word( sub, _mm_extract_epi32( hi, 1 ) );
+    luma_count_word( sub, _mm_extract_epi32( hi, 2 ) );
+    luma_count_word( sub, _mm_extract_epi32( hi, 3 ) );
+}
+
+__attribute__((target("avx2")))
+int histogram_yuv_fillFromYUVPlanar_avx2( histogram_t *h, const picture_t *p_yuv )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    /*Skipped columns defeat the vector loads*/
+    if (h->x_step > 1)
+        return histogram_yuv_fillFromYUVPlanar( h, p_yuv );
+
+    HISTOGRAM_ALIGNED( 64 ) uint32_t sub[LUMA_SUB_HISTOGRAMS][256];
+    memset( sub, 0, sizeof(sub) );
+
+    int pitch = p_yuv->p[Y_PLANE].i_pitch,
+        visible_pitch = p_yuv->p[Y_PLANE].i_visible_pitch;
+    const uint8_t *start = p_yuv->p[Y_PLANE].p_pixels,
+                  *end = start + pitch * p_yuv->p[Y_PLANE].i_visible_lines;
+
+    for (const uint8_t *line = start; line < end; line += h->y_step*pitch) {
+        const uint8_t *pel = line, *end_visible = line+visible_pitch;
+        for (; pel+32 <= end_visible; pel+=32)
+            luma_count_avx2( sub, _mm256_loadu_si256( (const __m256i*)pel ) );
+        for (int s=0; pel != end_visible; pel++, s=(s+1)%LUMA_SUB_HISTOGRAMS)
+            sub[s][*pel]++;
+    }
+    histogram_luma_merge( h, sub );
+
+    return HIST_SUCCESS;
+}
+
+__attribute__((target("avx2")))
+int histogram_yuv_fillFromYUYV_avx2( histogram_t *h, const picture_t *p_yuv )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    /*Skipped columns defeat the vector loads*/
+    if (h->x_step > 1)
+        return histogram_yuv_fillFromYUYV( h, p_yuv );
+
+    HISTOGRAM_ALIGNED( 64 ) uint32_t sub[LUMA_SUB_HISTOGRAMS][256];
+    memset( sub, 0, sizeof(sub) );
+
+    const __m256i mask = _mm256_set1_epi16( 0x00FF );
+    int pitch = p_yuv->p[Y_PLANE].i_pitch,
+        visible_pitch = p_yuv->p[Y_PLANE].i_visible_pitch;
+    const uint8_t *start = p_yuv->p[Y_PLANE].p_pixels,
+                  *end = start + pitch * p_yuv->p[Y_PLANE].i_visible_lines;
+
+    for (const uint8_t *line = start; line < end; line += h->y_step*pitch) {
+        const uint8_t *pel = line, *end_visible = line+visible_pitch;
+        for (; pel+64 <= end_visible; pel+=64) {
+            __m256i a = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*)pel ), mask );
+            __m256i b = _mm256_and_si256( _mm256_loadu_si256( (const __m256i*)(pel+32) ), mask );
+            /*packus works per 128-bit lane, the sample order does not matter here*/
+            luma_count_avx2( sub, _mm256_packus_epi16( a, b ) );
+        }
+        for (int s=0; pel != end_visible; pel+=2, s=(s+1)%LUMA_SUB_HISTOGRAMS)
+            sub[s][*pel]++;
+    }
+    histogram_luma_merge( h, sub );
 
     return HIST_SUCCESS;
 }
+#endif /*HAVE_AVX2_INTRINSICS*/
+
+/**
+ * Make p_view the region of interest of p_pic, when roi is set.
+ *
+ * The rectangle is clipped to the picture and aligned to 2 pixels, so that
+ * subsampled and packed chroma stays co-sited. It is never empty.
+ * Returns false (p_view untouched) to fill the whole picture.
+ */
+static bool histogram_roi_view( const histogram_roi_t *roi, const picture_t *p_pic, picture_t *p_view )
+{
+    const plane_t *p0 = &p_pic->p[0];
+    const int pic_width  = p0->i_visible_pitch / p0->i_pixel_pitch,
+              pic_height = p0->i_visible_lines;
+
+    if (roi->width <= 0 || roi->height <= 0 || pic_width < 2 || pic_height < 2)
+        return false;
+
+    int x = __MIN( __MAX( 0, roi->x ), pic_width - 2 ) & ~1,
+        y = __MIN( __MAX( 0, roi->y ), pic_height - 2 ) & ~1,
+        width  = __MAX( 2, __MIN( roi->width,  pic_width - x ) & ~1 ),
+        height = __MAX( 2, __MIN( roi->height, pic_height - y ) & ~1 );
+    picture_CropView( p_view, p_pic, x, y, width, height );
+
+    return true;
+}
+
+/**
+ * Rows of the first plane per fill unit: a whole chroma row for the fills
+ * that pair luma with chroma or read chroma, eg. 2 for 4:2:0, else 1.
+ */
+static int histogram_row_unit( const histogram_t *h, const picture_t *p_pic )
+{
+    int unit = 1;
+
+    if (h->yuv2rgb != NULL || h->type == HISTO_VECTORSCOPE)
+        for (int i=1; i<p_pic->i_planes; i++) {
+            int x_shift, y_shift;
+            picture_PlaneShift( p_pic, i, &x_shift, &y_shift );
+            if (1 << y_shift > unit)
+                unit = 1 << y_shift;
+        }
+
+    return unit;
+}
+
+/**
+ * Make p_view the part of p_pic that has chroma samples, for the fills that
+ * pair luma with chroma or read chroma. The chroma of an odd sized picture
+ * is rounded down, those fills would read one chroma row or column past
+ * its end. Returns false (p_view untouched) when the whole picture is read.
+ */
+static bool histogram_chroma_view( const histogram_t *h, const picture_t *p_pic, picture_t *p_view )
+{
+    if (h->yuv2rgb == NULL && h->type != HISTO_VECTORSCOPE)
+        return false;
+
+    const plane_t *p0 = &p_pic->p[0];
+    const int pic_width  = p0->i_visible_pitch / p0->i_pixel_pitch,
+              pic_height = p0->i_visible_lines;
+    int width  = pic_width,
+        height = pic_height;
+
+    /*Packed 4:2:2 has its chroma in whole macro-pixels*/
+    if (p_pic->i_planes == 1)
+        width &= ~1;
+    for (int i=1; i<p_pic->i_planes; i++) {
+        const plane_t *p = &p_pic->p[i];
+        int x_shift, y_shift;
+        picture_PlaneShift( p_pic, i, &x_shift, &y_shift );
+        width  = __MIN( width,  (p->i_visible_pitch / p->i_pixel_pitch) << x_shift );
+        height = __MIN( height, p->i_visible_lines << y_shift );
+    }
+
+    if (width == pic_width && height == pic_height)
+        return false;
+    picture_CropView( p_view, p_pic, 0, 0, width, height );
+    return true;
+}
+
+int histogram_fill( histogram_t *h, const picture_t *p_in, histogram_pool_t *pool )
+{
+    int status;
+
+    /*Only the luma with chroma is read by the chroma fills*/
+    picture_t cosited;
+    if (histogram_chroma_view( h, p_in, &cosited ))
+        p_in = &cosited;
+
+    /*Only the region of interest is read*/
+    picture_t roi;
+    if (histogram_roi_view( &h->roi, p_in, &roi ))
+        p_in = &roi;
+
+    /*Smoothed and sampled: start each fill on other pixels*/
+    picture_t phase;
+    if (histogram_phase_view( h, p_in, &phase ))
+        p_in = &phase;
+
+    if (h->tiles[0])
+        status = histogram_grid_fill( h, p_in, pool );
+    else if (pool)
+        status = histogram_pool_fill( pool, h, p_in );
+    else
+        status = h->fill_func( h, p_in );
+
+    /*Scale sampled counts up, so that log/equalize behave like full sampling*/
+    uint32_t scale = h->x_step * h->y_step * h->y_sampled;
+    if (scale > 1)
+        for (int i=0; i<h->num_channels; i++) {
+            for (int b=0; b<h->num_raw_bins; b++)
+                h->bins[i][b] *= scale;
+            for (int b=0; h->tiles[i] && b<h->grid_cols*h->grid_rows*h->num_raw_bins; b++)
+                h->tiles[i][b] *= scale;
+        }
+
+    return status;
+}
+
+/*****************************************************************************
+ * Temporal smoothing
+ *****************************************************************************
+ * histogram_smooth() runs between histogram_fill() and histogram_normalize().
+ * It replaces the counts of the frame by their exponential moving average,
+ * or by their average over the last frames, so update_max, normalize and
+ * the grid see steady counts.
+ *
+ * With sampling, each fill starts on another of the x_step*y_step sampling
+ * phases, see histogram_phase_view(): a window of x_step*y_step frames of a
+ * still picture counts all its pixels once, and the EMA converges to them.
+ *****************************************************************************/
+
+/** Parse the smooth option value */
+int histogram_smooth_mode( const char *psz_mode, histo_smooth_e *mode )
+{
+    *mode = HISTO_SMOOTH_OFF;
+    if (psz_mode == NULL || *psz_mode == '\0' || !strcmp( psz_mode, "off" ))
+        return HIST_SUCCESS;
+    if (!strcmp( psz_mode, "ema" ))
+        *mode = HISTO_SMOOTH_EMA;
+    else if (!strcmp( psz_mode, "window" ))
+        *mode = HISTO_SMOOTH_WINDOW;
+    else
+        return HIST_INPUT_ERROR;
+
+    return HIST_SUCCESS;
+}
+
+/**
+ * Smooth the counts of h over frames frames.
+ *
+ * Call after histogram_set_codec() and histogram_set_grid(), the state is
+ * sized for the bins and the tiles.
+ */
+int histogram_set_smooth( histogram_t *h, histo_smooth_e mode, int frames )
+{
+    if (mode == HISTO_SMOOTH_OFF || frames < 2)
+        return HIST_SUCCESS;
+
+    histogram_smooth_t *s = (histogram_smooth_t*)calloc( 1, sizeof(histogram_smooth_t) );
+    if (s == NULL)
+        return HIST_ERROR;
+    s->mode   = mode;
+    s->frames = frames;
+    s->size   = h->num_raw_bins;
+    if (h->tiles[0])
+        s->size += h->grid_cols*h->grid_rows*h->num_raw_bins;
+
+    for (int c=0; c<h->num_channels; c++) {
+        bool ok;
+        if (mode == HISTO_SMOOTH_EMA) {
+            s->ema[c] = (int64_t*)calloc( s->size, sizeof(int64_t) );
+            ok = s->ema[c] != NULL;
+        } else {
+            s->ring[c] = (uint32_t*)calloc( (size_t)frames*s->size, sizeof(uint32_t) );
+            s->sum[c]  = (uint32_t*)calloc( s->size, sizeof(uint32_t) );
+            ok = s->ring[c] != NULL && s->sum[c] != NULL;
+        }
+        if (!ok) {
+            histogram_smooth_free( s );
+            return HIST_ERROR;
+        }
+    }
+
+    histogram_smooth_free( h->smooth );
+    h->smooth = s;
+    return HIST_SUCCESS;
+}
+
+void histogram_smooth_free( histogram_smooth_t *s )
+{
+    if (s == NULL)
+        return;
+    for (int c=0; c<MAX_NUM_CHANNELS; c++) {
+        free( s->ema[c] );
+        free( s->ring[c] );
+        free( s->sum[c] );
+    }
+    free( s );
+}
+
+/** Smooth n counts of channel c, stored at offset in the smoothing state */
+static void histogram_smooth_counts( histogram_smooth_t *s, int c, uint32_t *counts,
+                                     int offset, int n )
+{
+    if (s->mode == HISTO_SMOOTH_EMA) {
+        const int64_t weight = ((int64_t)1 << SMOOTH_EMA_BITS) / s->frames,
+                      half   = (int64_t)1 << (SMOOTH_EMA_BITS - 1);
+        int64_t *ema = s->ema[c] + offset;
+
+        for (int b=0; b<n; b++) {
+            const int64_t count = (int64_t)counts[b] << SMOOTH_EMA_BITS;
+            if (s->filled == 1)
+                ema[b] = count;
+            else
+                ema[b] += (count - ema[b]) * weight >> SMOOTH_EMA_BITS;
+            counts[b] = (ema[b] + half) >> SMOOTH_EMA_BITS;
+        }
+    } else {
+        uint32_t *slot = s->ring[c] + (size_t)s->next*s->size + offset,
+                 *sum  = s->sum[c] + offset;
+        const uint32_t filled = s->filled;
+
+        for (int b=0; b<n; b++) {
+            sum[b] += counts[b] - slot[b];
+            slot[b] = counts[b];
+            counts[b] = (sum[b] + filled/2) / filled;
+        }
+    }
+}
+
+/**
+ * Replace the counts of the last fill by their smoothed values, in place.
+ * Does nothing without histogram_set_smooth().
+ */
+int histogram_smooth( histogram_t *h )
+{
+    histogram_smooth_t *s = h->smooth;
+    if (s == NULL)
+        return HIST_SUCCESS;
+
+    if (s->filled < s->frames)
+        s->filled++;
+    for (int c=0; c<h->num_channels; c++) {
+        histogram_smooth_counts( s, c, h->bins[c], 0, h->num_raw_bins );
+        if (h->tiles[c])
+            histogram_smooth_counts( s, c, h->tiles[c], h->num_raw_bins,
+                                     s->size - h->num_raw_bins );
+    }
+    s->next = (s->next + 1) % s->frames;
+    s->phase++;
+
+    return HIST_SUCCESS;
+}
+
+/**
+ * Crop p_in to the sampling phase of the next fill, for smoothed histograms
+ * sampled with x_step or y_step > 1. Returns false when there is nothing
+ * to crop.
+ *
+ * The phases step over the fill units: pixels for the luma fills, whole
+ * chroma samples for the fills that pair luma with chroma or read chroma.
+ */
+bool histogram_phase_view( const histogram_t *h, const picture_t *p_in, picture_t *p_view )
+{
+    if (h->smooth == NULL || h->x_step * h->y_step <= 1)
+        return false;
+
+    const plane_t *p0 = &p_in->p[0];
+    const bool chroma = h->yuv2rgb != NULL || h->type == HISTO_VECTORSCOPE;
+    const unsigned k = h->smooth->phase % (unsigned)(h->x_step * h->y_step);
+    const int x_unit = chroma ? 2 : 1,
+              y_unit = histogram_row_unit( h, p_in ),
+              x      = (k % h->x_step) * x_unit,
+              y      = (k / h->x_step) * y_unit,
+              width  = p0->i_visible_pitch / p0->i_pixel_pitch,
+              height = p0->i_visible_lines;
+
+    if ((x == 0 && y == 0) || x >= width || y >= height)
+        return false;
+    picture_CropView( p_view, p_in, x, y, width - x, height - y );
+    return true;
+}
+
+/*****************************************************************************
+ * Peak hold
+ *****************************************************************************
+ * histogram_peak_hold() runs after the fill and the smoothing, and keeps
+ * the highest count of every overlay bin over the last frames. The held
+ * counts are scaled with the bars by update_max/normalize, and drawn as a
+ * one pixel line above them by the bar paint functions.
+ *****************************************************************************/
+
+/**
+ * Hold the peaks of h over frames histogram updates, 0: off.
+ *
+ * Only the whole picture bar histograms have a peak line: call after
+ * histogram_set_grid(), HIST_INPUT_ERROR is returned for grids, the
+ * waveform and the vectorscope.
+ */
+int histogram_set_peak_hold( histogram_t *h, int frames )
+{
+    if (frames <= 0)
+        return HIST_SUCCESS;
+    if (h->tiles[0] || histogram_is_density( h ) || frames > UINT16_MAX)
+        return HIST_INPUT_ERROR;
+
+    histogram_peak_t *p = (histogram_peak_t*)calloc( 1, sizeof(histogram_peak_t) );
+    if (p == NULL)
+        return HIST_ERROR;
+    p->frames = frames;
+    p->size   = h->num_bins;
+
+    for (int c=0; c<h->num_channels; c++) {
+        p->count[c]   = (uint32_t*)malloc( (size_t)frames*p->size*sizeof(uint32_t) );
+        p->stamp[c]   = (uint32_t*)malloc( (size_t)frames*p->size*sizeof(uint32_t) );
+        p->head[c]    = (uint16_t*)calloc( p->size, sizeof(uint16_t) );
+        p->len[c]     = (uint16_t*)calloc( p->size, sizeof(uint16_t) );
+        p->held[c]    = (uint32_t*)calloc( p->size, sizeof(uint32_t) );
+        p->heights[c] = (uint32_t*)calloc( p->size, sizeof(uint32_t) );
+        p->painted[c] = (uint32_t*)calloc( p->size, sizeof(uint32_t) );
+        if (!p->count[c] || !p->stamp[c] || !p->head[c] || !p->len[c] ||
+            !p->held[c] || !p->heights[c] || !p->painted[c]) {
+            histogram_peak_free( p );
+            return HIST_ERROR;
+        }
+    }
+
+    histogram_peak_free( h->peak );
+    h->peak = p;
+    return HIST_SUCCESS;
+}
+
+void histogram_peak_free( histogram_peak_t *p )
+{
+    if (p == NULL)
+        return;
+    for (int c=0; c<MAX_NUM_CHANNELS; c++) {
+        free( p->count[c] );
+        free( p->stamp[c] );
+        free( p->head[c] );
+        free( p->len[c] );
+        free( p->held[c] );
+        free( p->heights[c] );
+        free( p->painted[c] );
+    }
+    free( p );
+}
+
+/**
+ * Push the counts of the last fill and update the held counts.
+ * Does nothing without histogram_set_peak_hold().
+ *
+ * A new count first drops the counts it is not smaller than from the back
+ * of the deque, they can never be the maximum again, then the counts older
+ * than frames are dropped from the front. The front is the held count.
+ */
+int histogram_peak_hold( histogram_t *h )
+{
+    histogram_peak_t *p = h->peak;
+    if (p == NULL)
+        return HIST_SUCCESS;
+
+    const uint32_t frame  = p->frame++,
+                   frames = p->frames;
+
+    for (int c=0; c<h->num_channels; c++)
+        for (int b=0; b<p->size; b++) {
+            uint32_t *count = p->count[c] + b*frames,
+                     *stamp = p->stamp[c] + b*frames;
+            uint32_t head = p->head[c][b],
+                     len  = p->len[c][b];
+            const uint32_t value = h->num_raw_bins > h->num_bins ? histogram_fold( h, c, b )
+                                                                 : h->bins[c][b];
+
+            while (len > 0 && count[(head + len - 1) % frames] <= value)
+                len--;
+            if (len > 0 && frame - stamp[head] >= frames) {
+                head = (head + 1) % frames;
+                len--;
+            }
+            count[(head + len) % frames] = value;
+            stamp[(head + len) % frames] = frame;
+            len++;
+
+            p->head[c][b] = head;
+            p->len[c][b]  = len;
+            p->held[c][b] = count[head];
+        }
+
+    return HIST_SUCCESS;
+}
+
+static void *histogram_worker_run( void *data )
+{
+    histogram_worker_t *w = (histogram_worker_t*)data;
+    histogram_pool_t *pool = w->pool;
+    unsigned generation = 0;
+
+    vlc_mutex_lock( &pool->lock );
+    for (;;) {
+        while (!pool->quit && w->generation == generation)
+            vlc_cond_wait( &pool->wait_job, &pool->lock );
+        if (pool->quit)
+            break;
+        generation = w->generation;
+        vlc_mutex_unlock( &pool->lock );
+
+        histogram_zero( &w->h );
+        int status = w->h.fill_func( &w->h, &w->slice );
+
+        vlc_mutex_lock( &pool->lock );
+        w->status = status;
+        if (--pool->pending == 0)
+            vlc_cond_signal( &pool->wait_done );
+    }
+    vlc_mutex_unlock( &pool->lock );
+
+    return NULL;
+}
+
+/** Start num_threads-1 workers, the caller is the remaining thread. */
+histogram_pool_t* histogram_pool_new( int num_threads )
+{
+    histogram_pool_t *pool = (histogram_pool_t*)calloc( 1, sizeof(histogram_pool_t) );
+    if (pool == NULL)
+        return NULL;
+
+    vlc_mutex_init( &pool->lock );
+    vlc_cond_init( &pool->wait_job );
+    vlc_cond_init( &pool->wait_done );
+
+    for (int i=0; i<num_threads-1; i++) {
+        histogram_worker_t *w = &pool->workers[i];
+        w->pool = pool;
+        if (vlc_clone( &w->thread, histogram_worker_run, w, VLC_THREAD_PRIORITY_LOW ))
+            break;
+        pool->num_workers++;
+    }
+
+    if (pool->num_workers == 0) {
+        histogram_pool_delete( pool );
+        return NULL;
+    }
+
+    return pool;
+}
+
+void histogram_pool_delete( histogram_pool_t *pool )
+{
+    if (!pool)
+        return;
+
+    vlc_mutex_lock( &pool->lock );
+    pool->quit = true;
+    vlc_cond_broadcast( &pool->wait_job );
+    vlc_mutex_unlock( &pool->lock );
+
+    for (int i=0; i<pool->num_workers; i++) {
+        vlc_join( pool->workers[i].thread, NULL );
+        for (int c=0; c<MAX_NUM_CHANNELS; c++)
+            free( pool->workers[i].h.bins[c] );
+    }
+
+    vlc_cond_destroy( &pool->wait_done );
+    vlc_cond_destroy( &pool->wait_job );
+    vlc_mutex_destroy( &pool->lock );
+    free( pool );
+}
+
+/** Make the private bins of a worker match the layout of h. */
+static int histogram_worker_prepare( histogram_worker_t *w, const histogram_t *h )
+{
+    uint32_t *bins[MAX_NUM_CHANNELS];
+
+    if (w->num_bins < h->num_raw_bins) {
+        for (int c=0; c<MAX_NUM_CHANNELS; c++) {
+            free( w->h.bins[c] );
+            w->h.bins[c] = NULL;
+        }
+        w->num_bins = 0;
+        for (int c=0; c<MAX_NUM_CHANNELS; c++) {
+            w->h.bins[c] = (uint32_t*)malloc( h->num_raw_bins*sizeof(uint32_t) );
+            if (w->h.bins[c] == NULL)
+                return HIST_ERROR;
+        }
+        w->num_bins = h->num_raw_bins;
+    }
+
+    /*Share everything but the bins with the job histogram, and not the tiles*/
+    memcpy( bins, w->h.bins, sizeof(bins) );
+    w->h = *h;
+    memcpy( w->h.bins, bins, sizeof(bins) );
+    memset( w->h.tiles, 0, sizeof(w->h.tiles) );
+
+    return HIST_SUCCESS;
+}
+
+int histogram_pool_fill( histogram_pool_t *pool, histogram_t *h, const picture_t *p_in )
+{
+    const plane_t *p0 = &p_in->p[0];
+    int width  = p0->i_visible_pitch / p0->i_pixel_pitch,
+        height = p0->i_visible_lines,
+        align  = 1;
+
+    /*Slices start on a sampled chroma line, eg. on even lines for 4:2:0*/
+    for (int i=1; i<p_in->i_planes; i++) {
+        int x_shift, y_shift;
+        picture_PlaneShift( p_in, i, &x_shift, &y_shift );
+        if (1 << y_shift > align)
+            align = 1 << y_shift;
+    }
+    align *= h->y_step;
+
+    int num_slices = pool->num_workers + 1;
+    int slice_height = (height + num_slices - 1) / num_slices;
+    slice_height = (slice_height + align - 1) / align * align;
+
+    vlc_mutex_lock( &pool->lock );
+    pool->pending = 0;
+    pool->generation++;
+    for (int i=0; i<pool->num_workers; i++) {
+        histogram_worker_t *w = &pool->workers[i];
+        int y0 = __MIN( (i+1)*slice_height, height ),
+            y1 = __MIN( (i+2)*slice_height, height );
+
+        if (histogram_worker_prepare( w, h ) != HIST_SUCCESS)
+            break;
+        picture_CropView( &w->slice, p_in, 0, y0, width, y1 - y0 );
+        w->generation = pool->generation;
+        pool->pending++;
+    }
+    int num_jobs = pool->pending;
+    vlc_cond_broadcast( &pool->wait_job );
+    vlc_mutex_unlock( &pool->lock );
+
+    /*The first slice is ours, plus whatever a worker could not take*/
+    picture_t slice;
+    int y1 = __MIN( slice_height, height ),
+        y_rest = __MIN( (num_jobs+1)*slice_height, height );
+    picture_CropView( &slice, p_in, 0, 0, width, y1 );
+    int status = h->fill_func( h, &slice );
+    if (y_rest < height) {
+        picture_CropView( &slice, p_in, 0, y_rest, width, height - y_rest );
+        int rest_status = h->fill_func( h, &slice );
+        if (status == HIST_SUCCESS)
+            status = rest_status;
+    }
+
+    vlc_mutex_lock( &pool->lock );
+    while (pool->pending > 0)
+        vlc_cond_wait( &pool->wait_done, &pool->lock );
+    vlc_mutex_unlock( &pool->lock );
+
+    /*The first error wins, ours before the workers'*/
+    for (int i=0; i<num_jobs && status == HIST_SUCCESS; i++)
+        status = pool->workers[i].status;
+
+    /*Reduce the private bins*/
+    for (int i=0; i<num_jobs; i++)
+        for (int c=0; c<h->num_channels; c++) {
+            const uint32_t *bins = pool->workers[i].h.bins[c];
+            for (int b=0; b<h->num_raw_bins; b++)
+                h->bins[c][b] += bins[b];
+        }
+
+    return status;
+}
+
+static void *histogram_async_run( void *data )
+{
+    histogram_async_t *async = (histogram_async_t*)data;
+
+    vlc_mutex_lock( &async->lock );
+    for (;;) {
+        while (!async->quit && !async->busy)
+            vlc_cond_wait( &async->wait, &async->lock );
+        if (async->quit)
+            break;
+        histogram_job_t job = async->job;
+        vlc_mutex_unlock( &async->lock );
+
+        histogram_stats_t stats;
+        bool stats_ready = false;
+        histogram_t *h = async->h_back;
+        if (h && h->type != job.type)
+            histogram_free( &async->h_back );
+        /*Counts to normalize again come with a first histogram only*/
+        if (async->h_back == NULL && job.fill) {
+            /*histogram_init() sizes the overlay from the first plane only*/
+            picture_t geometry;
+            memset( &geometry, 0, sizeof(picture_t) );
+            geometry.p[0].i_visible_pitch = job.width;
+            geometry.p[0].i_visible_lines = job.height;
+            geometry.p[0].i_pixel_pitch   = 1;
+
+            int status = histogram_init( &async->h_back, &geometry, job.type );
+            if (status == HIST_SUCCESS)
+                status = histogram_set_codec( async->h_back, job.codec, job.cpu );
+            if (status == HIST_SUCCESS)
+                histogram_set_grid( async->h_back, job.grid_cols, job.grid_rows );
+            if (status == HIST_SUCCESS)
+                histogram_set_smooth( async->h_back, job.smooth, job.smooth_frames );
+            if (status == HIST_SUCCESS)
+                histogram_set_peak_hold( async->h_back, job.peak_frames );
+            if (status != HIST_SUCCESS)
+                histogram_free( &async->h_back );
+        }
+
+        h = async->h_back;
+        if (h) {
+            h->x_step = job.x_step;
+            h->y_step = job.y_step;
+            h->y_sampled = job.y_sampled;
+            h->roi    = job.roi;
+            PROFILE_START( t );
+            if (job.fill) {
+                histogram_zero( h );
+                histogram_fill( h, async->p_snap, async->pool );
+                histogram_smooth( h );
+                histogram_peak_hold( h );
+                PROFILE_LAP( async->profile, STAGE_FILL, t );
+                if (job.stats && histogram_stats( h, &stats ) == HIST_SUCCESS)
+                    stats_ready = true;
+            }
+            histogram_update_max( h );
+            PROFILE_LAP( async->profile, STAGE_UPDATE_MAX, t );
+            histogram_normalize( h, job.log, job.equalize );
+            PROFILE_LAP( async->profile, STAGE_NORMALIZE, t );
+            histogram_paint( h );
+            PROFILE_LAP( async->profile, STAGE_PAINT, t );
+        }
+
+        vlc_mutex_lock( &async->lock );
+        /*Publish, unless the front histogram changed type meanwhile*/
+        if (h && async->h_front && async->h_front->type == h->type)
+        {
+            picture_CopyPixels( async->h_front->p_overlay, h->p_overlay );
+            memcpy( async->h_front->spans, h->spans,
+                    h->p_overlay->p[0].i_visible_lines*sizeof(histogram_span_t) );
+        }
+        if (stats_ready) {
+            async->stats = stats;
+            async->stats_ready = true;
+        }
+        async->busy = false;
+    }
+    vlc_mutex_unlock( &async->lock );
+
+    return NULL;
+}
+
+histogram_async_t* histogram_async_new( histogram_pool_t *pool )
+{
+    histogram_async_t *async = (histogram_async_t*)calloc( 1, sizeof(histogram_async_t) );
+    if (async == NULL)
+        return NULL;
+
+    vlc_mutex_init( &async->lock );
+    vlc_cond_init( &async->wait );
+    async->pool = pool;
+
+    if (vlc_clone( &async->thread, histogram_async_run, async, VLC_THREAD_PRIORITY_LOW )) {
+        vlc_cond_destroy( &async->wait );
+        vlc_mutex_destroy( &async->lock );
+        free( async );
+        return NULL;
+    }
+
+    return async;
+}
+
+void histogram_async_delete( histogram_async_t *async )
+{
+    if (!async)
+        return;
+
+    vlc_mutex_lock( &async->lock );
+    async->quit = true;
+    vlc_cond_signal( &async->wait );
+    vlc_mutex_unlock( &async->lock );
+
+    vlc_join( async->thread, NULL );
+
+    if (async->p_snap)
+        picture_Release( async->p_snap );
+    histogram_free( &async->h_back );
+
+    vlc_cond_destroy( &async->wait );
+    vlc_mutex_destroy( &async->lock );
+    free( async );
+}
+
+/** Set the histogram whose overlay receives the results, h may be NULL. */
+void histogram_async_set_front( histogram_async_t *async, histogram_t *h )
+{
+    vlc_mutex_lock( &async->lock );
+    async->h_front = h;
+    vlc_mutex_unlock( &async->lock );
+}
+
+/**
+ * Copy to p_snap what the fill of h reads of p_pic: the region of interest,
+ * only the luma that has chroma for the chroma fills, only the planes the
+ * fill reads, and only the sampled rows when the sampling does not move
+ * between fills. job is changed to fill the snapshot as is: no region of
+ * interest, and the row step moved to y_sampled when the rows were sampled
+ * here.
+ *
+ * p_snap is reallocated when the size of the copy changes, it may be NULL.
+ * Returns the snapshot, NULL when it could not be allocated.
+ */
+static picture_t* histogram_snapshot( const histogram_t *h, const picture_t *p_pic, picture_t *p_snap,
+                                      histogram_job_t *job )
+{
+    picture_t cosited, roi;
+    if (histogram_chroma_view( h, p_pic, &cosited ))
+        p_pic = &cosited;
+    if (histogram_roi_view( &job->roi, p_pic, &roi ))
+        p_pic = &roi;
+
+    const plane_t *p0 = &p_pic->p[0];
+    const int width  = p0->i_visible_pitch / p0->i_pixel_pitch,
+              height = p0->i_visible_lines;
+    /*Rows of whole fill units, every y_step units. A sampling phase moves
+      the sampled rows from fill to fill, and every grid tile samples from
+      its own first row, all the rows are copied then*/
+    const bool sample = job->y_step > 1 && job->smooth == HISTO_SMOOTH_OFF &&
+                        job->grid_cols * job->grid_rows <= 1;
+    const int unit  = histogram_row_unit( h, p_pic ),
+              block = sample ? unit : height,
+              step  = sample ? unit * job->y_step : height;
+    const bool luma   = h->type != HISTO_VECTORSCOPE,
+               chroma = h->yuv2rgb != NULL || h->type == HISTO_VECTORSCOPE;
+
+    int rows = 0;
+    for (int y=0; y<height; y+=step)
+        rows += __MIN( block, height - y );
+
+    if (p_snap && (p_snap->format.i_chroma != p_pic->format.i_chroma ||
+                   p_snap->p[0].i_visible_pitch != p0->i_visible_pitch ||
+                   p_snap->p[0].i_visible_lines != rows)) {
+        picture_Release( p_snap );
+        p_snap = NULL;
+    }
+    if (p_snap == NULL) {
+        video_format_t fmt;
+        video_format_Init( &fmt, p_pic->format.i_chroma );
+        fmt.i_width  = fmt.i_visible_width  = width;
+        fmt.i_height = fmt.i_visible_height = rows;
+        p_snap = picture_NewFromFormat( &fmt );
+        video_format_Clean( &fmt );
+        if (p_snap == NULL)
+            return NULL;
+    }
+
+    for (int y=0, row=0; y<height; y+=step) {
+        const int lines = __MIN( block, height - y );
+        picture_t src, dst;
+        picture_CropView( &src, p_pic, 0, y, width, lines );
+        picture_CropView( &dst, p_snap, 0, row, width, lines );
+        for (int i=0; i<src.i_planes; i++) {
+            if (src.i_planes > 1 && !(i == 0 ? luma : chroma))
+                continue;
+            const int pitch = __MIN( src.p[i].i_visible_pitch, dst.p[i].i_visible_pitch ),
+                      count = __MIN( src.p[i].i_visible_lines, dst.p[i].i_visible_lines );
+            for (int l=0; l<count; l++)
+                memcpy( dst.p[i].p_pixels + l*dst.p[i].i_pitch,
+                        src.p[i].p_pixels + l*src.p[i].i_pitch, pitch );
+        }
+        row += lines;
+    }
+
+    memset( &job->roi, 0, sizeof(histogram_roi_t) );
+    if (sample) {
+        job->y_sampled = job->y_step;
+        job->y_step    = 1;
+    }
+
+    return p_snap;
+}
+
+/**
+ * Analyse p_pic in the background, if the thread is idle. h is a histogram
+ * of the job type and codec, it tells what the fill reads.
+ *
+ * What the fill reads is copied, p_pic is not held. A job that does not
+ * fill normalizes and paints the last counts again, p_pic is not read.
+ * Returns false if the job was dropped.
+ */
+bool histogram_async_post( histogram_async_t *async, const histogram_t *h, const picture_t *p_pic,
+                           const histogram_job_t *job )
+{
+    bool busy;
+
+    vlc_mutex_lock( &async->lock );
+    busy = async->busy;
+    vlc_mutex_unlock( &async->lock );
+    if (busy)
+        return false;
+
+    /*Idle, the thread does not touch the snapshot until the next job*/
+    histogram_job_t posted = *job;
+    if (posted.fill) {
+        async->p_snap = histogram_snapshot( h, p_pic, async->p_snap, &posted );
+        if (async->p_snap == NULL)
+            return false;
+    }
+
+    vlc_mutex_lock( &async->lock );
+    async->job  = posted;
+    async->busy = true;
+    vlc_cond_signal( &async->wait );
+    vlc_mutex_unlock( &async->lock );
+
+    return true;
+}
+
+/** Blend the last completed overlay to p_out. */
+int histogram_async_blend( histogram_async_t *async, picture_t *p_out )
+{
+    int status = HIST_ERROR;
+
+    vlc_mutex_lock( &async->lock );
+    if (async->h_front)
+        status = histogram_blend( async->h_front, p_out );
+    vlc_mutex_unlock( &async->lock );
+
+    return status;
+}
+
+/** Take the statistics of the last completed job, false if none is new. */
+bool histogram_async_stats( histogram_async_t *async, histogram_stats_t *stats )
+{
+    bool ready;
+
+    vlc_mutex_lock( &async->lock );
+    ready = async->stats_ready;
+    if (ready)
+        *stats = async->stats;
+    async->stats_ready = false;
+    vlc_mutex_unlock( &async->lock );
+
+    return ready;
+}
+
+#ifdef HISTOGRAM_PROFILE
+uint64_t histogram_profile_now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Bucket of ns: ns itself below 4, else 4 buckets per power of 2 */
+static inline int latency_bucket( uint64_t ns )
+{
+    if (ns < (1<<LATENCY_SUB_BITS))
+        return (int)ns;
+
+    int e = 63 - __builtin_clzll( ns );
+    int bucket = ((e - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) +
+                 (int)((ns >> (e - LATENCY_SUB_BITS)) & ((1<<LATENCY_SUB_BITS) - 1));
+
+    return __MIN( bucket, LATENCY_BUCKETS-1 );
+}
+
+/** The largest ns that falls in bucket */
+static inline uint64_t latency_bucket_max( int bucket )
+{
+    if (bucket < (1<<LATENCY_SUB_BITS))
+        return bucket;
+
+    bucket++;
+    int e = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    uint64_t sub = (1<<LATENCY_SUB_BITS) + (bucket & ((1<<LATENCY_SUB_BITS) - 1));
+
+    return (sub << (e - LATENCY_SUB_BITS)) - 1;
+}
+
+void histogram_profile_record( histogram_profile_t *profile, histo_stage_e stage, uint64_t ns )
+{
+    histogram_latency_t *l = &profile->stage[stage];
+
+    l->count[latency_bucket( ns )]++;
+    l->n++;
+    l->sum_ns += ns;
+    if (ns > l->max_ns)
+        l->max_ns = ns;
+}
+
+/** The smallest bucket bound that covers q*n samples, at most max_ns */
+static uint64_t latency_percentile( const histogram_latency_t *l, double q )
+{
+    uint64_t rank = (uint64_t)ceil( q * l->n ), seen = 0;
+
+    for (int b=0; b<LATENCY_BUCKETS; b++) {
+        seen += l->count[b];
+        if (seen >= rank)
+            return __MIN( latency_bucket_max( b ), l->max_ns );
+    }
+    return l->max_ns;
+}
+
+void histogram_profile_report( vlc_object_t *p_this, const histogram_profile_t *profile )
+{
+    static const char *const stage_names[NUM_STAGES] = {
+        "copy", "fill", "update_max", "normalize", "paint", "blend"
+    };
+
+    msg_Info( p_this, "%-10s %8s %10s %10s %10s %10s",
+              "stage", "count", "mean(us)", "p50(us)", "p99(us)", "max(us)" );
+    for (int s=0; s<NUM_STAGES; s++) {
+        const histogram_latency_t *l = &profile->stage[s];
+        if (l->n == 0)
+            continue;
+        msg_Info( p_this, "%-10s %8"PRIu64" %10.1f %10.1f %10.1f %10.1f",
+                  stage_names[s], l->n,
+                  l->sum_ns / 1000.0 / l->n,
+                  latency_percentile( l, 0.50 ) / 1000.0,
+                  latency_percentile( l, 0.99 ) / 1000.0,
+                  l->max_ns / 1000.0 );
+    }
+}
+#endif /*HISTOGRAM_PROFILE*/
+
+void histogram_zero( histogram_t *h )
+{
+    for (int i=0; i<h->num_channels; i++)
+        memset( h->bins[i], 0, h->num_raw_bins*sizeof(uint32_t) );
+    for (int i=0; i<h->num_channels && h->tiles[i]; i++)
+        memset( h->tiles[i], 0, h->grid_cols*h->grid_rows*h->num_raw_bins*sizeof(uint32_t) );
+}
+
+/** The count of the overlay bin b: the sum of its raw bins */
+static inline uint32_t histogram_fold( const histogram_t *h, int c, int b )
+{
+    const int fold = h->num_raw_bins / h->num_bins;
+    const uint32_t *raw = &h->bins[c][b*fold];
+    uint32_t sum = 0;
+
+    for (int i=0; i<fold; i++)
+        sum += raw[i];
+    return sum;
+}
+
+int histogram_update_max( histogram_t *h )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    /*Reset max[i]*/
+    for (int i=0; i<MAX_NUM_CHANNELS; i++)
+        h->max[i] = 0;
+
+    if (histogram_is_density( h )) {
+        histogram_density_update_max( h );
+        return HIST_SUCCESS;
+    }
+
+    /*Get maximum bin value for each color, at the overlay width*/
+    uint32_t value;
+    for (int i=0; i<h->num_channels; i++)
+        for (int b=0; b<h->num_bins; b++) {
+            value = h->num_raw_bins > h->num_bins ? histogram_fold( h, i, b ) : h->bins[i][b];
+            if (value > h->max[i]) h->max[i] = value;
+        }
+
+    /*The held line must fit too*/
+    if (h->peak)
+        for (int i=0; i<h->num_channels; i++)
+            for (int b=0; b<h->num_bins; b++)
+                if (h->peak->held[i][b] > h->max[i]) h->max[i] = h->peak->held[i][b];
+
+    return HIST_SUCCESS;
+}
+
+/** The lowest raw bin whose prefix sum reaches rank, prefix is non-decreasing */
+static inline int histogram_rank_bin( const uint64_t *prefix, int n, uint64_t rank )
+{
+    int lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (prefix[mid] >= rank)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+/**
+ * Compute the statistics of the raw counts, between histogram_fill() and
+ * histogram_normalize(), which overwrites them.
+ *
+ * One pass over the raw bins builds their prefix sums along with the first
+ * and second moments; the percentiles are then looked up in the prefix
+ * sums (nearest rank). Values are the centers of the raw bins, scaled to
+ * 0..255 whatever the bit depth. The raw bins hold every 8-bit or 10-bit
+ * value, so nothing depends on the overlay width.
+ *
+ * Under and over count the samples out of range, at the depth of the raw
+ * bins: below 16 and above 235 (64 and 940 at 10 bits) for luma, 0 and 255
+ * for R, G and B, where the YUV->RGB conversion clamps. Returns
+ * HIST_INPUT_ERROR for the waveform and the vectorscope.
+ */
+int histogram_stats( const histogram_t *h, histogram_stats_t *stats )
+{
+    if (!h || histogram_is_density( h ) ||
+        h->num_raw_bins < HISTOGRAM_8BIT_BINS || h->num_raw_bins > HISTOGRAM_RAW_BINS)
+        return HIST_INPUT_ERROR;
+
+    const int n = h->num_raw_bins;
+    const double scale  = (double)(MAX_PIXEL_VALUE + 1) / n,
+                 offset = scale / 2 - 0.5;
+    /*First and last raw bins in range, unit raw bins per 8-bit value*/
+    const int unit  = n / HISTOGRAM_8BIT_BINS,
+              black = h->type == HISTO_Y ? VIDEO_BLACK_LEVEL * unit : 1,
+              white = h->type == HISTO_Y ? VIDEO_WHITE_LEVEL * unit : n - 2;
+    uint64_t prefix[HISTOGRAM_RAW_BINS];
+
+    memset( stats, 0, sizeof(histogram_stats_t) );
+    stats->type = h->type;
+    for (int c=0; c<h->num_channels; c++) {
+        histogram_channel_stats_t *s = &stats->channel[c];
+        const uint32_t *bins = h->bins[c];
+        uint64_t total = 0, sum = 0, sum2 = 0;
+
+        for (int b=0; b<n; b++) {
+            total += bins[b];
+            sum   += (uint64_t)bins[b] * b;
+            sum2  += (uint64_t)bins[b] * b * b;
+            prefix[b] = total;
+        }
+        if (total == 0)
+            continue;
+
+        const double mean     = (double)sum / total,
+                     variance = (double)sum2 / total - mean * mean;
+        s->mean   = mean * scale + offset;
+        s->stddev = variance > 0 ? sqrt( variance ) * scale : 0;
+        s->p1     = histogram_rank_bin( prefix, n, (total + 99) / 100 ) * scale + offset;
+        s->p50    = histogram_rank_bin( prefix, n, (total + 1) / 2 ) * scale + offset;
+        s->p99    = histogram_rank_bin( prefix, n, (total * 99 + 99) / 100 ) * scale + offset;
+        s->under  = prefix[black-1];
+        s->over   = total - prefix[white];
+    }
+
+    return HIST_SUCCESS;
+}
+
+int histogram_free( histogram_t **h )
+{
+    if (!h || !*h)
+        return HIST_SUCCESS;
+
+    for (int i=0; i<MAX_NUM_CHANNELS; i++) {
+        free( (*h)->bins[i] );
+        free( (*h)->heights[i] );
+        free( (*h)->tiles[i] );
+        free( (*h)->tile_heights[i] );
+        free( (*h)->painted[i] );
+    }
+    free( (*h)->dirty );
+    free( (*h)->spans );
+    free( (*h)->yuv2rgb );
+    histogram_smooth_free( (*h)->smooth );
+    histogram_peak_free( (*h)->peak );
+    picture_Release( (*h)->p_overlay );
+
+    free( *h );
+    *h = NULL;
+
+    return HIST_SUCCESS;
+}
+
+static inline uint32_t max(uint32_t a, uint32_t b, uint32_t c)
+{
+    uint32_t tmp = a > b ? a : b;
+    return c > tmp ? c : tmp;
+}
+
+/*****************************************************************************
+ * Fixed point normalization
+ *****************************************************************************
+ * A count c is drawn at top * c / max, or top * log(c+1) / log(max+1) on
+ * the log scale, truncated like the float code it replaces. Both are done
+ * in integers: log2(c+1) comes from a table of the mantissa in 16.16 fixed
+ * point, and the division by max (or its log) is a multiply by a 32.32
+ * reciprocal, rounded up so that max itself is drawn at top exactly.
+ *
+ * The table has 8 mantissa bits, linearly interpolated with the next 16:
+ * log2 is off by less than 2^-15, which keeps every height within
+ * one pixel of log10f() for top below 2^12. Counts never exceed max, the
+ * heights never exceed top.
+ *
+ * The rows of counts are scaled by the kernels of histogram_t::scale_rows.
+ * The SSE2 and AVX2 ones split the 32x64 multiply in two 32x32->64 ones,
+ * the AVX2 log kernel finds the leading one by bisection with per lane
+ * shifts and gathers log2_lut[]. All kernels give identical results.
+ *****************************************************************************/
+
+#define LOG2_FRAC_BITS 16 /**< Fraction bits of histogram_log2()                 */
+#define LOG2_LUT_BITS  8  /**< Mantissa bits indexing log2_lut[]                */
+
+/** log2(1 + i/256) in 16.16 fixed point */
+static const uint32_t log2_lut[(1<<LOG2_LUT_BITS) + 1] = {
+        0,   369,   736,  1102,  1466,  1829,  2190,  2551,
+     2909,  3267,  3623,  3978,  4331,  4683,  5034,  5384,
+     5732,  6079,  6425,  6769,  7112,  7454,  7795,  8134,
+     8473,  8810,  9146,  9480,  9814, 10146, 10477, 10807,
+    11136, 11464, 11791, 12116, 12440, 12764, 13086, 13407,
+    13727, 14046, 14363, 14680, 14996, 15310, 15624, 15937,
+    16248, 16559, 16868, 17177, 17484, 17791, 18096, 18401,
+    18704, 19007, 19308, 19609, 19909, 20207, 20505, 20802,
+    21098, 21393, 21687, 21980, 22272, 22564, 22854, 23144,
+    23433, 23720, 24007, 24293, 24579, 24863, 25146, 25429,
+    25711, 25992, 26272, 26551, 26830, 27108, 27384, 27660,
+    27936, 28210, 28484, 28757, 29029, 29300, 29571, 29840,
+    30109, 30378, 30645, 30912, 31178, 31443, 31707, 31971,
+    32234, 32496, 32758, 33019, 33279, 33538, 33797, 34055,
+    34312, 34569, 34825, 35080, 35334, 35588, 35841, 36094,
+    36346, 36597, 36847, 37097, 37346, 37595, 37842, 38090,
+    38336, 38582, 38827, 39072, 39316, 39559, 39802, 40044,
+    40286, 40527, 40767, 41006, 41246, 41484, 41722, 41959,
+    42196, 42432, 42667, 42902, 43137, 43370, 43603, 43836,
+    44068, 44300, 44530, 44761, 44990, 45220, 45448, 45676,
+    45904, 46131, 46357, 46583, 46809, 47034, 47258, 47482,
+    47705, 47928, 48150, 48372, 48593, 48813, 49034, 49253,
+    49472, 49691, 49909, 50127, 50344, 50560, 50776, 50992,
+    51207, 51422, 51636, 51850, 52063, 52276, 52488, 52700,
+    52911, 53122, 53332, 53542, 53751, 53960, 54169, 54377,
+    54584, 54791, 54998, 55204, 55410, 55615, 55820, 56025,
+    56229, 56432, 56635, 56838, 57040, 57242, 57443, 57644,
+    57845, 58045, 58245, 58444, 58643, 58841, 59039, 59237,
+    59434, 59631, 59827, 60023, 60219, 60414, 60609, 60803,
+    60997, 61190, 61384, 61576, 61769, 61961, 62152, 62343,
+    62534, 62725, 62915, 63104, 63294, 63483, 63671, 63859,
+    64047, 64234, 64421, 64608, 64794, 64980, 65166, 65351,
+    65536
+};
+
+/** log2(count+1) in 16.16 fixed point: exponent from the leading zeros, mantissa from log2_lut[] */
+static inline uint32_t histogram_log2( uint32_t count )
+{
+    const uint64_t v = (uint64_t)count + 1;
+    const int n = 63 - __builtin_clzll( v );
+    /*The mantissa bits below the leading one, at the top of 64 bits*/
+    const uint64_t frac = v << (63 - n) << 1;
+    const uint32_t i = frac >> (64 - LOG2_LUT_BITS),
+                   r = frac >> (64 - LOG2_LUT_BITS - 16) & 0xFFFF;
+
+    return ((uint32_t)n << LOG2_FRAC_BITS) + log2_lut[i] +
+           ((log2_lut[i+1] - log2_lut[i]) * r >> 16);
+}
+
+/** Scale of the counts of one channel to 0..top, see histogram_scale_init() */
+typedef struct {
+    uint64_t recip;              /**< top / max, or top / log2(max+1), in 32.32     */
+    bool     log;
+    const histogram_scale_rows_t* rows; /**< Row kernels of histogram_scale()   */
+} histogram_scale_t;
+
+static inline histogram_scale_t histogram_scale_init( const histogram_t *h, uint32_t max,
+                                                      uint32_t top, bool log )
+{
+    const uint64_t denom = log ? histogram_log2( max ) : max;
+    histogram_scale_t s = {
+        .recip = denom ? (((uint64_t)top << 32) + denom - 1) / denom : 0,
+        .log   = log,
+        .rows  = h->scale_rows,
+    };
+    return s;
+}
+
+/** Scale n counts to heights, dst may be src. */
+static void histogram_scale( const histogram_scale_t *s, const uint32_t *src, uint32_t *dst, int n )
+{
+    if (s->log)
+        s->rows->log( s->recip, src, dst, n );
+    else
+        s->rows->linear( s->recip, src, dst, n );
+}
+
+static void scale_row_linear_c( uint64_t recip, const uint32_t *src, uint32_t *dst, int n )
+{
+    for (int i=0; i<n; i++)
+        dst[i] = (uint64_t)src[i] * recip >> 32;
+}
+
+static void scale_row_log_c( uint64_t recip, const uint32_t *src, uint32_t *dst, int n )
+{
+    for (int i=0; i<n; i++)
+        dst[i] = (uint64_t)histogram_log2( src[i] ) * recip >> 32;
+}
+
+static const histogram_scale_rows_t scale_rows_c = {
+    .linear = scale_row_linear_c,
+    .log    = scale_row_log_c,
+};
+
+#ifdef HAVE_SSE2_INTRINSICS
+/**
+ * count * recip >> 32 on 4 lanes, recip split in its 32-bit halves lo and hi:
+ * (count*lo >> 32) + count*hi, the heights fit 32 bits.
+ */
+static inline __m128i scale_epu32_sse2( __m128i count, __m128i lo, __m128i hi )
+{
+    const __m128i odd_count = _mm_srli_epi64( count, 32 ),
+                  even = _mm_add_epi32( _mm_srli_epi64( _mm_mul_epu32( count, lo ), 32 ),
+                                        _mm_mul_epu32( count, hi ) ),
+                  odd  = _mm_add_epi32( _mm_srli_epi64( _mm_mul_epu32( odd_count, lo ), 32 ),
+                                        _mm_mul_epu32( odd_count, hi ) ),
+                  low  = _mm_set_epi32( 0, -1, 0, -1 );
+    return _mm_or_si128( _mm_and_si128( even, low ), _mm_slli_epi64( odd, 32 ) );
+}
+
+static void scale_row_linear_sse2( uint64_t recip, const uint32_t *src, uint32_t *dst, int n )
+{
+    const __m128i lo = _mm_set1_epi32( (uint32_t)recip ),
+                  hi = _mm_set1_epi32( (uint32_t)(recip >> 32) );
+    int i = 0;
+    for (; i+4 <= n; i += 4)
+        _mm_storeu_si128( (__m128i*)(dst+i),
+                          scale_epu32_sse2( _mm_loadu_si128( (const __m128i*)(src+i) ), lo, hi ) );
+    scale_row_linear_c( recip, src+i, dst+i, n-i );
+}
+
+/*Without per lane shifts nor gathers, the log stays scalar before AVX2*/
+static const histogram_scale_rows_t scale_rows_sse2 = {
+    .linear = scale_row_linear_sse2,
+    .log    = scale_row_log_c,
+};
+#endif /*HAVE_SSE2_INTRINSICS*/
+
+#ifdef HAVE_AVX2_INTRINSICS
+/** scale_epu32_sse2() on 8 lanes */
+__attribute__((target("avx2")))
+static inline __m256i scale_epu32_avx2( __m256i count, __m256i lo, __m256i hi )
+{
+    const __m256i odd_count = _mm256_srli_epi64( count, 32 ),
+                  even = _mm256_add_epi32( _mm256_srli_epi64( _mm256_mul_epu32( count, lo ), 32 ),
+                                           _mm256_mul_epu32( count, hi ) ),
+                  odd  = _mm256_add_epi32( _mm256_srli_epi64( _mm256_mul_epu32( odd_count, lo ), 32 ),
+                                           _mm256_mul_epu32( odd_count, hi ) );
+    return _mm256_blend_epi32( even, _mm256_slli_epi64( odd, 32 ), 0xAA );
+}
+
+/** histogram_log2() on 8 lanes, count+1 wraps to 0 for 2^32 */
+__attribute__((target("avx2")))
+static inline __m256i log2_epu32_avx2( __m256i count )
+{
+    const __m256i zero = _mm256_setzero_si256(),
+                  v    = _mm256_add_epi32( count, _mm256_set1_epi32( 1 ) );
+
+    /*Leading one n: v >> t is not 0 for t <= n*/
+    __m256i n = zero;
+    for (int b = 16; b > 0; b >>= 1) {
+        const __m256i t = _mm256_add_epi32( n, _mm256_set1_epi32( b ) );
+        n = _mm256_blendv_epi8( t, n, _mm256_cmpeq_epi32( _mm256_srlv_epi32( v, t ), zero ) );
+    }
+
+    /*The mantissa bits below the leading one, at the top of 32 bits*/
+    const __m256i frac = _mm256_sllv_epi32( v, _mm256_sub_epi32( _mm256_set1_epi32( 32 ), n ) ),
+                  i    = _mm256_srli_epi32( frac, 32 - LOG2_LUT_BITS ),
+                  r    = _mm256_and_si256( _mm256_srli_epi32( frac, 32 - LOG2_LUT_BITS - 16 ),
+                                           _mm256_set1_epi32( 0xFFFF ) ),
+                  l0   = _mm256_i32gather_epi32( (const int*)log2_lut, i, 4 ),
+                  l1   = _mm256_i32gather_epi32( (const int*)log2_lut + 1, i, 4 ),
+                  lerp = _mm256_srli_epi32( _mm256_mullo_epi32( _mm256_sub_epi32( l1, l0 ), r ), 16 ),
+                  wrap = _mm256_and_si256( _mm256_cmpeq_epi32( v, zero ),
+                                           _mm256_set1_epi32( 32 << LOG2_FRAC_BITS ) );
+
+    return _mm256_add_epi32( _mm256_add_epi32( _mm256_slli_epi32( n, LOG2_FRAC_BITS ), wrap ),
+                             _mm256_add_epi32( l0, lerp ) );
+}
+
+__attribute__((target("avx2")))
+static void scale_row_linear_avx2( uint64_t recip, const uint32_t *src, uint32_t *dst, int n )
+{
+    const __m256i lo = _mm256_set1_epi32( (uint32_t)recip ),
+                  hi = _mm256_set1_epi32( (uint32_t)(recip >> 32) );
+    int i = 0;
+    for (; i+8 <= n; i += 8)
+        _mm256_storeu_si256( (__m256i*)(dst+i),
+                             scale_epu32_avx2( _mm256_loadu_si256( (const __m256i*)(src+i) ), lo, hi ) );
+    scale_row_linear_c( recip, src+i, dst+i, n-i );
+}
+
+__attribute__((target("avx2")))
+static void scale_row_log_avx2( uint64_t recip, const uint32_t *src, uint32_t *dst, int n )
+{
+    const __m256i lo = _mm256_set1_epi32( (uint32_t)recip ),
+                  hi = _mm256_set1_epi32( (uint32_t)(recip >> 32) );
+    int i = 0;
+    for (; i+8 <= n; i += 8) {
+        const __m256i log = log2_epu32_avx2( _mm256_loadu_si256( (const __m256i*)(src+i) ) );
+        _mm256_storeu_si256( (__m256i*)(dst+i), scale_epu32_avx2( log, lo, hi ) );
+    }
+    scale_row_log_c( recip, src+i, dst+i, n-i );
+}
+
+static const histogram_scale_rows_t scale_rows_avx2 = {
+    .linear = scale_row_linear_avx2,
+    .log    = scale_row_log_avx2,
+};
+#endif /*HAVE_AVX2_INTRINSICS*/
+
+/** Pick the fastest scale row kernels cpu (HISTOGRAM_CPU_*) can run. */
+const histogram_scale_rows_t* histogram_scale_rows( unsigned cpu )
+{
+#ifdef HAVE_AVX2_INTRINSICS
+    if (cpu & HISTOGRAM_CPU_AVX2)
+        return &scale_rows_avx2;
+#endif
+#ifdef HAVE_SSE2_INTRINSICS
+    if (cpu & HISTOGRAM_CPU_SSE2)
+        return &scale_rows_sse2;
+#endif
+    VLC_UNUSED(cpu);
+    return &scale_rows_c;
+}
+
+int histogram_normalize( histogram_t *h, bool log, bool equalize )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    const uint32_t height = h->height;
+
+    if (histogram_is_density( h ))
+        return histogram_density_normalize( h, log );
+
+    /*The heights are those of the raw bins reduced to the overlay width*/
+    const bool fold = h->num_raw_bins > h->num_bins;
+    if (fold)
+        for (int i = 0; i < h->num_channels; i++)
+            for (int b=0; b < h->num_bins; b++)
+                h->heights[i][b] = histogram_fold( h, i, b );
+
+    /*log is monotonic, equalizing the counts equalizes their logs*/
+    if (equalize && h->num_channels == 3)
+        h->max[0] = h->max[1] = h->max[2] = max( h->max[0], h->max[1], h->max[2] );
+
+    for (int i = 0; i < h->num_channels; i++) {
+        const histogram_scale_t scale = histogram_scale_init( h, h->max[i], height-1, log );
+        histogram_scale( &scale, fold ? h->heights[i] : h->bins[i], h->heights[i], h->num_bins );
+
+        /*Held counts to line heights, like the bars*/
+        if (h->peak)
+            histogram_scale( &scale, h->peak->held[i], h->peak->heights[i], h->num_bins );
+    }
+
+    /*Set max[i] to new normalized height*/
+    for (int i=0; i<h->num_channels; i++)
+        h->max[i] = height-1;
+
+    if (h->tiles[0])
+        histogram_grid_normalize( h, log, equalize );
+
+    return HIST_SUCCESS;
+}
+
+inline uint8_t* xy2p(int x, int y, plane_t *plane)
+{
+#ifdef HISTOGRAM_DEBUG
+   if (x>=plane->i_visible_pitch || y>=plane->i_visible_lines) {
+      printf("[%d,%d]->%d {%dx%d}\n",x,y,(plane->i_visible_lines-y-1)*plane->i_pitch+x,plane->i_visible_pitch,plane->i_visible_lines);
+      fflush(stdout);
+      return NULL;
+   }
+#endif
+      return plane->p_pixels + (plane->i_visible_lines-y-1)*plane->i_pitch + x;
+}
+
+/**
+ * Premultiply a color channel by alpha.
+ *
+ * The overlay is stored premultiplied, so that blending it only takes one
+ * multiply per sample, see blend().
+ */
+static inline uint8_t premultiply( uint8_t c, uint8_t a )
+{
+    return c * a >> 8;
+}
+
+/**
+ * Repaint column x of a histogram whose bars start at row y0.
+ *
+ * Column x holds bar x and the drop shadow of bar x-1 (1 pel right - 1 pel
+ * below it), so it can be painted from bins[x-1] and bins[x] alone. Column
+ * num_bins only holds the shadow of the last bar. Rows y0-1 up to the
+ * highest bar, y0+height-1, are cleared first. With peaks, the held value
+ * of the bar is drawn last, as one pixel above it.
+ */
+static void histogram_paintColumnYUVA( const histogram_t *histo, picture_t *p_yuv,
+                                       const uint32_t *bins, int x, int y0,
+                                       const uint8_t color[4], const uint8_t shadow[4],
+                                       const uint32_t *peaks, const uint8_t peak[4] )
+{
+    static const uint8_t clear[4] = { 0, 0, 0, 0 };
+
+#define PAINT(y,c) do { *xy2p( x, (y), &p_yuv->p[Y_PLANE] ) = (c)[0]; \
+                        *xy2p( x, (y), &p_yuv->p[U_PLANE] ) = (c)[1]; \
+                        *xy2p( x, (y), &p_yuv->p[V_PLANE] ) = (c)[2]; \
+                        *xy2p( x, (y), &p_yuv->p[A_PLANE] ) = (c)[3]; } while(0)
+    for (int y = y0-1; y < y0 + histo->height; y++)
+        PAINT( y, clear );
+
+    /*Paint bar*/
+    if (x < histo->num_bins)
+        for (uint32_t j = 0; j <= bins[x]; j++)
+            PAINT( y0 + j, color );
+
+    if (x > 0) {
+        /*Drop shadow of the previous bar, above this bar*/
+        const uint32_t js0 = (x == histo->num_bins) ? 0 : bins[x]+1;
+        for (uint32_t j = js0; j < bins[x-1]; j++)
+            PAINT( y0 + j, shadow );
+        /*Drop shadow under this bar*/
+        PAINT( y0-1, shadow );
+    }
+
+    /*Peak-hold line*/
+    if (peaks && x < histo->num_bins && peaks[x] > bins[x])
+        PAINT( y0 + peaks[x], peak );
+#undef PAINT
+}
+
+/** Repaint column x of an RGBA histogram, see histogram_paintColumnYUVA(). */
+static void histogram_paintColumnRGBA( const histogram_t *histo, plane_t *plane,
+                                       const uint32_t *bins, int x, int y0,
+                                       uint32_t color, uint32_t shadow,
+                                       const uint32_t *peaks, uint32_t peak )
+{
+    for (int y = y0-1; y < y0 + histo->height; y++)
+        *xy_rgba2p( x, y, plane ) = 0;
+
+    /*Paint bar*/
+    if (x < histo->num_bins)
+        for (uint32_t j = 0; j <= bins[x]; j++)
+            *xy_rgba2p( x, y0 + j, plane ) = color;
+
+    if (x > 0) {
+        /*Drop shadow of the previous bar, above this bar*/
+        const uint32_t js0 = (x == histo->num_bins) ? 0 : bins[x]+1;
+        for (uint32_t j = js0; j < bins[x-1]; j++)
+            *xy_rgba2p( x, y0 + j, plane ) = shadow;
+        /*Drop shadow under this bar*/
+        *xy_rgba2p( x, y0-1, plane ) = shadow;
+    }
+
+    /*Peak-hold line*/
+    if (peaks && x < histo->num_bins && peaks[x] > bins[x])
+        *xy_rgba2p( x, y0 + peaks[x], plane ) = peak;
+}
+
+/**
+ * Paint an RGB histogram directly to a YUV picture.
+ *
+ * p_yuv is expected to be a YUVA planar picture, with enough space for:
+ * width = histo->num_bins + 1(shadow)
+ * height = 3*histo->height + 2*BOTTOM_MARGIN + 1(shadow)
+ * The picture dimentions should be even
+ */
+int histogram_rgb_paintToYUVA( histogram_t *histo, picture_t *p_yuv )
+{
+    const int yr0 = 1,
+              yg0 = yr0 + histo->height + BOTTOM_MARGIN,
+              yb0 = yg0 + histo->height + BOTTOM_MARGIN;
+    const int y0[3] = { yr0, yg0, yb0 };
+    uint8_t color[3][4], peak[3][4], grey[4];
+
+    rgb_to_yuv( &color[R][0], &color[R][1], &color[R][2], MAX_PIXEL_VALUE, 0, 0 );
+    rgb_to_yuv( &color[G][0], &color[G][1], &color[G][2], 0, MAX_PIXEL_VALUE, 0 );
+    rgb_to_yuv( &color[B][0], &color[B][1], &color[B][2], 0, 0, MAX_PIXEL_VALUE );
+    rgb_to_yuv( &grey[0], &grey[1], &grey[2],
+                SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
+    memcpy( peak, color, sizeof(peak) );
+    color[R][3] = color[G][3] = color[B][3] = grey[3] = HISTOGRAM_ALPHA;
+    peak[R][3] = peak[G][3] = peak[B][3] = PEAK_ALPHA;
+    for (int i = 0; i < 3; i++) {
+        color[R][i] = premultiply( color[R][i], HISTOGRAM_ALPHA );
+        color[G][i] = premultiply( color[G][i], HISTOGRAM_ALPHA );
+        color[B][i] = premultiply( color[B][i], HISTOGRAM_ALPHA );
+        grey[i]     = premultiply( grey[i], HISTOGRAM_ALPHA );
+        peak[R][i]  = premultiply( peak[R][i], PEAK_ALPHA );
+        peak[G][i]  = premultiply( peak[G][i], PEAK_ALPHA );
+        peak[B][i]  = premultiply( peak[B][i], PEAK_ALPHA );
+    }
+
+    /*For each changed column of the R/G/B histograms, repaint bar and shadow*/
+    for (int c = R; c <= B; c++)
+        for (int x = 0; x <= histo->num_bins; x++)
+            if (histo->dirty[x] & 1<<c)
+                histogram_paintColumnYUVA( histo, p_yuv, histo->heights[c], x, y0[c],
+                                           color[c], grey,
+                                           histo->peak ? histo->peak->heights[c] : NULL, peak[c] );
+
+    return HIST_SUCCESS;
+}
+
+/**
+ * Paint a Y histogram to a YUV picture.
+ * 
+ * p_yuv is expected to be a YUVA planar picture, with enough space for:
+ * width = histo->num_bins + 1(shadow)
+ * height = histo->height + 1(shadow)
+ * The picture dimentions should be even
+ */
+int histogram_yuv_paintToYUVA( histogram_t *histo, picture_t *p_yuv )
+{
+    const int y0 = 1;
+    uint8_t bright[4], grey[4], peak[4];
+
+    rgb_to_yuv( &grey[0], &grey[1], &grey[2],
+                SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
+    rgb_to_yuv( &bright[0], &bright[1], &bright[2],
+                MAX_PIXEL_VALUE, MAX_PIXEL_VALUE, MAX_PIXEL_VALUE );
+    memcpy( peak, bright, sizeof(peak) );
+    bright[3] = grey[3] = HISTOGRAM_ALPHA;
+    peak[3] = PEAK_ALPHA;
+    for (int i = 0; i < 3; i++) {
+        bright[i] = premultiply( bright[i], HISTOGRAM_ALPHA );
+        grey[i]   = premultiply( grey[i], HISTOGRAM_ALPHA );
+        peak[i]   = premultiply( peak[i], PEAK_ALPHA );
+    }
+
+    /*For each changed column, repaint bar and shadow*/
+    for (int x = 0; x <= histo->num_bins; x++)
+        if (histo->dirty[x] & 1<<Y)
+            histogram_paintColumnYUVA( histo, p_yuv, histo->heights[Y], x, y0,
+                                       bright, grey,
+                                       histo->peak ? histo->peak->heights[Y] : NULL, peak );
+
+    return HIST_SUCCESS;
+}
+
+/** Return a pointer to the RGBA pixel channel */
+inline uint8_t* xyca2pc(int x, int y, int c, plane_t *plane)
+{
+#ifdef HISTOGRAM_DEBUG
+   if (x>=plane->i_visible_pitch || y>=plane->i_visible_lines || c > 3) {
+      printf("[%d,%d,%d] {%dx%d}\n",x,y,c,plane->i_visible_pitch,plane->i_visible_lines);
+      fflush(stdout);
+      return NULL;
+   }
+#endif
+      return plane->p_pixels + (plane->i_visible_lines-y-1)*plane->i_pitch + 4*x + c;
+}
+
+/**
+ * Paint a Y histogram to an 32-bit RGBA picture.
+ *
+ * p_bgra is expected to be an RGBA picture, with enough space for:
+ * width = histo->num_bins + 1(shadow)
+ * height = histo->height + 1(shadow)
+ * The picture dimentions should be even
+ */
+int histogram_yuv_paintToRGBA( histogram_t *histo, picture_t *p_bgra )
+{
+    const int y0 = 1;
+    const uint32_t max    = premultiply( MAX_PIXEL_VALUE, HISTOGRAM_ALPHA ),
+                   shadow = premultiply( SHADOW_PIXEL_VALUE, HISTOGRAM_ALPHA ),
+                   alpha  = HISTOGRAM_ALPHA,
+                   pmax   = premultiply( MAX_PIXEL_VALUE, PEAK_ALPHA ),
+                   palpha = PEAK_ALPHA;
+#ifdef HISTOGRAM_LITTLE_ENDIAN
+    const uint32_t bright = max<<0  |
+                            max<<8  |
+                            max<<16 |
+                            alpha<<24,
+                   grey   = shadow<<0  |
+                            shadow<<8  |
+                            shadow<<16 |
+                            alpha <<24,
+                   peak   = pmax<<0  |
+                            pmax<<8  |
+                            pmax<<16 |
+                            palpha<<24;
+#else /*BIG_ENDIAN*/
+    const uint32_t bright = max<<24 |
+                            max<<16 |
+                            max<<8  |
+                            alpha,
+                   grey   = shadow<<24 |
+                            shadow<<16 |
+                            shadow<<8  |
+                            alpha,
+                   peak   = pmax<<24 |
+                            pmax<<16 |
+                            pmax<<8  |
+                            palpha;
+#endif /*HISTOGRAM_LITTLE_ENDIAN*/
+
+    /*For each changed column, repaint bar and shadow*/
+    for (int x = 0; x <= histo->num_bins; x++)
+        if (histo->dirty[x] & 1<<Y)
+            histogram_paintColumnRGBA( histo, &p_bgra->p[RGB_PLANE], histo->heights[Y], x, y0,
+                                       bright, grey,
+                                       histo->peak ? histo->peak->heights[Y] : NULL, peak );
+
+    return HIST_SUCCESS;
+}
+
+/**
+ * Update the spans of the overlay rows after columns [d0,d1) were painted.
+ *
+ * The blend functions skip everything outside the spans: transparent
+ * pixels blend to the background, so the result does not change.
+ * Only those columns are scanned: the pixels outside them did not change,
+ * so the previous span tells where they end, unless its end was inside the
+ * painted columns. Then the scan goes on past them, up to the previous end.
+ * With d0=0 and d1=width, every row is scanned.
+ */
+static void histogram_update_spans( histogram_t *h, int d0, int d1 )
+{
+    const picture_t *p_overlay = h->p_overlay;
+    const bool rgba = p_overlay->format.i_chroma == VLC_CODEC_RGBA;
+    const plane_t *plane = &p_overlay->p[rgba ? RGB_PLANE : A_PLANE];
+    const int step  = rgba ? 4 : 1,
+              width = plane->i_visible_pitch / step;
+
+    d0 = __MAX( 0, d0 );
+    d1 = __MIN( width, d1 );
+    for (int r = 0; r < plane->i_visible_lines; r++) {
+        const uint8_t *a = plane->p_pixels + r*plane->i_pitch + (rgba ? 3 : 0);
+        histogram_span_t *span = &h->spans[r];
+        /*Unchanged pixels: left of d0, and right of d1*/
+        int lx0 = span->x0, lx1 = __MIN( span->x1, d0 ),
+            rx0 = __MAX( span->x0, d1 ), rx1 = span->x1;
+
+        /*The painted columns, then the unchanged pixels next to them*/
+        int x0 = d0, x1 = d1;
+        while (x0 < x1 && a[x0*step] == 0)
+            x0++;
+        while (x1 > x0 && a[(x1-1)*step] == 0)
+            x1--;
+        while (lx1 > lx0 && a[(lx1-1)*step] == 0)
+            lx1--;
+        while (rx0 < rx1 && a[rx0*step] == 0)
+            rx0++;
+
+        /*Hull of the non empty parts*/
+        const bool left = lx0 < lx1, middle = x0 < x1, right = rx0 < rx1;
+        span->x0 = left  ? lx0 : middle ? x0 : right ? rx0 : 0;
+        span->x1 = right ? rx1 : middle ? x1 : left  ? lx1 : 0;
+    }
+}
+
+/**
+ * Paint the normalized histogram to its overlay.
+ *
+ * Only the columns whose bars changed since the last paint are repainted,
+ * nothing is painted when all heights are the same.
+ */
+int histogram_paint( histogram_t *h )
+{
+    bool changed = false;
+
+    /*Columns are only tracked for the whole picture bar histograms*/
+    if (h->tiles[0] || histogram_is_density( h ))
+        h->repaint = true;
+
+    for (int x = 0; x <= h->num_bins; x++) {
+        uint8_t mask = 0;
+        for (int c = 0; c < h->num_channels; c++) {
+            if (h->repaint ||
+                (x < h->num_bins && h->heights[c][x]   != h->painted[c][x]) ||
+                (x > 0           && h->heights[c][x-1] != h->painted[c][x-1]) ||
+                (h->peak && x < h->num_bins &&
+                 h->peak->heights[c][x] != h->peak->painted[c][x]))
+                mask |= 1<<c;
+        }
+        h->dirty[x] = mask;
+        changed |= mask != 0;
+    }
+    if (!changed)
+        return HIST_SUCCESS;
+
+    if (h->repaint)
+        picture_ZeroPixels( h->p_overlay );
+
+    /*The painted columns, all of them on a repaint*/
+    int d0 = h->repaint ? 0 : h->num_bins+1, d1 = h->repaint ? INT_MAX : 0;
+    for (int x = 0; !h->repaint && x <= h->num_bins; x++)
+        if (h->dirty[x]) {
+            d0 = __MIN( d0, x );
+            d1 = x + 1;
+        }
+
+    int status = h->paint_func( h, h->p_overlay );
+    histogram_update_spans( h, d0, d1 );
+
+    for (int c = 0; c < h->num_channels; c++)
+        memcpy( h->painted[c], h->heights[c], h->num_bins*sizeof(uint32_t) );
+    for (int c = 0; h->peak && c < h->num_channels; c++)
+        memcpy( h->peak->painted[c], h->peak->heights[c], h->num_bins*sizeof(uint32_t) );
+    h->repaint = false;
+
+    return status;
+}
+
+/*****************************************************************************
+ * Zone grid
+ *****************************************************************************
+ * With a grid, the picture (or its region of interest) is split into
+ * grid_cols x grid_rows tiles, and every tile has its own bins. The tiles
+ * are disjoint views of the picture filled by the usual kernels, so each
+ * pixel is still read once, and the whole picture bins are their sum.
+ * The overlay keeps its size and shows one small histogram per tile, laid
+ * out like the picture zones.
+ *****************************************************************************/
+
+/** The bins of channel c of tile (tx,ty), num_raw_bins of them */
+static inline uint32_t* histogram_tile( const histogram_t *h, int c, int tx, int ty )
+{
+    return h->tiles[c] + (ty*h->grid_cols + tx)*h->num_raw_bins;
+}
+
+/** The bar heights of tile (tx,ty) for channel c, cell_bins of them */
+static inline uint32_t* histogram_tile_heights( const histogram_t *h, int c, int tx, int ty )
+{
+    return h->tile_heights[c] + (ty*h->grid_cols + tx)*h->cell_bins;
+}
+
+/**
+ * Split the histogram into a cols x rows grid of tiles.
+ *
+ * Call after histogram_set_codec(), the tiles need the overlay size and the
+ * raw bins. Returns HIST_INPUT_ERROR if the cells of the overlay would be too
+ * small, the histogram is left without a grid then.
+ */
+int histogram_set_grid( histogram_t *h, int cols, int rows )
+{
+    if (cols*rows <= 1)
+        return HIST_SUCCESS;
+    if (histogram_is_density( h ))
+        return HIST_INPUT_ERROR;
+
+    const plane_t *p0 = &h->p_overlay->p[0];
+    const int cell_w = p0->i_visible_pitch / p0->i_pixel_pitch / cols,
+              band_h = (p0->i_visible_lines / rows - 1) / h->num_channels;
+    int cell_bins = 1;
+    while (2*cell_bins <= __MIN( cell_w - 1, h->num_bins ))
+        cell_bins *= 2;
+    if (cell_bins < 4 || band_h < 3)
+        return HIST_INPUT_ERROR;
+
+    for (int c=0; c<h->num_channels; c++) {
+        h->tiles[c] = (uint32_t*)calloc( cols*rows*h->num_raw_bins, sizeof(uint32_t) );
+        h->tile_heights[c] = (uint32_t*)calloc( cols*rows*cell_bins, sizeof(uint32_t) );
+        if (h->tiles[c] == NULL || h->tile_heights[c] == NULL) {
+            for (int i=0; i<=c; i++) {
+                free( h->tiles[i] );
+                free( h->tile_heights[i] );
+                h->tiles[i] = NULL;
+                h->tile_heights[i] = NULL;
+            }
+            return HIST_ERROR;
+        }
+    }
+    h->grid_cols   = cols;
+    h->grid_rows   = rows;
+    h->cell_bins   = cell_bins;
+    h->cell_height = band_h - 1;
+    h->paint_func  = h->p_overlay->format.i_chroma == VLC_CODEC_RGBA ?
+                     histogram_grid_paintToRGBA : histogram_grid_paintToYUVA;
+    h->repaint     = true;
+
+    return HIST_SUCCESS;
+}
+
+/**
+ * Fill every tile from its own rectangle of p_in, then add the tiles to the
+ * whole picture bins. The rectangles are aligned to 2 pixels, for the
+ * subsampled chroma, the last row and column take the remainder.
+ */
+int histogram_grid_fill( histogram_t *h, const picture_t *p_in, histogram_pool_t *pool )
+{
+    const plane_t *p0 = &p_in->p[0];
+    const int width  = p0->i_visible_pitch / p0->i_pixel_pitch,
+              height = p0->i_visible_lines;
+    int status = HIST_SUCCESS;
+
+    /*Too small to split, the tiles stay empty*/
+    if (width < 2*h->grid_cols || height < 2*h->grid_rows)
+        return pool ? histogram_pool_fill( pool, h, p_in ) : h->fill_func( h, p_in );
+
+    for (int ty=0; ty<h->grid_rows; ty++) {
+        int y0 = ty*height/h->grid_rows & ~1,
+            y1 = ty+1 == h->grid_rows ? height : (ty+1)*height/h->grid_rows & ~1;
+        for (int tx=0; tx<h->grid_cols; tx++) {
+            int x0 = tx*width/h->grid_cols & ~1,
+                x1 = tx+1 == h->grid_cols ? width : (tx+1)*width/h->grid_cols & ~1;
+
+            /*The tile histogram shares everything but the bins*/
+            histogram_t tile = *h;
+            for (int c=0; c<h->num_channels; c++) {
+                tile.bins[c]  = histogram_tile( h, c, tx, ty );
+                tile.tiles[c] = NULL;
+            }
+
+            picture_t view;
+            picture_CropView( &view, p_in, x0, y0, x1 - x0, y1 - y0 );
+            int tile_status = pool ? histogram_pool_fill( pool, &tile, &view )
+                                   : tile.fill_func( &tile, &view );
+            if (tile_status != HIST_SUCCESS)
+                status = tile_status;
+
+            for (int c=0; c<h->num_channels; c++)
+                for (int b=0; b<h->num_raw_bins; b++)
+                    h->bins[c][b] += tile.bins[c][b];
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Fold the bins of each tile to cell_bins and scale them to cell_height,
+ * into the tile heights. Each tile is scaled to its own maximum, see
+ * histogram_normalize().
+ */
+void histogram_grid_normalize( histogram_t *h, bool log, bool equalize )
+{
+    const int fold = h->num_raw_bins / h->cell_bins;
+
+    for (int ty=0; ty<h->grid_rows; ty++)
+        for (int tx=0; tx<h->grid_cols; tx++) {
+            uint32_t tile_max[MAX_NUM_CHANNELS] = { 0 };
+
+            for (int c=0; c<h->num_channels; c++) {
+                const uint32_t *bins = histogram_tile( h, c, tx, ty );
+                uint32_t *heights = histogram_tile_heights( h, c, tx, ty );
+                for (int b=0; b<h->cell_bins; b++) {
+                    uint32_t sum = 0;
+                    for (int i=0; i<fold; i++)
+                        sum += bins[b*fold+i];
+                    heights[b] = sum;
+                    if (sum > tile_max[c]) tile_max[c] = sum;
+                }
+            }
+            if (equalize && h->num_channels == 3)
+                tile_max[0] = tile_max[1] = tile_max[2] = max( tile_max[0], tile_max[1], tile_max[2] );
+
+            for (int c=0; c<h->num_channels; c++) {
+                const histogram_scale_t scale = histogram_scale_init( h, tile_max[c], h->cell_height, log );
+                uint32_t *heights = histogram_tile_heights( h, c, tx, ty );
+                histogram_scale( &scale, heights, heights, h->cell_bins );
+            }
+        }
+}
+
+/** A premultiplied overlay color, as YUVA samples and as a RGBA pixel */
+typedef struct {
+    uint8_t  yuva[4];
+    uint32_t rgba;
+} histogram_color_t;
+
+static histogram_color_t histogram_color( uint8_t r, uint8_t g, uint8_t b )
+{
+    histogram_color_t color;
+    const uint32_t alpha = HISTOGRAM_ALPHA;
+
+    rgb_to_yuv( &color.yuva[0], &color.yuva[1], &color.yuva[2], r, g, b );
+    for (int i = 0; i < 3; i++)
+        color.yuva[i] = premultiply( color.yuva[i], HISTOGRAM_ALPHA );
+    color.yuva[3] = HISTOGRAM_ALPHA;
+
+    r = premultiply( r, HISTOGRAM_ALPHA );
+    g = premultiply( g, HISTOGRAM_ALPHA );
+    b = premultiply( b, HISTOGRAM_ALPHA );
+#ifdef HISTOGRAM_LITTLE_ENDIAN
+    color.rgba = b<<0 | g<<8 | r<<16 | alpha<<24;
+#else /*BIG_ENDIAN*/
+    color.rgba = b<<24 | g<<16 | r<<8 | alpha;
+#endif /*HISTOGRAM_LITTLE_ENDIAN*/
+
+    return color;
+}
+
+static inline void histogram_overlay_put( picture_t *p_overlay, bool rgba, int x, int y,
+                                       const histogram_color_t *color )
+{
+    if (rgba) {
+        *xy_rgba2p( x, y, &p_overlay->p[RGB_PLANE] ) = color->rgba;
+    } else {
+        for (int i = 0; i < 4; i++)
+            *xy2p( x, y, &p_overlay->p[i] ) = color->yuva[i];
+    }
+}
+
+/**
+ * Paint one small histogram per tile, over a shadow background.
+ *
+ * The cells follow the picture zones, top left tile in the top left cell.
+ * RGB histograms have R, G and B bands in each cell, like the whole
+ * picture overlay. Bars are cell_bins wide, as many pixels as fit.
+ */
+static int histogram_grid_paint( histogram_t *h, picture_t *p_overlay, bool rgba )
+{
+    const plane_t *p0 = &p_overlay->p[0];
+    const int cell_w = p0->i_visible_pitch / p0->i_pixel_pitch / h->grid_cols,
+              cell_h = p0->i_visible_lines / h->grid_rows,
+              band_h = (cell_h - 1) / h->num_channels,
+              bar_w  = (cell_w - 1) / h->cell_bins;
+    histogram_color_t color[3], shadow;
+
+    shadow = histogram_color( SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
+    if (h->num_channels == 1) {
+        color[Y] = histogram_color( MAX_PIXEL_VALUE, MAX_PIXEL_VALUE, MAX_PIXEL_VALUE );
+    } else {
+        color[R] = histogram_color( MAX_PIXEL_VALUE, 0, 0 );
+        color[G] = histogram_color( 0, MAX_PIXEL_VALUE, 0 );
+        color[B] = histogram_color( 0, 0, MAX_PIXEL_VALUE );
+    }
+
+    for (int ty=0; ty<h->grid_rows; ty++)
+        for (int tx=0; tx<h->grid_cols; tx++) {
+            const int x0 = tx*cell_w,
+                      y0 = (h->grid_rows-1 - ty)*cell_h;
+
+            for (int y = y0; y < y0 + cell_h - 1; y++)
+                for (int x = x0; x < x0 + cell_w - 1; x++)
+                    histogram_overlay_put( p_overlay, rgba, x, y, &shadow );
+
+            for (int c = 0; c < h->num_channels; c++) {
+                const uint32_t *heights = histogram_tile_heights( h, c, tx, ty );
+                const int yc = y0 + c*band_h;
+                for (int b = 0; b < h->cell_bins; b++)
+                    for (uint32_t j = 0; j < heights[b]; j++)
+                        for (int x = x0 + b*bar_w; x < x0 + (b+1)*bar_w; x++)
+                            histogram_overlay_put( p_overlay, rgba, x, yc + j, &color[c] );
+            }
+        }
+
+    return HIST_SUCCESS;
+}
+
+int histogram_grid_paintToYUVA( histogram_t *h, picture_t *p_yuv )
+{
+    return histogram_grid_paint( h, p_yuv, false );
+}
+
+int histogram_grid_paintToRGBA( histogram_t *h, picture_t *p_bgra )
+{
+    return histogram_grid_paint( h, p_bgra, true );
+}
+
+/*****************************************************************************
+ * Waveform monitor
+ *****************************************************************************
+ * HISTO_WAVEFORM counts, for every overlay column, the luma of the picture
+ * columns that fall into it. bins[Y] holds num_bins columns of height
+ * value levels, column x starts at bins[Y][x*height], so num_raw_bins is
+ * num_bins*height. The picture is read row by row like the other fills,
+ * the zero, sampling and thread pool code works on it unchanged.
+ *
+ * histogram_normalize() maps the counts to intensities in heights[Y], 0 (no
+ * pixel) to 255, painted as a brightness ramp over the shadow color, see
+ * histogram_density_ramp().
+ *****************************************************************************/
+
+/** 16.16 fixed point step from a picture column to an overlay column */
+static inline uint32_t wave_column_step( const histogram_t *h, int width )
+{
+    return width > 0 ? ((uint32_t)h->num_bins << 16) / width : 0;
+}
+
+/** Waveform of the 8-bit Y samples of planar, semi-planar and YUYV pictures */
+static int histogram_wave_fillFromYUV( histogram_t *h, const picture_t *p_yuv )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    const plane_t *p = &p_yuv->p[Y_PLANE];
+    const int step   = p->i_pixel_pitch,
+              width  = p->i_visible_pitch / step,
+              levels = h->height;
+    const uint32_t col_step = wave_column_step( h, width );
+    uint32_t *bins = h->bins[Y];
+
+    for (int y = 0; y < p->i_visible_lines; y += h->y_step) {
+        const uint8_t *line = p->p_pixels + y*p->i_pitch;
+        for (int x = 0; x < width; x += h->x_step) {
+            uint32_t *column = bins + (x*col_step >> 16)*levels;
+            column[line[x*step]*levels >> 8]++;
+        }
+    }
+
+    return HIST_SUCCESS;
+}
+
+/** Waveform of RGB24/RGB32 pictures, luma as in histogram_yuv_fillFromRGB24_32() */
+static int histogram_wave_fillFromRGB( histogram_t *h, const picture_t *p_bgr )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    const plane_t *p = &p_bgr->p[RGB_PLANE];
+    const int bytes  = p->i_pixel_pitch,
+              width  = p->i_visible_pitch / bytes,
+              levels = h->height;
+    const uint32_t col_step = wave_column_step( h, width );
+    uint32_t *bins = h->bins[Y];
+
+    for (int y = 0; y < p->i_visible_lines; y += h->y_step) {
+        const uint8_t *line = p->p_pixels + y*p->i_pitch;
+        for (int x = 0; x < width; x += h->x_step) {
+            const uint8_t *pel = line + x*bytes;
+            uint8_t luma = ( ( (  66 * pel[2] + 129 * pel[1] +  25 * pel[0] + 128 ) >> 8 ) + 16 );
+            uint32_t *column = bins + (x*col_step >> 16)*levels;
+            column[luma*levels >> 8]++;
+        }
+    }
+
+    return HIST_SUCCESS;
+}
+
+/** Waveform of the Y-plane of 16-bit YUV pictures, at 10 bits per sample */
+static int histogram_wave_fillFromYUV16( histogram_t *h, const picture_t *p_yuv )
+{
+    if (!h)
+        return HIST_INPUT_ERROR;
+
+    const plane_t *p = &p_yuv->p[Y_PLANE];
+    const int width  = p->i_visible_pitch / 2,
+              shift  = h->sample_shift,
+              levels = h->height;
+    const uint32_t col_step = wave_column_step( h, width );
+    uint32_t *bins = h->bins[Y];
+
+    for (int y = 0; y < p->i_visible_lines; y += h->y_step) {
+        const uint16_t *line = (const uint16_t*)(p->p_pixels + y*p->i_pitch);
+        for (int x = 0; x < width; x += h->x_step) {
+            int value = line[x] >> shift;
+            uint32_t *column = bins + (x*col_step >> 16)*levels;
+            column[(value < 1023 ? value : 1023)*levels >> 10]++;
+        }
+    }
+
+    return HIST_SUCCESS;
+}
+
+/** The colors of the intensities of histogram_density_normalize() */
+static void histogram_density_ramp( histogram_color_t ramp[256] )
+{
+    const int glow = SHADOW_PIXEL_VALUE + WAVEFORM_MIN_GLOW;
+
+    ramp[0] = histogram_color( SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
+    for (int i = 1; i < 256; i++) {
+        uint8_t value = glow + (MAX_PIXEL_VALUE - glow) * i / 255;
+        ramp[i] = histogram_color( value, value, value );
+    }
+}
+
+/** Paint the waveform intensities, see histogram_density_normalize() */
+static int histogram_wave_paint( histogram_t *h, picture_t *p_overlay, bool rgba )
+{
+    const int y0 = 1;
+    histogram_color_t ramp[256];
+
+    histogram_density_ramp( ramp );
+
+    for (int x = 0; x < h->num_bins; x++) {
+        const uint32_t *column = h->heights[Y] + x*h->height;
+        for (int l = 0; l < h->height; l++)
+            histogram_overlay_put( p_overlay, rgba, x, y0 + l, &ramp[column[l]] );
+    }
+
+    return HIST_SUCCESS;
+}
+
+static int histogram_wave_paintToYUVA( histogram_t *h, picture_t *p_yuv )
+{
+    return histogram_wave_paint( h, p_yuv, false );
+}
+
+static int histogram_wave_paintToRGBA( histogram_t *h, picture_t *p_bgra )
+{
+    return histogram_wave_paint( h, p_bgra, true );
+}
+
+/**
+ * Set the waveform fill/paint/blend functions, see histogram_set_codec().
+ *
+ * Supports the codecs of the Luminance histogram, the overlay and the blend
+ * functions are the same, only the fill and paint functions differ.
+ */
+int histogram_wave_set_codec( histogram_t *h, vlc_fourcc_t i_codec )
+{
+    int status;
+
+    if (histogram_hbd_shift( i_codec ) >= 0) {
+        h->sample_shift = histogram_hbd_shift( i_codec );
+        h->fill_func  = histogram_wave_fillFromYUV16;
+        h->paint_func = histogram_wave_paintToYUVA;
+        h->blend_func = picture_YUVA_BlendToY16;
+        status = histogram_init_picture_yuva( h );
+    } else {
+        /*NOTE: Same codecs as the Luminance histogram, see histogram_check_codec()*/
+        switch (i_codec) {
+            case VLC_CODEC_YV9:
+            case VLC_CODEC_YV12:
+            case VLC_CODEC_I420:
+            case VLC_CODEC_J420:
+            case VLC_CODEC_I422:
+            case VLC_CODEC_J422:
+            case VLC_CODEC_NV12:
+            case VLC_CODEC_NV21:
+            case VLC_CODEC_GREY:
+                h->fill_func  = histogram_wave_fillFromYUV;
+                h->paint_func = histogram_wave_paintToYUVA;
+                h->blend_func = picture_YUVA_BlendToY800;
+                status = histogram_init_picture_yuva( h );
+                break;
+            case VLC_CODEC_YUYV:
+                h->fill_func  = histogram_wave_fillFromYUV;
+                h->paint_func = histogram_wave_paintToYUVA;
+                h->blend_func = picture_YUVA_BlendToYUYV;
+                status = histogram_init_picture_yuva( h );
+                break;
+            case VLC_CODEC_RGB24:
+                h->fill_func  = histogram_wave_fillFromRGB;
+                h->paint_func = histogram_wave_paintToRGBA;
+                h->blend_func = picture_RGBA_BlendToRGB24;
+                status = histogram_init_picture_rgba( h );
+                break;
+            case VLC_CODEC_RGB32:
+                h->fill_func  = histogram_wave_fillFromRGB;
+                h->paint_func = histogram_wave_paintToRGBA;
+                h->blend_func = picture_RGBA_BlendToRGB32;
+                status = histogram_init_picture_rgba( h );
+                break;
+            default:
+                status = HIST_CODEC_UNSUPPORTED;
+        }
+    }
+
+    if (status == HIST_SUCCESS)
+        status = histogram_init_raw_bins( h, h->num_bins * h->height );
+
+    return status;
+}
+
+/** The largest count of all the waveform columns, or vectorscope cells */
+void histogram_density_update_max( histogram_t *h )
+{
+    const uint32_t *bins = h->bins[Y];
+    uint32_t max = 0;
+
+    for (int i=0; i<h->num_raw_bins; i++)
+        if (bins[i] > max) max = bins[i];
+    h->max[Y] = max;
+}
+
+/**
+ * Map the counts to intensities: 0 stays 0, the other counts go to 1..255,
+ * linearly or by their log, so that a single pixel still shows.
+ */
+int histogram_density_normalize( histogram_t *h, bool log )
+{
+    const histogram_scale_t scale = histogram_scale_init( h, h->max[Y], MAX_PIXEL_VALUE-1, log );
+    const uint32_t *bins = h->bins[Y];
+    uint32_t *heights = h->heights[Y];
+
+    histogram_scale( &scale, bins, heights, h->num_raw_bins );
+    for (int i=0; i<h->num_raw_bins; i++)
+        heights[i] = bins[i] ? 1 + heights[i] : 0;
+    h->max[Y] = MAX_PIXEL_VALUE;
+
+    return HIST_SUCCESS;
+}
+
+/*****************************************************************************
+ * Vectorscope
+ *****************************************************************************
+ * HISTO_VECTORSCOPE counts the (Cb,Cr) pairs of the picture in a square of
+ * num_bins x num_bins cells, bins[Y][v*num_bins + u]. Only the chroma
+ * samples are read, as they are: there is no RGB conversion and 4:2:0
+ * pictures cost a quarter of their luma. The sample options step over
+ * chroma samples and lines.
+ *
+ * The overlay is a round scope: Cb grows to the right, Cr upwards, and the
+ * neutral grey is at the center.
+ *****************************************************************************/
+
+/** Count one (Cb,Cr) pair */
+static inline void histogram_scope_bin( uint32_t *bins, int size, uint8_t u, uint8_t v )
+{
+    bins[(v*size >> 8)*size + (u*size >> 8)]++;
+}
+
+/** Vectorscope of planar YUV4:2:0/4:2:2 pictures, from the U and V planes */
+static int histogram_scope_fillFromYUVPlanar( histogram_t *h, const picture_t *p_yuv, bool switch_uv )
+{
+    if (!h || !p_yuv)
+        return HIST_INPUT_ERROR;
+
+    const plane_t *pu = &p_yuv->p[switch_uv ? V_PLANE : U_PLANE],
+                  *pv = &p_yuv->p[switch_uv ? U_PLANE : V_PLANE];
+    const int size = h->num_bins;
+    uint32_t *bins = h->bins[Y];
+
+    for (int r = 0; r < pu->i_visible_lines; r += h->y_step) {
+        const uint8_t *u = pu->p_pixels + r*pu->i_pitch,
+                      *v = pv->p_pixels + r*pv->i_pitch;
+        for (int x = 0; x < pu->i_visible_pitch; x += h->x_step)
+            histogram_scope_bin( bins, size, u[x], v[x] );
+    }
+
+    return HIST_SUCCESS;
+}
+
+static int histogram_scope_fillFromI4xx( histogram_t *h, const picture_t *p_yuv )
+{
+    return histogram_scope_fillFromYUVPlanar( h, p_yuv, false );
+}
+
+static int histogram_scope_fillFromYV12( histogram_t *h, const picture_t *p_yuv )
+{
+    return histogram_scope_fillFromYUVPlanar( h, p_yuv, true );
+}
+
+/** Vectorscope of NV12/NV21 pictures, from the interleaved chroma plane */
+static int histogram_scope_fillFromSemiPlanar420( histogram_t *h, const picture_t *p_yuv, bool switch_uv )
+{
+    if (!h || !p_yuv)
+        return HIST_INPUT_ERROR;
+
+    const plane_t *puv = &p_yuv->p[U_PLANE];
+    const int u_offset = switch_uv ? 1 : 0,
+              width    = puv->i_visible_pitch / 2,
+              size     = h->num_bins;
+    uint32_t *bins = h->bins[Y];
+
+    for (int r = 0; r < puv->i_visible_lines; r += h->y_step) {
+        const uint8_t *uv = puv->p_pixels + r*puv->i_pitch;
+        for (int x = 0; x < width; x += h->x_step)
+            histogram_scope_bin( bins, size, uv[2*x + u_offset], uv[2*x + 1 - u_offset] );
+    }
+
+    return HIST_SUCCESS;
+}
+
+static int histogram_scope_fillFromNV12( histogram_t *h, const picture_t *p_yuv )
+{
+    return histogram_scope_fillFromSemiPlanar420( h, p_yuv, false );
+}
+
+static int histogram_scope_fillFromNV21( histogram_t *h, const picture_t *p_yuv )
+{
+    return histogram_scope_fillFromSemiPlanar420( h, p_yuv, true );
+}
+
+/** Vectorscope of YUYV pictures, one (U,V) pair per 2 pixels */
+static int histogram_scope_fillFromYUYV( histogram_t *h, const picture_t *p_yuv )
+{
+    if (!h || !p_yuv)
+        return HIST_INPUT_ERROR;
+
+    const plane_t *p = &p_yuv->p[Y_PLANE];
+    const int pairs = p->i_visible_pitch / 4,
+              size  = h->num_bins;
+    uint32_t *bins = h->bins[Y];
+
+    for (int r = 0; r < p->i_visible_lines; r += h->y_step) {
+        const uint8_t *yuyv = p->p_pixels + r*p->i_pitch;
+        for (int x = 0; x < pairs; x += h->x_step)
+            histogram_scope_bin( bins, size, yuyv[4*x + 1], yuyv[4*x + 3] );
+    }
+
+    return HIST_SUCCESS;
+}
+
+/**
+ * Vectorscope of 16-bit YUV4:2:0/4:2:2 pictures, planar or P010, with the
+ * 8 most significant bits of each chroma sample.
+ */
+static int histogram_scope_fillFromYUV16( histogram_t *h, const picture_t *p_yuv )
+{
+    if (!h || !p_yuv)
+        return HIST_INPUT_ERROR;
+
+    const bool semi_planar = p_yuv->i_planes == 2;
+    const plane_t *pu = &p_yuv->p[U_PLANE],
+                  *pv = &p_yuv->p[semi_planar ? U_PLANE : V_PLANE];
+    const int c_step  = semi_planar ? 2 : 1,   /**< P010 interleaves U and V  */
+              c_width = pu->i_visible_pitch / (2*c_step),
+              shift   = h->sample_shift + 2,
+              size    = h->num_bins;
+    uint32_t *bins = h->bins[Y];
+
+    for (int r = 0; r < pu->i_visible_lines; r += h->y_step) {
+        const uint16_t *u = (const uint16_t*)(pu->p_pixels + r*pu->i_pitch),
+                       *v = (const uint16_t*)(pv->p_pixels + r*pv->i_pitch) + (semi_planar ? 1 : 0);
+        for (int x = 0; x < c_width; x += h->x_step)
+            histogram_scope_bin( bins, size, sample16_to_8( u[c_step*x], shift ),
+                                 sample16_to_8( v[c_step*x], shift ) );
+    }
+
+    return HIST_SUCCESS;
+}
+
+/** Mark the cell of a color with a hollow square, see histogram_scope_paintToYUVA() */
+static void histogram_scope_target( histogram_t *h, picture_t *p_yuv, int y0,
+                                    uint8_t r, uint8_t g, uint8_t b )
+{
+    const int size = h->num_bins;
+    uint8_t luma, u, v;
+
+    rgb_to_yuv( &luma, &u, &v, r, g, b );
+    const histogram_color_t color = histogram_color( r, g, b );
+    const int cx = u*size >> 8,
+              cy = v*size >> 8;
+    for (int dy = -2; dy <= 2; dy++)
+        for (int dx = -2; dx <= 2; dx++) {
+            const int x = cx + dx, y = cy + dy;
+            if ((abs( dx ) == 2 || abs( dy ) == 2) &&
+                x >= 0 && x < size && y >= 0 && y < size)
+                histogram_overlay_put( p_yuv, false, x, y0 + y, &color );
+        }
+}
+
+/**
+ * Paint the vectorscope to a YUVA picture.
+ *
+ * Inside the circle, the background and the counted cells are painted as
+ * the waveform is, with the circle and the Cb/Cr axes as graticule. The
+ * 75% color bars targets are marked in their own color. Cells out of the
+ * circle are only painted when counted.
+ */
+static int histogram_scope_paintToYUVA( histogram_t *h, picture_t *p_yuv )
+{
+    const int size = h->num_bins,
+              y0 = 1;
+    const float center = (size - 1) / 2.0F,
+                radius = size / 2.0F;
+    histogram_color_t ramp[256], graticule;
+
+    histogram_density_ramp( ramp );
+    graticule = histogram_color( GRATICULE_PIXEL_VALUE, GRATICULE_PIXEL_VALUE, GRATICULE_PIXEL_VALUE );
+
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++) {
+            const float dx = x - center, dy = y - center,
+                        d = sqrtf( dx*dx + dy*dy );
+            const uint32_t value = h->heights[Y][y*size + x];
+            if (value == 0 && d > radius)
+                continue;
+            if (value == 0 && (d > radius - 1 || x == size/2 || y == size/2))
+                histogram_overlay_put( p_yuv, false, x, y0 + y, &graticule );
+            else
+                histogram_overlay_put( p_yuv, false, x, y0 + y, &ramp[value] );
+        }
+
+    /*R, Mg, B, Cy, G, Yl*/
+    const uint8_t bar = MAX_PIXEL_VALUE * 3 / 4;
+    histogram_scope_target( h, p_yuv, y0, bar, 0, 0 );
+    histogram_scope_target( h, p_yuv, y0, bar, 0, bar );
+    histogram_scope_target( h, p_yuv, y0, 0, 0, bar );
+    histogram_scope_target( h, p_yuv, y0, 0, bar, bar );
+    histogram_scope_target( h, p_yuv, y0, 0, bar, 0 );
+    histogram_scope_target( h, p_yuv, y0, bar, bar, 0 );
+
+    return HIST_SUCCESS;
+}
+
+/**
+ * Set the vectorscope fill/paint/blend functions, see histogram_set_codec().
+ *
+ * The overlay has colored targets, so it is blended with its chroma, as
+ * the RGB histogram is. There is no RGB input, that would need a conversion.
+ */
+int histogram_scope_set_codec( histogram_t *h, vlc_fourcc_t i_codec )
+{
+    int status = HIST_SUCCESS;
+
+    h->paint_func = histogram_scope_paintToYUVA;
+    if (histogram_hbd_shift( i_codec ) >= 0) {
+        h->sample_shift = histogram_hbd_shift( i_codec );
+        h->fill_func  = histogram_scope_fillFromYUV16;
+        h->blend_func = picture_YUVA_BlendToYUV16;
+    } else {
+        /*NOTE: If you add/remove codecs, remember to update histogram_check_codec()*/
+        switch (i_codec) {
+            case VLC_CODEC_I422:
+            case VLC_CODEC_J422:
+                h->fill_func  = histogram_scope_fillFromI4xx;
+                h->blend_func = picture_YUVA_BlendToI422;
+                break;
+            case VLC_CODEC_I420:
+            case VLC_CODEC_J420:
+                h->fill_func  = histogram_scope_fillFromI4xx;
+                h->blend_func = picture_YUVA_BlendToI420;
+                break;
+            case VLC_CODEC_YV12:
+                h->fill_func  = histogram_scope_fillFromYV12;
+                h->blend_func = picture_YUVA_BlendToYV12;
+                break;
+            case VLC_CODEC_NV12:
+                h->fill_func  = histogram_scope_fillFromNV12;
+                h->blend_func = picture_YUVA_BlendToNV12;
+                break;
+            case VLC_CODEC_NV21:
+                h->fill_func  = histogram_scope_fillFromNV21;
+                h->blend_func = picture_YUVA_BlendToNV21;
+                break;
+            case VLC_CODEC_YUYV:
+                h->fill_func  = histogram_scope_fillFromYUYV;
+                h->blend_func = picture_YUVA_BlendToYUYV;
+                break;
+            case VLC_CODEC_GREY:
+                return HIST_COLOR_UNSUPPORTED;
+            default:
+                return HIST_CODEC_UNSUPPORTED;
+        }
+    }
+
+    status = histogram_init_picture_yuva( h );
+    if (status == HIST_SUCCESS)
+        status = histogram_init_raw_bins( h, h->num_bins * h->num_bins );
+
+    return status;
+}
+
+/*****************************************************************************
+ * Blend row kernels
+ *****************************************************************************
+ * The overlay is premultiplied (see premultiply()), so a sample blends as
+ * pm + bg*(256-a)/256: one multiply, no signed difference. Compared to the
+ * straight alpha blend fg*(a/256) + bg*(256-a)/256, the two rounded terms
+ * make the result equal or 1 below, never more.
+ * The blend functions walk the overlay rows and hand them to the row
+ * kernels of histogram_t::blend_rows. The SIMD kernels handle 8-32 samples
+ * at a time, including the 2x1 and 2x2 chroma averaging, and leave the
+ * tail of a row to the C kernels. All kernels give identical results.
+ *****************************************************************************/
+
+/**
+ * Alpha blend a premultiplied forground to background.
+ *
+ * Returns: pm + bg*(256-a)/256
+ */
+static inline uint8_t blend( uint8_t pm, uint8_t bg, uint8_t a )
+{
+    return pm + (((256-a) * bg)>>8);
+}
+
+/** o[i] = blend( pm[i], o[i], a[i] ) */
+static void blend_row_bytes_c( uint8_t *o, const uint8_t *pm, const uint8_t *a, int n )
+{
+    for (int i = 0; i < n; i++)
+        o[i] = blend( pm[i], o[i], a[i] );
+}
+
+/** Blend 2 horizontal samples to each of the n samples of o, and average them. */
+static void blend_row_chroma2_c( uint8_t *o, const uint8_t *pm, const uint8_t *a, int n )
+{
+    for (int i = 0; i < n; i++)
+        o[i] = ( blend( pm[2*i],   o[i], a[2*i]   ) +
+                 blend( pm[2*i+1], o[i], a[2*i+1] ) )>>1;
+}
+
+/** Blend 2x2 samples to each of the n samples of o, and average them. */
+static void blend_row_chroma4_c( uint8_t *o, const uint8_t *pm, int pm_pitch,
+                                 const uint8_t *a, int a_pitch, int n )
+{
+    const uint8_t *pm2 = pm + pm_pitch,
+                  *a2  = a + a_pitch;
+
+    for (int i = 0; i < n; i++)
+        o[i] = ( blend( pm[2*i],    o[i], a[2*i]    ) +
+                 blend( pm[2*i+1],  o[i], a[2*i+1]  ) +
+                 blend( pm2[2*i],   o[i], a2[2*i]   ) +
+                 blend( pm2[2*i+1], o[i], a2[2*i+1] ) )>>2;
+}
+
+/** chroma4 for the n interleaved pairs of o: u to the 1st sample, v to the 2nd. */
+static void blend_row_chroma4_uv_c( uint8_t *o, const uint8_t *u, const uint8_t *v, int pm_pitch,
+                                    const uint8_t *a, int a_pitch, int n )
+{
+    const uint8_t *u2 = u + pm_pitch,
+                  *v2 = v + pm_pitch,
+                  *a2 = a + a_pitch;
+
+    for (int i = 0; i < n; i++, o += 2) {
+        const uint8_t ou = o[0], ov = o[1];
+        o[0] = ( blend( u[2*i],    ou, a[2*i]    ) +
+                 blend( u[2*i+1],  ou, a[2*i+1]  ) +
+                 blend( u2[2*i],   ou, a2[2*i]   ) +
+                 blend( u2[2*i+1], ou, a2[2*i+1] ) )>>2;
+        o[1] = ( blend( v[2*i],    ov, a[2*i]    ) +
+                 blend( v[2*i+1],  ov, a[2*i+1]  ) +
+                 blend( v2[2*i],   ov, a2[2*i]   ) +
+                 blend( v2[2*i+1], ov, a2[2*i+1] ) )>>2;
+    }
+}
+
+/** Blend n (even) pixels to a row of YUYV macro-pixels. */
+static void blend_row_yuyv_c( uint8_t *o, const uint8_t *y, const uint8_t *u,
+                              const uint8_t *v, const uint8_t *a, int n )
+{
+    for (int i = 0; i < n; i += 2, o += 4) {
+        const uint8_t ou = o[1], ov = o[3];
+        o[0] = blend( y[i],   o[0], a[i]   );
+        o[2] = blend( y[i+1], o[2], a[i+1] );
+        o[1] = ( blend( u[i], ou, a[i] ) + blend( u[i+1], ou, a[i+1] ) )>>1;
+        o[3] = ( blend( v[i], ov, a[i] ) + blend( v[i+1], ov, a[i+1] ) )>>1;
+    }
+}
+
+/** Blend n RGBA pixels to a row of 3 (RGB24) or 4 (RGB32) byte pixels. */
+static inline void blend_row_rgb_c( uint8_t *o, const uint8_t *bgra, int n, int bytes )
+{
+    for (int i = 0; i < n; i++, o += bytes, bgra += 4) {
+        o[0] = blend( bgra[0], o[0], bgra[3] );
+        o[1] = blend( bgra[1], o[1], bgra[3] );
+        o[2] = blend( bgra[2], o[2], bgra[3] );
+    }
+}
+
+static void blend_row_rgb24_c( uint8_t *o, const uint8_t *bgra, int n )
+{
+    blend_row_rgb_c( o, bgra, n, 3 );
+}
+
+static void blend_row_rgb32_c( uint8_t *o, const uint8_t *bgra, int n )
+{
+    blend_row_rgb_c( o, bgra, n, 4 );
+}
+
+static const histogram_blend_rows_t blend_rows_c = {
+    .bytes   = blend_row_bytes_c,
+    .chroma2 = blend_row_chroma2_c,
+    .chroma4 = blend_row_chroma4_c,
+    .chroma4_uv = blend_row_chroma4_uv_c,
+    .yuyv    = blend_row_yuyv_c,
+    .rgb24   = blend_row_rgb24_c,
+    .rgb32   = blend_row_rgb32_c,
+};
 
-static inline uint32_t maxf(float a, float b, float c)
+#ifdef HAVE_SSE2_INTRINSICS
+/** blend() on 16-bit lanes */
+static inline __m128i blend_epi16_sse2( __m128i pm, __m128i bg, __m128i a )
 {
-    float tmp = a > b ? a : b;
-    return c > tmp ? c : tmp;
+    const __m128i k256 = _mm_set1_epi16( 256 );
+    return _mm_add_epi16( pm, _mm_srli_epi16( _mm_mullo_epi16( _mm_sub_epi16( k256, a ), bg ), 8 ) );
 }
 
-static inline uint32_t max(uint32_t a, uint32_t b, uint32_t c)
+/** Blend the even and odd samples of pm to bg (16-bit lanes), and add them. */
+static inline __m128i blend_pairs_sse2( __m128i pm, __m128i a, __m128i bg )
 {
-    uint32_t tmp = a > b ? a : b;
-    return c > tmp ? c : tmp;
+    const __m128i lo = _mm_set1_epi16( 0x00FF );
+    return _mm_add_epi16( blend_epi16_sse2( _mm_and_si128( pm, lo ), bg, _mm_and_si128( a, lo ) ),
+                          blend_epi16_sse2( _mm_srli_epi16( pm, 8 ), bg, _mm_srli_epi16( a, 8 ) ) );
 }
 
-int histogram_normalize( histogram_t *h, bool log, bool equalize )
+/** Blend 4 RGBA pixels to 4 pixels of 4 bytes, the 4th byte is undefined. */
+static inline __m128i blend_bgrx_sse2( __m128i bgra, __m128i o )
 {
-    uint32_t height = h->height;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i h_lo = _mm_unpacklo_epi8( bgra, zero ),
+            h_hi = _mm_unpackhi_epi8( bgra, zero );
+    __m128i a_lo = _mm_shufflehi_epi16( _mm_shufflelo_epi16( h_lo, 0xFF ), 0xFF ),
+            a_hi = _mm_shufflehi_epi16( _mm_shufflelo_epi16( h_hi, 0xFF ), 0xFF );
+    return _mm_packus_epi16( blend_epi16_sse2( h_lo, _mm_unpacklo_epi8( o, zero ), a_lo ),
+                             blend_epi16_sse2( h_hi, _mm_unpackhi_epi8( o, zero ), a_hi ) );
+}
 
-    if (!h)
-        return HIST_INPUT_ERROR;
+static void blend_row_bytes_sse2( uint8_t *o, const uint8_t *pm, const uint8_t *a, int n )
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i vpm = _mm_loadu_si128( (const __m128i*)(pm+i) ),
+                va  = _mm_loadu_si128( (const __m128i*)(a+i) ),
+                vo  = _mm_loadu_si128( (const __m128i*)(o+i) );
+        __m128i lo = blend_epi16_sse2( _mm_unpacklo_epi8( vpm, zero ), _mm_unpacklo_epi8( vo, zero ),
+                                       _mm_unpacklo_epi8( va, zero ) ),
+                hi = blend_epi16_sse2( _mm_unpackhi_epi8( vpm, zero ), _mm_unpackhi_epi8( vo, zero ),
+                                       _mm_unpackhi_epi8( va, zero ) );
+        _mm_storeu_si128( (__m128i*)(o+i), _mm_packus_epi16( lo, hi ) );
+    }
+    blend_row_bytes_c( o+i, pm+i, a+i, n-i );
+}
 
-    if (log)
-        for (int i=0; i<h->num_channels; i++)
-            h->max[i] = log10f(h->max[i]+1);
+static void blend_row_chroma2_sse2( uint8_t *o, const uint8_t *pm, const uint8_t *a, int n )
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i bg = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(o+i) ), zero );
+        __m128i t = blend_pairs_sse2( _mm_loadu_si128( (const __m128i*)(pm+2*i) ),
+                                      _mm_loadu_si128( (const __m128i*)(a+2*i) ), bg );
+        t = _mm_srli_epi16( t, 1 );
+        _mm_storel_epi64( (__m128i*)(o+i), _mm_packus_epi16( t, t ) );
+    }
+    blend_row_chroma2_c( o+i, pm+2*i, a+2*i, n-i );
+}
 
-    if (equalize && h->num_channels == 3)
-        h->max[0] = h->max[1] = h->max[2] = maxf( h->max[0], h->max[1], h->max[2] );
+static void blend_row_chroma4_sse2( uint8_t *o, const uint8_t *pm, int pm_pitch,
+                                    const uint8_t *a, int a_pitch, int n )
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i bg = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(o+i) ), zero );
+        __m128i t1 = blend_pairs_sse2( _mm_loadu_si128( (const __m128i*)(pm+2*i) ),
+                                       _mm_loadu_si128( (const __m128i*)(a+2*i) ), bg ),
+                t2 = blend_pairs_sse2( _mm_loadu_si128( (const __m128i*)(pm+pm_pitch+2*i) ),
+                                       _mm_loadu_si128( (const __m128i*)(a+a_pitch+2*i) ), bg );
+        __m128i t = _mm_srli_epi16( _mm_add_epi16( t1, t2 ), 2 );
+        _mm_storel_epi64( (__m128i*)(o+i), _mm_packus_epi16( t, t ) );
+    }
+    blend_row_chroma4_c( o+i, pm+2*i, pm_pitch, a+2*i, a_pitch, n-i );
+}
 
-    if (log) {
-        for (int i = 0; i < h->num_channels; i++)
-            for (int b=0; b < h->num_bins; b++)
-                h->bins[i][b] = log10f(h->bins[i][b]+1) * (height-1) / h->max[i];
-    } else {
-        for (int i = 0; i < h->num_channels; i++)
-            for (int b=0; b < h->num_bins; b++)
-                h->bins[i][b] = h->bins[i][b] * (height-1) / h->max[i];
+static void blend_row_chroma4_uv_sse2( uint8_t *o, const uint8_t *u, const uint8_t *v, int pm_pitch,
+                                       const uint8_t *a, int a_pitch, int n )
+{
+    const __m128i lo = _mm_set1_epi16( 0x00FF );
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i vo = _mm_loadu_si128( (const __m128i*)(o+2*i) ),
+                va = _mm_loadu_si128( (const __m128i*)(a+2*i) ),
+                va2 = _mm_loadu_si128( (const __m128i*)(a+a_pitch+2*i) );
+        __m128i bg_u = _mm_and_si128( vo, lo ),
+                bg_v = _mm_srli_epi16( vo, 8 );
+        __m128i tu = _mm_add_epi16( blend_pairs_sse2( _mm_loadu_si128( (const __m128i*)(u+2*i) ), va, bg_u ),
+                                    blend_pairs_sse2( _mm_loadu_si128( (const __m128i*)(u+pm_pitch+2*i) ), va2, bg_u ) ),
+                tv = _mm_add_epi16( blend_pairs_sse2( _mm_loadu_si128( (const __m128i*)(v+2*i) ), va, bg_v ),
+                                    blend_pairs_sse2( _mm_loadu_si128( (const __m128i*)(v+pm_pitch+2*i) ), va2, bg_v ) );
+        _mm_storeu_si128( (__m128i*)(o+2*i), _mm_or_si128( _mm_srli_epi16( tu, 2 ),
+                                                           _mm_slli_epi16( _mm_srli_epi16( tv, 2 ), 8 ) ) );
     }
+    blend_row_chroma4_uv_c( o+2*i, u+2*i, v+2*i, pm_pitch, a+2*i, a_pitch, n-i );
+}
 
-    /*Set max[i] to new normalized height*/
-    for (int i=0; i<h->num_channels; i++)
-        h->max[i] = height-1;
+static void blend_row_yuyv_sse2( uint8_t *o, const uint8_t *y, const uint8_t *u,
+                                 const uint8_t *v, const uint8_t *a, int n )
+{
+    const __m128i zero = _mm_setzero_si128(),
+                  lo   = _mm_set1_epi16( 0x00FF );
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i vo = _mm_loadu_si128( (const __m128i*)(o+2*i) ),
+                va = _mm_loadl_epi64( (const __m128i*)(a+i) );
+        /*Lanes hold Y (low byte) and U or V (high byte) of one pixel*/
+        __m128i vy = blend_epi16_sse2( _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(y+i) ), zero ),
+                                       _mm_and_si128( vo, lo ), _mm_unpacklo_epi8( va, zero ) );
+        /*Lanes 2k and 2k+1 hold the U and V pairs of macro-pixel k*/
+        __m128i uv = _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i*)(u+i) ),
+                                         _mm_loadl_epi64( (const __m128i*)(v+i) ) ),
+                aa = _mm_unpacklo_epi16( va, va );
+        __m128i vc = _mm_srli_epi16( blend_pairs_sse2( uv, aa, _mm_srli_epi16( vo, 8 ) ), 1 );
+        _mm_storeu_si128( (__m128i*)(o+2*i), _mm_or_si128( vy, _mm_slli_epi16( vc, 8 ) ) );
+    }
+    blend_row_yuyv_c( o+2*i, y+i, u+i, v+i, a+i, n-i );
+}
 
-    return HIST_SUCCESS;
+static void blend_row_rgb24_sse2( uint8_t *o, const uint8_t *bgra, int n )
+{
+    const __m128i rgb = _mm_setr_epi32( 0x00FFFFFF, 0, 0, 0 );
+    int i = 0;
+
+    /*4 pixels at a time, without reading past the 3*n bytes of the row*/
+    for (; i + 6 <= n; i += 4) {
+        __m128i vo = _mm_loadu_si128( (const __m128i*)(o+3*i) );
+        __m128i px = _mm_unpacklo_epi64( _mm_unpacklo_epi32( vo, _mm_srli_si128( vo, 3 ) ),
+                                         _mm_unpacklo_epi32( _mm_srli_si128( vo, 6 ),
+                                                             _mm_srli_si128( vo, 9 ) ) );
+        __m128i r = blend_bgrx_sse2( _mm_loadu_si128( (const __m128i*)(bgra+4*i) ), px );
+        r = _mm_or_si128( _mm_or_si128( _mm_and_si128( r, rgb ),
+                                        _mm_srli_si128( _mm_and_si128( r, _mm_slli_si128( rgb, 4 ) ), 1 ) ),
+                          _mm_or_si128( _mm_srli_si128( _mm_and_si128( r, _mm_slli_si128( rgb, 8 ) ), 2 ),
+                                        _mm_srli_si128( _mm_and_si128( r, _mm_slli_si128( rgb, 12 ) ), 3 ) ) );
+        _mm_storel_epi64( (__m128i*)(o+3*i), r );
+        uint32_t last = _mm_cvtsi128_si32( _mm_srli_si128( r, 8 ) );
+        memcpy( o+3*i+8, &last, 4 );
+    }
+    blend_row_rgb24_c( o+3*i, bgra+4*i, n-i );
 }
 
-inline uint8_t* xy2p(int x, int y, plane_t *plane)
+static void blend_row_rgb32_sse2( uint8_t *o, const uint8_t *bgra, int n )
 {
-#ifdef HISTOGRAM_DEBUG
-   if (x>=plane->i_visible_pitch || y>=plane->i_visible_lines) {
-      printf("[%d,%d]->%d {%dx%d}\n",x,y,(plane->i_visible_lines-y-1)*plane->i_pitch+x,plane->i_visible_pitch,plane->i_visible_lines);
-      fflush(stdout);
-      return NULL;
-   }
-#endif
-      return plane->p_pixels + (plane->i_visible_lines-y-1)*plane->i_pitch + x;
+    const __m128i rgb = _mm_set1_epi32( 0x00FFFFFF );
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i vo = _mm_loadu_si128( (const __m128i*)(o+4*i) );
+        __m128i r = blend_bgrx_sse2( _mm_loadu_si128( (const __m128i*)(bgra+4*i) ), vo );
+        /*The 4th byte is not blended*/
+        _mm_storeu_si128( (__m128i*)(o+4*i), _mm_or_si128( _mm_and_si128( r, rgb ),
+                                                           _mm_andnot_si128( rgb, vo ) ) );
+    }
+    blend_row_rgb32_c( o+4*i, bgra+4*i, n-i );
 }
 
-/**
- * Paint an RGB histogram directly to a YUV picture.
- *
- * p_yuv is expected to be a YUVA planar picture, with enough space for:
- * width = histo->num_bins + 1(shadow)
- * height = 3*histo->height + 2*BOTTOM_MARGIN + 1(shadow)
- * The picture dimentions should be even
- */
-int histogram_rgb_paintToYUVA( histogram_t *histo, picture_t *p_yuv )
+static const histogram_blend_rows_t blend_rows_sse2 = {
+    .bytes   = blend_row_bytes_sse2,
+    .chroma2 = blend_row_chroma2_sse2,
+    .chroma4 = blend_row_chroma4_sse2,
+    .chroma4_uv = blend_row_chroma4_uv_sse2,
+    .yuyv    = blend_row_yuyv_sse2,
+    .rgb24   = blend_row_rgb24_sse2,
+    .rgb32   = blend_row_rgb32_sse2,
+};
+#endif /*HAVE_SSE2_INTRINSICS*/
+
+#ifdef HAVE_AVX2_INTRINSICS
+__attribute__((target("avx2")))
+static inline __m256i blend_epi16_avx2( __m256i pm, __m256i bg, __m256i a )
 {
-    const int yr0 = 1,
-              yg0 = yr0 + histo->height + BOTTOM_MARGIN,
-              yb0 = yg0 + histo->height + BOTTOM_MARGIN;
+    const __m256i k256 = _mm256_set1_epi16( 256 );
+    return _mm256_add_epi16( pm, _mm256_srli_epi16( _mm256_mullo_epi16( _mm256_sub_epi16( k256, a ), bg ), 8 ) );
+}
 
-#define P_Y(x,y) xy2p( (x), (y), &p_yuv->p[Y_PLANE] )
-#define P_U(x,y) xy2p( (x), (y), &p_yuv->p[U_PLANE] )
-#define P_V(x,y) xy2p( (x), (y), &p_yuv->p[V_PLANE] )
-#define P_A(x,y) xy2p( (x), (y), &p_yuv->p[A_PLANE] )
-    /*For each bin in the histogram, paint a vertical bar in R/G/B color*/
-    for (int bin=0; bin < histo->num_bins; bin++) {
-        /*y-min for drop shaddow bar*/
-       const uint32_t jsr0 = (bin == histo->num_bins-1) ? 0 : histo->bins[R][bin+1]+1;
-       const uint32_t jsg0 = (bin == histo->num_bins-1) ? 0 : histo->bins[G][bin+1]+1;
-       const uint32_t jsb0 = (bin == histo->num_bins-1) ? 0 : histo->bins[B][bin+1]+1;
-
-       const int x = bin;
-
-       /*Paint red bar*/
-       for (uint32_t j = 0; j <= histo->bins[R][bin]; j++) {
-          int y = yr0 + j;
-          rgb_to_yuv( P_Y(x,y), P_U(x,y), P_V(x,y), MAX_PIXEL_VALUE, 0, 0 );
-          *P_A(x,y) = HISTOGRAM_ALPHA;
-       }
-       /*Drop shadow, 1 pel right - 1 pel below red bar*/
-       for (uint32_t j = jsr0; j < histo->bins[R][bin]; j++) {
-          int y = yr0 + j;
-          rgb_to_yuv( P_Y(x+1,y), P_U(x+1,y), P_V(x+1,y),
-                      SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
-          *P_A(x+1,y) = HISTOGRAM_ALPHA;
-       }
-       /*Drop shadow under the next red bar*/
-       rgb_to_yuv( P_Y(x+1,yr0-1), P_U(x+1,yr0-1), P_V(x+1,yr0-1),
-                   SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
-       *P_A(x+1,yr0-1) = HISTOGRAM_ALPHA;
-
-       /*Paint green bar*/
-       for (uint32_t j = 0; j <= histo->bins[G][bin]; j++) {
-          int y = yg0 + j;
-          rgb_to_yuv( P_Y(x,y), P_U(x,y), P_V(x,y), 0, MAX_PIXEL_VALUE, 0 );
-          *P_A(x,y) = HISTOGRAM_ALPHA;
-       }
-       /*Drop shadow, 1 pel right - 1 pel below green bar*/
-       for (uint32_t j = jsg0; j < histo->bins[G][bin]; j++) {
-          int y = yg0 + j;
-          rgb_to_yuv( P_Y(x+1,y), P_U(x+1,y), P_V(x+1,y),
-                      SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
-          *P_A(x+1,y) = HISTOGRAM_ALPHA;
-       }
-       /*Drop shadow under the next green bar*/
-       rgb_to_yuv( P_Y(x+1,yg0-1), P_U(x+1,yg0-1), P_V(x+1,yg0-1),
-                   SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
-       *P_A(x+1,yg0-1) = HISTOGRAM_ALPHA;
-
-       /*Paint blue bar*/
-       for (uint32_t j=0; j <= histo->bins[B][bin]; j++) {
-          int y = yb0 + j;
-          rgb_to_yuv( P_Y(x,y), P_U(x,y), P_V(x,y), 0, 0, MAX_PIXEL_VALUE );
-          *P_A(x,y) = HISTOGRAM_ALPHA;
-       }
-       /*Drop shadow, 1 pel right - 1 pel below blue bar*/
-       for (uint32_t j = jsb0; j < histo->bins[B][bin]; j++) {
-          int y = yb0 + j;
-          rgb_to_yuv( P_Y(x+1,y), P_U(x+1,y), P_V(x+1,y),
-                      SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
-          *P_A(x+1,y) = HISTOGRAM_ALPHA;
-       }
-       /*Drop shadow under the next blue bar*/
-       rgb_to_yuv( P_Y(x+1,yb0-1), P_U(x+1,yb0-1), P_V(x+1,yb0-1),
-                   SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
-       *P_A(x+1,yb0-1) = HISTOGRAM_ALPHA;
-    }
-#undef P_Y
-#undef P_U
-#undef P_V
-#undef P_A
+__attribute__((target("avx2")))
+static inline __m256i blend_pairs_avx2( __m256i pm, __m256i a, __m256i bg )
+{
+    const __m256i lo = _mm256_set1_epi16( 0x00FF );
+    return _mm256_add_epi16( blend_epi16_avx2( _mm256_and_si256( pm, lo ), bg, _mm256_and_si256( a, lo ) ),
+                             blend_epi16_avx2( _mm256_srli_epi16( pm, 8 ), bg, _mm256_srli_epi16( a, 8 ) ) );
+}
 
-    return HIST_SUCCESS;
+/** Pack 16 lanes of 16 bits to 16 bytes. */
+__attribute__((target("avx2")))
+static inline __m128i pack_epi16_avx2( __m256i v )
+{
+    return _mm256_castsi256_si128( _mm256_permute4x64_epi64( _mm256_packus_epi16( v, v ),
+                                                             _MM_SHUFFLE(3,1,2,0) ) );
 }
 
-/**
- * Paint a Y histogram to a YUV picture.
- * 
- * p_yuv is expected to be a YUVA planar picture, with enough space for:
- * width = histo->num_bins + 1(shadow)
- * height = histo->height + 1(shadow)
- * The picture dimentions should be even
- */
-int histogram_yuv_paintToYUVA( histogram_t *histo, picture_t *p_yuv )
+__attribute__((target("avx2")))
+static void blend_row_bytes_avx2( uint8_t *o, const uint8_t *pm, const uint8_t *a, int n )
 {
-    const int y0 = 1;
-    uint8_t gray_y, gray_u, gray_v, bright_y, bright_u, bright_v;
-    rgb_to_yuv( &gray_y, &gray_u, &gray_v,
-                SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE, SHADOW_PIXEL_VALUE );
-    rgb_to_yuv( &bright_y, &bright_u, &bright_v,
-                MAX_PIXEL_VALUE, MAX_PIXEL_VALUE, MAX_PIXEL_VALUE );
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i vpm = _mm256_loadu_si256( (const __m256i*)(pm+i) ),
+                va  = _mm256_loadu_si256( (const __m256i*)(a+i) ),
+                vo  = _mm256_loadu_si256( (const __m256i*)(o+i) );
+        __m256i lo = blend_epi16_avx2( _mm256_unpacklo_epi8( vpm, zero ), _mm256_unpacklo_epi8( vo, zero ),
+                                       _mm256_unpacklo_epi8( va, zero ) ),
+                hi = blend_epi16_avx2( _mm256_unpackhi_epi8( vpm, zero ), _mm256_unpackhi_epi8( vo, zero ),
+                                       _mm256_unpackhi_epi8( va, zero ) );
+        _mm256_storeu_si256( (__m256i*)(o+i), _mm256_packus_epi16( lo, hi ) );
+    }
+    blend_row_bytes_sse2( o+i, pm+i, a+i, n-i );
+}
 
-#define P_Y(x,y) xy2p( (x), (y), &p_yuv->p[Y_PLANE] )
-#define P_U(x,y) xy2p( (x), (y), &p_yuv->p[U_PLANE] )
-#define P_V(x,y) xy2p( (x), (y), &p_yuv->p[V_PLANE] )
-#define P_A(x,y) xy2p( (x), (y), &p_yuv->p[A_PLANE] )
-    /*For each bin in the histogram, paint a vertical bar in Y*/
-    for (int bin=0; bin < histo->num_bins; bin++) {
-        /*y-min for drop shaddow bar*/
-       const uint32_t js0 = (bin == histo->num_bins-1) ? 0 : histo->bins[Y][bin+1]+1;
-       const int x = bin;
-
-       /*Paint bar*/
-       for (uint32_t j = 0; j <= histo->bins[Y][bin]; j++) {
-          int y = y0 + j;
-          *P_Y(x,y) = bright_y;
-          *P_U(x,y) = bright_u;
-          *P_V(x,y) = bright_v;
-          *P_A(x,y) = HISTOGRAM_ALPHA;
-       }
-       /*Drop shadow, 1 pel right - 1 pel below bar*/
-       for (uint32_t j = js0; j < histo->bins[Y][bin]; j++) {
-          int y = y0 + j;
-          *P_Y(x+1,y) = gray_y;
-          *P_U(x+1,y) = gray_u;
-          *P_V(x+1,y) = gray_v;
-          *P_A(x+1,y) = HISTOGRAM_ALPHA;
-       }
-       /*Drop shadow under the next red bar*/
-       *P_Y(x+1,y0-1) = gray_y;
-       *P_U(x+1,y0-1) = gray_u;
-       *P_V(x+1,y0-1) = gray_v;
-       *P_A(x+1,y0-1) = HISTOGRAM_ALPHA;
-    }
-#undef P_Y
-#undef P_U
-#undef P_V
-#undef P_A
+__attribute__((target("avx2")))
+static void blend_row_chroma2_avx2( uint8_t *o, const uint8_t *pm, const uint8_t *a, int n )
+{
+    int i = 0;
 
-    return HIST_SUCCESS;
+    for (; i + 16 <= n; i += 16) {
+        __m256i bg = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*)(o+i) ) );
+        __m256i t = blend_pairs_avx2( _mm256_loadu_si256( (const __m256i*)(pm+2*i) ),
+                                      _mm256_loadu_si256( (const __m256i*)(a+2*i) ), bg );
+        _mm_storeu_si128( (__m128i*)(o+i), pack_epi16_avx2( _mm256_srli_epi16( t, 1 ) ) );
+    }
+    blend_row_chroma2_sse2( o+i, pm+2*i, a+2*i, n-i );
 }
 
-/** Return a pointer to the RGBA pixel channel */
-inline uint8_t* xyca2pc(int x, int y, int c, plane_t *plane)
+__attribute__((target("avx2")))
+static void blend_row_chroma4_avx2( uint8_t *o, const uint8_t *pm, int pm_pitch,
+                                    const uint8_t *a, int a_pitch, int n )
 {
-#ifdef HISTOGRAM_DEBUG
-   if (x>=plane->i_visible_pitch || y>=plane->i_visible_lines || c > 3) {
-      printf("[%d,%d,%d] {%dx%d}\n",x,y,c,plane->i_visible_pitch,plane->i_visible_lines);
-      fflush(stdout);
-      return NULL;
-   }
-#endif
-      return plane->p_pixels + (plane->i_visible_lines-y-1)*plane->i_pitch + 4*x + c;
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i bg = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*)(o+i) ) );
+        __m256i t1 = blend_pairs_avx2( _mm256_loadu_si256( (const __m256i*)(pm+2*i) ),
+                                       _mm256_loadu_si256( (const __m256i*)(a+2*i) ), bg ),
+                t2 = blend_pairs_avx2( _mm256_loadu_si256( (const __m256i*)(pm+pm_pitch+2*i) ),
+                                       _mm256_loadu_si256( (const __m256i*)(a+a_pitch+2*i) ), bg );
+        _mm_storeu_si128( (__m128i*)(o+i), pack_epi16_avx2( _mm256_srli_epi16( _mm256_add_epi16( t1, t2 ), 2 ) ) );
+    }
+    blend_row_chroma4_sse2( o+i, pm+2*i, pm_pitch, a+2*i, a_pitch, n-i );
 }
 
-/**
- * Paint a Y histogram to an 32-bit RGBA picture.
- *
- * p_bgra is expected to be an RGBA picture, with enough space for:
- * width = histo->num_bins + 1(shadow)
- * height = histo->height + 1(shadow)
- * The picture dimentions should be even
- */
-int histogram_yuv_paintToRGBA( histogram_t *histo, picture_t *p_bgra )
+__attribute__((target("avx2")))
+static void blend_row_chroma4_uv_avx2( uint8_t *o, const uint8_t *u, const uint8_t *v, int pm_pitch,
+                                       const uint8_t *a, int a_pitch, int n )
 {
-    const int y0 = 1;
-#ifdef HISTOGRAM_LITTLE_ENDIAN
-    const uint32_t bright = MAX_PIXEL_VALUE<<0  |
-                            MAX_PIXEL_VALUE<<8  |
-                            MAX_PIXEL_VALUE<<16 |
-                            HISTOGRAM_ALPHA<<24,
-                   grey   = SHADOW_PIXEL_VALUE<<0  |
-                            SHADOW_PIXEL_VALUE<<8  |
-                            SHADOW_PIXEL_VALUE<<16 |
-                            HISTOGRAM_ALPHA   <<24;
-#else /*BIG_ENDIAN*/
-    const uint32_t bright = MAX_PIXEL_VALUE<<24 |
-                            MAX_PIXEL_VALUE<<16 |
-                            MAX_PIXEL_VALUE<<8  |
-                            HISTOGRAM_ALPHA,
-                   grey   = SHADOW_PIXEL_VALUE<<24 |
-                            SHADOW_PIXEL_VALUE<<16 |
-                            SHADOW_PIXEL_VALUE<<8  |
-                            HISTOGRAM_ALPHA;
-#endif /*HISTOGRAM_LITTLE_ENDIAN*/
+    const __m256i lo = _mm256_set1_epi16( 0x00FF );
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i vo = _mm256_loadu_si256( (const __m256i*)(o+2*i) ),
+                va = _mm256_loadu_si256( (const __m256i*)(a+2*i) ),
+                va2 = _mm256_loadu_si256( (const __m256i*)(a+a_pitch+2*i) );
+        __m256i bg_u = _mm256_and_si256( vo, lo ),
+                bg_v = _mm256_srli_epi16( vo, 8 );
+        __m256i tu = _mm256_add_epi16( blend_pairs_avx2( _mm256_loadu_si256( (const __m256i*)(u+2*i) ), va, bg_u ),
+                                       blend_pairs_avx2( _mm256_loadu_si256( (const __m256i*)(u+pm_pitch+2*i) ), va2, bg_u ) ),
+                tv = _mm256_add_epi16( blend_pairs_avx2( _mm256_loadu_si256( (const __m256i*)(v+2*i) ), va, bg_v ),
+                                       blend_pairs_avx2( _mm256_loadu_si256( (const __m256i*)(v+pm_pitch+2*i) ), va2, bg_v ) );
+        _mm256_storeu_si256( (__m256i*)(o+2*i), _mm256_or_si256( _mm256_srli_epi16( tu, 2 ),
+                                                                 _mm256_slli_epi16( _mm256_srli_epi16( tv, 2 ), 8 ) ) );
+    }
+    blend_row_chroma4_uv_sse2( o+2*i, u+2*i, v+2*i, pm_pitch, a+2*i, a_pitch, n-i );
+}
 
-#define P(x,y) xy_rgba2p( (x), (y), &p_bgra->p[RGB_PLANE] )
-    /*For each bin in the histogram, paint a vertical bar*/
-    for (int bin=0; bin < histo->num_bins; bin++) {
-        /*y-min for drop shaddow bar*/
-       const uint32_t js0 = (bin == histo->num_bins-1) ? 0 : histo->bins[Y][bin+1]+1;
-       const int x = bin;
-
-       /*Paint bar*/
-       for (uint32_t j = 0; j <= histo->bins[Y][bin]; j++) {
-          int y = y0 + j;
-          *P(x,y) = bright;
-       }
-       /*Drop shadow, 1 pel right - 1 pel below bar*/
-       for (uint32_t j = js0; j < histo->bins[Y][bin]; j++) {
-          int y = y0 + j;
-          *P(x+1,y) = grey;
-       }
-       /*Drop shadow under the next bar*/
-       *P(x+1,y0-1) = grey;
-    }
-#undef P
+__attribute__((target("avx2")))
+static void blend_row_yuyv_avx2( uint8_t *o, const uint8_t *y, const uint8_t *u,
+                                 const uint8_t *v, const uint8_t *a, int n )
+{
+    const __m256i lo = _mm256_set1_epi16( 0x00FF );
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i vo = _mm256_loadu_si256( (const __m256i*)(o+2*i) );
+        __m128i va = _mm_loadu_si128( (const __m128i*)(a+i) ),
+                vu = _mm_loadu_si128( (const __m128i*)(u+i) ),
+                vv = _mm_loadu_si128( (const __m128i*)(v+i) );
+        __m256i vy = blend_epi16_avx2( _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*)(y+i) ) ),
+                                       _mm256_and_si256( vo, lo ), _mm256_cvtepu8_epi16( va ) );
+        __m256i uv = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_unpacklo_epi16( vu, vv ) ),
+                                              _mm_unpackhi_epi16( vu, vv ), 1 ),
+                aa = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_unpacklo_epi16( va, va ) ),
+                                              _mm_unpackhi_epi16( va, va ), 1 );
+        __m256i vc = _mm256_srli_epi16( blend_pairs_avx2( uv, aa, _mm256_srli_epi16( vo, 8 ) ), 1 );
+        _mm256_storeu_si256( (__m256i*)(o+2*i), _mm256_or_si256( vy, _mm256_slli_epi16( vc, 8 ) ) );
+    }
+    blend_row_yuyv_sse2( o+2*i, y+i, u+i, v+i, a+i, n-i );
+}
 
-    return HIST_SUCCESS;
+__attribute__((target("avx2")))
+static void blend_row_rgb32_avx2( uint8_t *o, const uint8_t *bgra, int n )
+{
+    const __m256i zero = _mm256_setzero_si256(),
+                  rgb  = _mm256_set1_epi32( 0x00FFFFFF );
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i vo = _mm256_loadu_si256( (const __m256i*)(o+4*i) ),
+                vh = _mm256_loadu_si256( (const __m256i*)(bgra+4*i) );
+        __m256i h_lo = _mm256_unpacklo_epi8( vh, zero ),
+                h_hi = _mm256_unpackhi_epi8( vh, zero );
+        __m256i a_lo = _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( h_lo, 0xFF ), 0xFF ),
+                a_hi = _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( h_hi, 0xFF ), 0xFF );
+        __m256i r = _mm256_packus_epi16( blend_epi16_avx2( h_lo, _mm256_unpacklo_epi8( vo, zero ), a_lo ),
+                                         blend_epi16_avx2( h_hi, _mm256_unpackhi_epi8( vo, zero ), a_hi ) );
+        _mm256_storeu_si256( (__m256i*)(o+4*i), _mm256_or_si256( _mm256_and_si256( r, rgb ),
+                                                                 _mm256_andnot_si256( rgb, vo ) ) );
+    }
+    blend_row_rgb32_sse2( o+4*i, bgra+4*i, n-i );
 }
 
-int histogram_paint( histogram_t *h )
+/*The 3 byte pixels of RGB24 gain nothing from 256-bit lanes*/
+static const histogram_blend_rows_t blend_rows_avx2 = {
+    .bytes   = blend_row_bytes_avx2,
+    .chroma2 = blend_row_chroma2_avx2,
+    .chroma4 = blend_row_chroma4_avx2,
+    .chroma4_uv = blend_row_chroma4_uv_avx2,
+    .yuyv    = blend_row_yuyv_avx2,
+    .rgb24   = blend_row_rgb24_sse2,
+    .rgb32   = blend_row_rgb32_avx2,
+};
+#endif /*HAVE_AVX2_INTRINSICS*/
+
+/** Pick the fastest blend row kernels cpu (HISTOGRAM_CPU_*) can run. */
+const histogram_blend_rows_t* histogram_blend_rows( unsigned cpu )
 {
-    picture_ZeroPixels( h->p_overlay );
+#ifdef HAVE_AVX2_INTRINSICS
+    if (cpu & HISTOGRAM_CPU_AVX2)
+        return &blend_rows_avx2;
+#endif
+#ifdef HAVE_SSE2_INTRINSICS
+    if (cpu & HISTOGRAM_CPU_SSE2)
+        return &blend_rows_sse2;
+#endif
+    VLC_UNUSED(cpu);
+    return &blend_rows_c;
+}
 
-    return h->paint_func( h, h->p_overlay );
+/** The span covering overlay rows r and r+1. */
+static inline histogram_span_t span_union( const histogram_span_t *spans, int r )
+{
+    histogram_span_t s = spans[r];
+    const histogram_span_t *s2 = &spans[r+1];
+
+    if (s2->x1 > s2->x0) {
+        if (s.x1 <= s.x0)
+            return *s2;
+        s.x0 = __MIN( s.x0, s2->x0 );
+        s.x1 = __MAX( s.x1, s2->x1 );
+    }
+    return s;
 }
 
-/**
- * Alpha blend forground to background.
- *
- * Returns: fg*(a/256) + bg*(256-a)/256
- */
-static inline uint8_t blend( uint8_t fg, uint8_t bg, uint8_t a )
+/** Widen a span to whole pairs of pixels, for horizontally subsampled chroma. */
+static inline histogram_span_t span_pairs( histogram_span_t s )
 {
-    return ( a * (fg-bg) + (bg<<8) )>>8;
+    s.x0 &= ~1;
+    s.x1 = (s.x1 + 1) & ~1;
+    return s;
 }
 
-int picture_RGBA_BlendToRGB24_32( picture_t *p_out, picture_t *p_histo, int x0, int y0, bool rgb24 )
+int picture_RGBA_BlendToRGB24_32( picture_t *p_out, picture_t *p_histo, int x0, int y0, bool rgb24,
+                                  const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
     int bytes = rgb24 ? 3 : 4;
     int h_pitch = p_histo->p[RGB_PLANE].i_pitch,
-        h_width = p_histo->p[RGB_PLANE].i_visible_pitch,
+        h_lines = p_histo->p[RGB_PLANE].i_visible_lines,
         o_pitch = p_out->p[RGB_PLANE].i_pitch;
     uint8_t *h = p_histo->p[RGB_PLANE].p_pixels,
             *o = p_out->p[RGB_PLANE].p_pixels + y0*o_pitch + x0*bytes;
-    uint8_t *h_end = h + p_histo->p[RGB_PLANE].i_visible_lines*h_pitch;
+    void (*blend_row)( uint8_t*, const uint8_t*, int ) = rgb24 ? rows->rgb24 : rows->rgb32;
 
-    while (h < h_end) {
-        uint8_t *h_line_end  = h + h_width;
-        uint8_t *h_line_next = h + h_pitch;
-        uint8_t *o_line_next = o + o_pitch;
-        while (h < h_line_end) {
-            *(o+0) = blend( *(h+0), *(o+0), *(h+3) );
-            *(o+1) = blend( *(h+1), *(o+1), *(h+3) );
-            *(o+2) = blend( *(h+2), *(o+2), *(h+3) );
-            h+=4; o+=bytes;
-        }
-        h = h_line_next;
-        o = o_line_next;
+    for (int r = 0; r < h_lines; r++, h += h_pitch, o += o_pitch) {
+        const histogram_span_t s = spans[r];
+        if (s.x1 > s.x0)
+            blend_row( o + s.x0*bytes, h + s.x0*4, s.x1 - s.x0 );
     }
 
     return HIST_SUCCESS;
@@ -1482,9 +5747,10 @@ int picture_RGBA_BlendToRGB24_32( picture_t *p_out, picture_t *p_histo, int x0,
  * p_out  : RGB24 picture, the filter output
  * x0,y0  : Where the top-left corner of p_histo should be placed
  */
-int picture_RGBA_BlendToRGB24( picture_t *p_out, picture_t *p_histo, int x0, int y0 )
+int picture_RGBA_BlendToRGB24( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                               const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
-    return picture_RGBA_BlendToRGB24_32( p_out, p_histo, x0, y0, true );
+    return picture_RGBA_BlendToRGB24_32( p_out, p_histo, x0, y0, true, spans, rows );
 }
 
 /**
@@ -1494,9 +5760,10 @@ int picture_RGBA_BlendToRGB24( picture_t *p_out, picture_t *p_histo, int x0, int
  * p_out  : RGB32 picture, the filter output
  * x0,y0  : Where the top-left corner of p_histo should be placed
  */
-int picture_RGBA_BlendToRGB32( picture_t *p_out, picture_t *p_histo, int x0, int y0 )
+int picture_RGBA_BlendToRGB32( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                               const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
-    return picture_RGBA_BlendToRGB24_32( p_out, p_histo, x0, y0, false );
+    return picture_RGBA_BlendToRGB24_32( p_out, p_histo, x0, y0, false, spans, rows );
 }
 
 /**
@@ -1507,29 +5774,21 @@ int picture_RGBA_BlendToRGB32( picture_t *p_out, picture_t *p_histo, int x0, int
  * p_out  : Y800 picture, the filter output
  * x0,y0  : Where the top-left corner of p_histo should be placed
  */
-int picture_YUVA_BlendToY800( picture_t *p_out, picture_t *p_histo, int x0, int y0 )
+int picture_YUVA_BlendToY800( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                              const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
     int a_pitch = p_histo->p[A_PLANE].i_pitch,
         y_pitch = p_histo->p[Y_PLANE].i_pitch,
-        y_width = p_histo->p[Y_PLANE].i_visible_pitch,
+        y_lines = p_histo->p[Y_PLANE].i_visible_lines,
         o_pitch = p_out->p[Y_PLANE].i_pitch;
     uint8_t *y = p_histo->p[Y_PLANE].p_pixels,
             *a = p_histo->p[A_PLANE].p_pixels,
             *o = p_out->p[Y_PLANE].p_pixels + y0*o_pitch + x0;
-    uint8_t *y_end = y + p_histo->p[Y_PLANE].i_visible_lines*y_pitch;
 
-    while (y < y_end) {
-        uint8_t *y_line_end = y+y_width;
-        uint8_t *y_line_next = y + y_pitch;
-        uint8_t *a_line_next = a + a_pitch;
-        uint8_t *o_line_next = o + o_pitch;
-        while (y < y_line_end) {
-            *o = blend( *y, *o, *a );
-            y++; a++; o++;
-        }
-        y = y_line_next;
-        a = a_line_next;
-        o = o_line_next;
+    for (int r = 0; r < y_lines; r++, y += y_pitch, a += a_pitch, o += o_pitch) {
+        const histogram_span_t s = spans[r];
+        if (s.x1 > s.x0)
+            rows->bytes( o + s.x0, y + s.x0, a + s.x0, s.x1 - s.x0 );
     }
 
     return HIST_SUCCESS;
@@ -1539,7 +5798,8 @@ int picture_YUVA_BlendToY800( picture_t *p_out, picture_t *p_histo, int x0, int
  *
  * Supports I422(with switch_uv=false) & YV16(with switch_uv=true)
  */
-int picture_YUVA_BlendToYUV422( picture_t *p_out, picture_t *p_histo, int x0, int y0, bool switch_uv )
+int picture_YUVA_BlendToYUV422( picture_t *p_out, picture_t *p_histo, int x0, int y0, bool switch_uv,
+                                const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
     int u_plane, v_plane;
     u_plane = switch_uv ? V_PLANE : U_PLANE;
@@ -1548,12 +5808,9 @@ int picture_YUVA_BlendToYUV422( picture_t *p_out, picture_t *p_histo, int x0, in
         y_pitch = p_histo->p[Y_PLANE].i_pitch,
         u_pitch = p_histo->p[U_PLANE].i_pitch,
         v_pitch = p_histo->p[V_PLANE].i_pitch,
-        y_width = p_histo->p[Y_PLANE].i_visible_pitch,
         o_pitch = p_out->p[Y_PLANE].i_pitch,
         uo_pitch = p_out->p[u_plane].i_pitch,
         vo_pitch = p_out->p[v_plane].i_pitch;
-    uint8_t ut1, ut2,
-            vt1, vt2;
     uint8_t *y = p_histo->p[Y_PLANE].p_pixels,
             *u = p_histo->p[U_PLANE].p_pixels,
             *v = p_histo->p[V_PLANE].p_pixels,
@@ -1562,62 +5819,36 @@ int picture_YUVA_BlendToYUV422( picture_t *p_out, picture_t *p_histo, int x0, in
             *uo= p_out->p[u_plane].p_pixels + y0*uo_pitch + x0/2,
             *vo= p_out->p[v_plane].p_pixels + y0*vo_pitch + x0/2;
     uint8_t *y_end = y + p_histo->p[Y_PLANE].i_visible_lines*y_pitch;
-    uint8_t *y1, *y2,
-            *u1, *u2,
-            *v1, *v2,
-            *a1, *a2,
-            *o1, *o2;
 
-    while (y < y_end) {
-        uint8_t *y_line_end = y+y_width;
-        uint8_t *y_line_next = y + y_pitch;
-        uint8_t *u_line_next = u + u_pitch;
-        uint8_t *v_line_next = v + v_pitch;
-        uint8_t *a_line_next = a + a_pitch;
-        uint8_t *o_line_next = o + o_pitch;
-        uint8_t *uo_line_next = uo + uo_pitch;
-        uint8_t *vo_line_next = vo + vo_pitch;
-        while (y < y_line_end) {
-            y1 = y; y2 = y+1;
-            u1 = u; u2 = u+1;
-            v1 = v; v2 = v+1;
-            a1 = a; a2 = a+1;
-            o1 = o; o2 = o+1;
-            *o1 = blend( *y1, *o1, *a1 );
-            *o2 = blend( *y2, *o2, *a2 );
-
-            ut1 = blend( *u1, *uo, *a1 );
-            ut2 = blend( *u2, *uo, *a2 );
-            *uo = (ut1+ut2)/2;
-
-            vt1 = blend( *v1, *vo, *a1 );
-            vt2 = blend( *v2, *vo, *a2 );
-            *vo = (vt1+vt2)/2;
-
-            y+=2; u+=2; v+=2; a+=2; o+=2;
-            uo++; vo++;
-        }
-        y = y_line_next;
-        u = u_line_next;
-        v = v_line_next;
-        a = a_line_next;
-        o = o_line_next;
-        uo = uo_line_next;
-        vo = vo_line_next;
+    for (int r = 0; y < y_end; r++) {
+        const histogram_span_t s = span_pairs( spans[r] );
+        const int n = s.x1 - s.x0;
+        if (n > 0) {
+            rows->bytes( o + s.x0, y + s.x0, a + s.x0, n );
+            rows->chroma2( uo + s.x0/2, u + s.x0, a + s.x0, n/2 );
+            rows->chroma2( vo + s.x0/2, v + s.x0, a + s.x0, n/2 );
+        }
+
+        y += y_pitch;
+        u += u_pitch;
+        v += v_pitch;
+        a += a_pitch;
+        o += o_pitch;
+        uo += uo_pitch;
+        vo += vo_pitch;
     }
 
     return HIST_SUCCESS;
 }
 
-int picture_YUVA_BlendToYUYV( picture_t *p_out, picture_t *p_histo, int xoffset, int yoffset )
+int picture_YUVA_BlendToYUYV( picture_t *p_out, picture_t *p_histo, int xoffset, int yoffset,
+                              const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
     int a_pitch = p_histo->p[A_PLANE].i_pitch,
         y_pitch = p_histo->p[Y_PLANE].i_pitch,
         u_pitch = p_histo->p[U_PLANE].i_pitch,
         v_pitch = p_histo->p[V_PLANE].i_pitch,
-        y_width = p_histo->p[Y_PLANE].i_visible_pitch,
         o_pitch = p_out->p[Y_PLANE].i_pitch;
-    uint8_t vt0, vt1, ut0, ut1;
     uint8_t *y = p_histo->p[Y_PLANE].p_pixels,
             *u = p_histo->p[U_PLANE].p_pixels,
             *v = p_histo->p[V_PLANE].p_pixels,
@@ -1625,47 +5856,17 @@ int picture_YUVA_BlendToYUYV( picture_t *p_out, picture_t *p_histo, int xoffset,
             *o = p_out->p[Y_PLANE].p_pixels + yoffset*o_pitch + 2 * (xoffset/2)*2;
     /*xoffset should be a multiple of '2' to be aligned on a macro-pixel*/
     uint8_t *y_end = y + p_histo->p[Y_PLANE].i_visible_lines*y_pitch;
-    uint8_t *y0, *y1,
-            *u0, *u1,
-            *v0, *v1,
-            *a0, *a1,
-            *oy0, *oy1,
-            *ou0,
-            *ov0;
 
-    while (y < y_end) {
-        uint8_t *y_line_end = y+y_width;
-        uint8_t *y_line_next = y + y_pitch;
-        uint8_t *u_line_next = u + u_pitch;
-        uint8_t *v_line_next = v + v_pitch;
-        uint8_t *a_line_next = a + a_pitch;
-        uint8_t *o_line_next = o + o_pitch;
-        while (y < y_line_end) {
-            y0 = y; y1 = y+1;
-            u0 = u; u1 = u+1;
-            v0 = v; v1 = v+1;
-            a0 = a; a1 = a+1;
-            oy0 = o; oy1 = o+2;
-            ou0 = o+1; ov0 = o+3;
-
-            *oy0 = blend( *y0, *oy0, *a0 );
-            *oy1 = blend( *y1, *oy1, *a1 );
-
-            ut0 = blend( *u0, *ou0, *a0 );
-            ut1 = blend( *u1, *ou0, *a1 );
-            *ou0 = (ut0+ut1)>>1;
-
-            vt0 = blend( *v0, *ov0, *a0 );
-            vt1 = blend( *v1, *ov0, *a1 );
-            *ov0 = (vt0+vt1)>>1;
-
-            y+=2; u+=2; v+=2; a+=2; o+=4;
-        }
-        y = y_line_next;
-        u = u_line_next;
-        v = v_line_next;
-        a = a_line_next;
-        o = o_line_next;
+    for (int r = 0; y < y_end; r++) {
+        const histogram_span_t s = span_pairs( spans[r] );
+        if (s.x1 > s.x0)
+            rows->yuyv( o + 2*s.x0, y + s.x0, u + s.x0, v + s.x0, a + s.x0, s.x1 - s.x0 );
+
+        y += y_pitch;
+        u += u_pitch;
+        v += v_pitch;
+        a += a_pitch;
+        o += o_pitch;
     }
 
     return HIST_SUCCESS;
@@ -1675,7 +5876,8 @@ int picture_YUVA_BlendToYUYV( picture_t *p_out, picture_t *p_histo, int xoffset,
  *
  * Supports I420(with switch_uv=true) & YV12(with switch_uv=true)
  */
-int picture_YUVA_BlendToYUV420( picture_t *p_out, picture_t *p_histo, int x0, int y0, bool switch_uv )
+int picture_YUVA_BlendToYUV420( picture_t *p_out, picture_t *p_histo, int x0, int y0, bool switch_uv,
+                                const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
     int u_plane, v_plane;
     u_plane = switch_uv ? V_PLANE : U_PLANE;
@@ -1684,12 +5886,9 @@ int picture_YUVA_BlendToYUV420( picture_t *p_out, picture_t *p_histo, int x0, in
         y_pitch = p_histo->p[Y_PLANE].i_pitch,
         u_pitch = p_histo->p[U_PLANE].i_pitch,
         v_pitch = p_histo->p[V_PLANE].i_pitch,
-        y_width = p_histo->p[Y_PLANE].i_visible_pitch,
         o_pitch = p_out->p[Y_PLANE].i_pitch,
         uo_pitch = p_out->p[u_plane].i_pitch,
         vo_pitch = p_out->p[v_plane].i_pitch;
-    uint8_t ut1, ut2, ut3, ut4,
-            vt1, vt2, vt3, vt4;
     uint8_t *y = p_histo->p[Y_PLANE].p_pixels,
             *u = p_histo->p[U_PLANE].p_pixels,
             *v = p_histo->p[V_PLANE].p_pixels,
@@ -1698,54 +5897,66 @@ int picture_YUVA_BlendToYUV420( picture_t *p_out, picture_t *p_histo, int x0, in
             *uo= p_out->p[u_plane].p_pixels + y0/2*uo_pitch + x0/2,
             *vo= p_out->p[v_plane].p_pixels + y0/2*vo_pitch + x0/2;
     uint8_t *y_end = y + p_histo->p[Y_PLANE].i_visible_lines*y_pitch;
-    uint8_t *y1, *y2, *y3, *y4,
-            *u1, *u2, *u3, *u4,
-            *v1, *v2, *v3, *v4,
-            *a1, *a2, *a3, *a4,
-            *o1, *o2, *o3, *o4;
 
-    while (y < y_end) {
-        uint8_t *y_line_end = y+y_width;
-        uint8_t *y_line_next = y + 2*y_pitch;
-        uint8_t *u_line_next = u + 2*u_pitch;
-        uint8_t *v_line_next = v + 2*v_pitch;
-        uint8_t *a_line_next = a + 2*a_pitch;
-        uint8_t *o_line_next = o + 2*o_pitch;
-        uint8_t *uo_line_next = uo + uo_pitch;
-        uint8_t *vo_line_next = vo + vo_pitch;
-        while (y < y_line_end) {
-            y1 = y; y2 = y+1; y3 = y2+y_pitch; y4 = y1+y_pitch;
-            u1 = u; u2 = u+1; u3 = u2+u_pitch; u4 = u1+u_pitch;
-            v1 = v; v2 = v+1; v3 = v2+v_pitch; v4 = v1+v_pitch;
-            a1 = a; a2 = a+1; a3 = a2+a_pitch; a4 = a1+a_pitch;
-            o1 = o; o2 = o+1; o3 = o2+o_pitch; o4 = o1+o_pitch;
-            *o1 = blend( *y1, *o1, *a1 );
-            *o2 = blend( *y2, *o2, *a2 );
-            *o3 = blend( *y3, *o3, *a3 );
-            *o4 = blend( *y4, *o4, *a4 );
-
-            ut1 = blend( *u1, *uo, *a1 );
-            ut2 = blend( *u2, *uo, *a2 );
-            ut3 = blend( *u3, *uo, *a3 );
-            ut4 = blend( *u4, *uo, *a4 );
-            *uo = (ut1+ut2+ut3+ut4)/4;
-
-            vt1 = blend( *v1, *vo, *a1 );
-            vt2 = blend( *v2, *vo, *a2 );
-            vt3 = blend( *v3, *vo, *a3 );
-            vt4 = blend( *v4, *vo, *a4 );
-            *vo = (vt1+vt2+vt3+vt4)/4;
-
-            y+=2; u+=2; v+=2; a+=2; o+=2;
-            uo++; vo++;
-        }
-        y = y_line_next;
-        u = u_line_next;
-        v = v_line_next;
-        a = a_line_next;
-        o = o_line_next;
-        uo = uo_line_next;
-        vo = vo_line_next;
+    /*Two lines of luma for each line of chroma*/
+    for (int r = 0; y < y_end; r += 2) {
+        const histogram_span_t s = span_pairs( span_union( spans, r ) );
+        const int n = s.x1 - s.x0;
+        if (n > 0) {
+            rows->bytes( o + s.x0, y + s.x0, a + s.x0, n );
+            rows->bytes( o + o_pitch + s.x0, y + y_pitch + s.x0, a + a_pitch + s.x0, n );
+            rows->chroma4( uo + s.x0/2, u + s.x0, u_pitch, a + s.x0, a_pitch, n/2 );
+            rows->chroma4( vo + s.x0/2, v + s.x0, v_pitch, a + s.x0, a_pitch, n/2 );
+        }
+
+        y += 2*y_pitch;
+        u += 2*u_pitch;
+        v += 2*v_pitch;
+        a += 2*a_pitch;
+        o += 2*o_pitch;
+        uo += uo_pitch;
+        vo += vo_pitch;
+    }
+
+    return HIST_SUCCESS;
+}
+
+/** Generic YUVA to semi-planar YUV4:2:0 blend function.
+ *
+ * Supports NV12 & NV21(with switch_uv=true)
+ */
+int picture_YUVA_BlendToSemiPlanar420( picture_t *p_out, picture_t *p_histo, int x0, int y0, bool switch_uv,
+                                       const histogram_span_t *spans, const histogram_blend_rows_t *rows )
+{
+    int a_pitch = p_histo->p[A_PLANE].i_pitch,
+        y_pitch = p_histo->p[Y_PLANE].i_pitch,
+        c_pitch = p_histo->p[U_PLANE].i_pitch,
+        o_pitch = p_out->p[Y_PLANE].i_pitch,
+        uvo_pitch = p_out->p[1].i_pitch;
+    uint8_t *y = p_histo->p[Y_PLANE].p_pixels,
+            *u = p_histo->p[switch_uv ? V_PLANE : U_PLANE].p_pixels,
+            *v = p_histo->p[switch_uv ? U_PLANE : V_PLANE].p_pixels,
+            *a = p_histo->p[A_PLANE].p_pixels,
+            *o = p_out->p[Y_PLANE].p_pixels + y0*o_pitch + x0,
+            *uvo= p_out->p[1].p_pixels + y0/2*uvo_pitch + x0/2*2;
+    uint8_t *y_end = y + p_histo->p[Y_PLANE].i_visible_lines*y_pitch;
+
+    /*Two lines of luma for each line of chroma pairs*/
+    for (int r = 0; y < y_end; r += 2) {
+        const histogram_span_t s = span_pairs( span_union( spans, r ) );
+        const int n = s.x1 - s.x0;
+        if (n > 0) {
+            rows->bytes( o + s.x0, y + s.x0, a + s.x0, n );
+            rows->bytes( o + o_pitch + s.x0, y + y_pitch + s.x0, a + a_pitch + s.x0, n );
+            rows->chroma4_uv( uvo + s.x0, u + s.x0, v + s.x0, c_pitch, a + s.x0, a_pitch, n/2 );
+        }
+
+        y += 2*y_pitch;
+        u += 2*c_pitch;
+        v += 2*c_pitch;
+        a += 2*a_pitch;
+        o += 2*o_pitch;
+        uvo += uvo_pitch;
     }
 
     return HIST_SUCCESS;
@@ -1760,9 +5971,10 @@ int picture_YUVA_BlendToYUV420( picture_t *p_out, picture_t *p_histo, int x0, in
  * x0,y0  : Where the top-left corner of p_histo should be placed
  *          Should be multiples of '2'
  */
-int picture_YUVA_BlendToI422( picture_t *p_out, picture_t *p_histo, int x0, int y0 )
+int picture_YUVA_BlendToI422( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                              const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
-    return picture_YUVA_BlendToYUV422( p_out, p_histo, x0, y0, false );
+    return picture_YUVA_BlendToYUV422( p_out, p_histo, x0, y0, false, spans, rows );
 }
 
 /**
@@ -1776,9 +5988,10 @@ int picture_YUVA_BlendToI422( picture_t *p_out, picture_t *p_histo, int x0, int
  *
  * NOTE: YV16 seems to not be supported by VLC.
  */
-int picture_YUVA_BlendToYV16( picture_t *p_out, picture_t *p_histo, int x0, int y0 )
+int picture_YUVA_BlendToYV16( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                              const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
-    return picture_YUVA_BlendToYUV422( p_out, p_histo, x0, y0, true );
+    return picture_YUVA_BlendToYUV422( p_out, p_histo, x0, y0, true, spans, rows );
 }
 
 /**
@@ -1790,9 +6003,10 @@ int picture_YUVA_BlendToYV16( picture_t *p_out, picture_t *p_histo, int x0, int
  * x0,y0  : Where the top-left corner of p_histo should be placed
  *          Should be multiples of '2'
  */
-int picture_YUVA_BlendToI420( picture_t *p_out, picture_t *p_histo, int x0, int y0 )
+int picture_YUVA_BlendToI420( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                              const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
-    return picture_YUVA_BlendToYUV420( p_out, p_histo, x0, y0, false );
+    return picture_YUVA_BlendToYUV420( p_out, p_histo, x0, y0, false, spans, rows );
 }
 
 /**
@@ -1804,15 +6018,173 @@ int picture_YUVA_BlendToI420( picture_t *p_out, picture_t *p_histo, int x0, int
  * x0,y0  : Where the top-left corner of p_histo should be placed
  *          Should be multiples of '2'
  */
-int picture_YUVA_BlendToYV12( picture_t *p_out, picture_t *p_histo, int x0, int y0 )
+int picture_YUVA_BlendToYV12( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                              const histogram_span_t *spans, const histogram_blend_rows_t *rows )
+{
+    return picture_YUVA_BlendToYUV420( p_out, p_histo, x0, y0, true, spans, rows );
+}
+
+/**
+ * Alpha blend a YUVA4:4:4 picture to a NV12 picture.
+ *
+ * p_histo: YUVA planar picture, contains the histogram.
+ *          Dimentions should be multiples of '2'.
+ * p_out  : NV12 picture, the filter output
+ * x0,y0  : Where the top-left corner of p_histo should be placed
+ *          Should be multiples of '2'
+ */
+int picture_YUVA_BlendToNV12( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                              const histogram_span_t *spans, const histogram_blend_rows_t *rows )
+{
+    return picture_YUVA_BlendToSemiPlanar420( p_out, p_histo, x0, y0, false, spans, rows );
+}
+
+/**
+ * Alpha blend a YUVA4:4:4 picture to a NV21 picture.
+ *
+ * p_histo: YUVA planar picture, contains the histogram.
+ *          Dimentions should be multiples of '2'.
+ * p_out  : NV21 picture, the filter output
+ * x0,y0  : Where the top-left corner of p_histo should be placed
+ *          Should be multiples of '2'
+ */
+int picture_YUVA_BlendToNV21( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                              const histogram_span_t *spans, const histogram_blend_rows_t *rows )
+{
+    return picture_YUVA_BlendToSemiPlanar420( p_out, p_histo, x0, y0, true, spans, rows );
+}
+
+/*****************************************************************************
+ * High bit depth blend
+ *****************************************************************************
+ * The overlay keeps its 8-bit samples, they are scaled to the depth of the
+ * 16-bit output while blending: 2 bits up for 10-bit, 4 for 12-bit and 8
+ * for P010. There are no SIMD row kernels for 16-bit samples.
+ *****************************************************************************/
+
+/**
+ * Alpha blend a premultiplied 8-bit forground to a 16-bit background.
+ *
+ * Returns: pm<<shift + bg*(256-a)/256
+ */
+static inline uint16_t blend16( uint8_t pm, uint16_t bg, uint8_t a, int shift )
+{
+    return (pm << shift) + (((256-a) * bg)>>8);
+}
+
+/** o[i] = blend16( pm[i], o[i], a[i] ) */
+static void blend_row16_c( uint16_t *o, const uint8_t *pm, const uint8_t *a, int n, int shift )
+{
+    for (int i = 0; i < n; i++)
+        o[i] = blend16( pm[i], o[i], a[i], shift );
+}
+
+/**
+ * Blend 2x'lines' samples to every o_step'th of the n samples of o, and
+ * average them. lines is 1 for 4:2:2 and 2 for 4:2:0 chroma.
+ */
+static void blend_row16_chroma_c( uint16_t *o, int o_step, const uint8_t *pm, int pm_pitch,
+                                  const uint8_t *a, int a_pitch, int lines, int n, int shift )
+{
+    for (int i = 0; i < n; i++, o += o_step) {
+        uint32_t sum = 0;
+        for (int l = 0; l < lines; l++)
+            sum += blend16( pm[l*pm_pitch+2*i],   *o, a[l*a_pitch+2*i],   shift ) +
+                   blend16( pm[l*pm_pitch+2*i+1], *o, a[l*a_pitch+2*i+1], shift );
+        *o = sum >> lines;
+    }
+}
+
+/**
+ * Alpha blend the luma of a YUVA4:4:4 picture to a 16-bit YUV picture.
+ *
+ * Used by the Luminance histogram, the chroma planes are left untouched.
+ */
+int picture_YUVA_BlendToY16( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                             const histogram_span_t *spans, const histogram_blend_rows_t *rows )
+{
+    VLC_UNUSED( rows );
+    int a_pitch = p_histo->p[A_PLANE].i_pitch,
+        y_pitch = p_histo->p[Y_PLANE].i_pitch,
+        y_lines = p_histo->p[Y_PLANE].i_visible_lines,
+        o_pitch = p_out->p[Y_PLANE].i_pitch,
+        shift   = histogram_hbd_shift( p_out->format.i_chroma ) + 2;
+    uint8_t *y = p_histo->p[Y_PLANE].p_pixels,
+            *a = p_histo->p[A_PLANE].p_pixels,
+            *o = p_out->p[Y_PLANE].p_pixels + y0*o_pitch + 2*x0;
+
+    for (int r = 0; r < y_lines; r++, y += y_pitch, a += a_pitch, o += o_pitch) {
+        const histogram_span_t s = spans[r];
+        if (s.x1 > s.x0)
+            blend_row16_c( (uint16_t*)o + s.x0, y + s.x0, a + s.x0, s.x1 - s.x0, shift );
+    }
+
+    return HIST_SUCCESS;
+}
+
+/**
+ * Alpha blend a YUVA4:4:4 picture to a 16-bit YUV4:2:0/4:2:2 picture.
+ *
+ * p_histo: YUVA planar picture, contains the histogram.
+ *          Dimentions should be multiples of '2'.
+ * p_out  : I420/I422 10L & 12L or P010 picture, the filter output
+ * x0,y0  : Where the top-left corner of p_histo should be placed
+ *          Should be multiples of '2'
+ */
+int picture_YUVA_BlendToYUV16( picture_t *p_out, picture_t *p_histo, int x0, int y0,
+                               const histogram_span_t *spans, const histogram_blend_rows_t *rows )
 {
-    return picture_YUVA_BlendToYUV420( p_out, p_histo, x0, y0, true );
+    VLC_UNUSED( rows );
+    const bool semi_planar = p_out->i_planes == 2;
+    const int lines  = p_out->p[1].i_visible_lines < p_out->p[Y_PLANE].i_visible_lines ? 2 : 1,
+              c_step = semi_planar ? 2 : 1,
+              shift  = histogram_hbd_shift( p_out->format.i_chroma ) + 2;
+    int a_pitch  = p_histo->p[A_PLANE].i_pitch,
+        y_pitch  = p_histo->p[Y_PLANE].i_pitch,
+        c_pitch  = p_histo->p[U_PLANE].i_pitch,
+        o_pitch  = p_out->p[Y_PLANE].i_pitch,
+        uo_pitch = p_out->p[1].i_pitch,
+        vo_pitch = p_out->p[semi_planar ? 1 : 2].i_pitch;
+    uint8_t *y  = p_histo->p[Y_PLANE].p_pixels,
+            *u  = p_histo->p[U_PLANE].p_pixels,
+            *v  = p_histo->p[V_PLANE].p_pixels,
+            *a  = p_histo->p[A_PLANE].p_pixels,
+            *o  = p_out->p[Y_PLANE].p_pixels + y0*o_pitch + 2*x0,
+            *uo = p_out->p[1].p_pixels + y0/lines*uo_pitch + x0/2*c_step*2,
+            *vo = p_out->p[semi_planar ? 1 : 2].p_pixels + y0/lines*vo_pitch + x0/2*c_step*2
+                  + (semi_planar ? 2 : 0);
+    uint8_t *y_end = y + p_histo->p[Y_PLANE].i_visible_lines*y_pitch;
+
+    /*'lines' lines of luma for each line of chroma*/
+    for (int r = 0; y < y_end; r += lines) {
+        const histogram_span_t s = span_pairs( lines == 2 ? span_union( spans, r ) : spans[r] );
+        const int n = s.x1 - s.x0;
+        if (n > 0) {
+            for (int l = 0; l < lines; l++)
+                blend_row16_c( (uint16_t*)(o + l*o_pitch) + s.x0,
+                               y + l*y_pitch + s.x0, a + l*a_pitch + s.x0, n, shift );
+            blend_row16_chroma_c( (uint16_t*)uo + s.x0/2*c_step, c_step, u + s.x0, c_pitch,
+                                  a + s.x0, a_pitch, lines, n/2, shift );
+            blend_row16_chroma_c( (uint16_t*)vo + s.x0/2*c_step, c_step, v + s.x0, c_pitch,
+                                  a + s.x0, a_pitch, lines, n/2, shift );
+        }
+
+        y  += lines*y_pitch;
+        u  += lines*c_pitch;
+        v  += lines*c_pitch;
+        a  += lines*a_pitch;
+        o  += lines*o_pitch;
+        uo += uo_pitch;
+        vo += vo_pitch;
+    }
+
+    return HIST_SUCCESS;
 }
 
 int histogram_blend( histogram_t *h, picture_t *p_out )
 {
     int yt = p_out->format.i_height-(h->y0+h->p_overlay->format.i_height);
-    return h->blend_func( p_out, h->p_overlay, h->x0, yt );
+    return h->blend_func( p_out, h->p_overlay, h->x0, yt, h->spans, h->blend_rows );
 }
 
 /** Return a pointer to the RGBA pixel. */
@@ -1842,74 +6214,46 @@ int histogram_rgb_paintToRGBA( histogram_t *histo, picture_t *p_bgra )
               yg0 = yr0 + histo->height + BOTTOM_MARGIN,
               yb0 = yg0 + histo->height + BOTTOM_MARGIN;
 
+    const uint32_t max    = premultiply( MAX_PIXEL_VALUE, HISTOGRAM_ALPHA ),
+                   shadow = premultiply( SHADOW_PIXEL_VALUE, HISTOGRAM_ALPHA ),
+                   alpha  = HISTOGRAM_ALPHA,
+                   pmax   = premultiply( MAX_PIXEL_VALUE, PEAK_ALPHA ),
+                   palpha = PEAK_ALPHA;
 #ifdef HISTOGRAM_LITTLE_ENDIAN
-    const uint32_t red   = 0x00FF0000 | HISTOGRAM_ALPHA<<24,
-                   green = 0x0000FF00 | HISTOGRAM_ALPHA<<24,
-                   blue  = 0x000000FF | HISTOGRAM_ALPHA<<24,
-                   grey  = SHADOW_PIXEL_VALUE<<0  |
-                           SHADOW_PIXEL_VALUE<<8  |
-                           SHADOW_PIXEL_VALUE<<16 |
-                           HISTOGRAM_ALPHA<<24;
+    const uint32_t red   = max<<16 | alpha<<24,
+                   green = max<<8  | alpha<<24,
+                   blue  = max<<0  | alpha<<24,
+                   grey  = shadow<<0  |
+                           shadow<<8  |
+                           shadow<<16 |
+                           alpha<<24,
+                   pred   = pmax<<16 | palpha<<24,
+                   pgreen = pmax<<8  | palpha<<24,
+                   pblue  = pmax<<0  | palpha<<24;
 #else /*BIG_ENDIAN*/
-    const uint32_t red   = 0x0000FF00 | HISTOGRAM_ALPHA,
-                   green = 0x00FF0000 | HISTOGRAM_ALPHA,
-                   blue  = 0xFF000000 | HISTOGRAM_ALPHA,
-                   grey  = SHADOW_PIXEL_VALUE<<24 |
-                           SHADOW_PIXEL_VALUE<<16 |
-                           SHADOW_PIXEL_VALUE<<8  |
-                           HISTOGRAM_ALPHA;
+    const uint32_t red   = max<<8  | alpha,
+                   green = max<<16 | alpha,
+                   blue  = max<<24 | alpha,
+                   grey  = shadow<<24 |
+                           shadow<<16 |
+                           shadow<<8  |
+                           alpha,
+                   pred   = pmax<<8  | palpha,
+                   pgreen = pmax<<16 | palpha,
+                   pblue  = pmax<<24 | palpha;
 #endif /*HISTOGRAM_LITTLE_ENDIAN*/
 
-#define P(x,y) xy_rgba2p( (x), (y), &p_bgra->p[RGB_PLANE] )
-    /*For each bin in the histogram, paint a vertical bar in R/G/B color*/
-    for (int bin=0; bin < histo->num_bins; bin++) {
-        /*y-min for drop shaddow bar*/
-        const uint32_t jsr0 = (bin == histo->num_bins-1) ? 0 : histo->bins[R][bin+1]+1;
-        const uint32_t jsg0 = (bin == histo->num_bins-1) ? 0 : histo->bins[G][bin+1]+1;
-        const uint32_t jsb0 = (bin == histo->num_bins-1) ? 0 : histo->bins[B][bin+1]+1;
-
-        const int x = bin;
-
-        /*Paint red bar*/
-        for (uint32_t j = 0; j <= histo->bins[R][bin]; j++) {
-           int y = yr0 + j;
-           *P(x,y) = red;
-        }
-        /*Drop shadow, 1 pel right - 1 pel below red bar*/
-        for (uint32_t j = jsr0; j < histo->bins[R][bin]; j++) {
-           int y = yr0 + j;
-           *P(x+1,y) = grey;
-        }
-        /*Drop shadow under the next red bar*/
-        *P(x+1, yr0-1) = grey;
-
-        /*Paint green bar*/
-        for (uint32_t j = 0; j <= histo->bins[G][bin]; j++) {
-           int y = yg0 + j;
-           *P(x,y) = green;
-        }
-        /*Drop shadow, 1 pel right - 1 pel below green bar*/
-        for (uint32_t j = jsg0; j < histo->bins[G][bin]; j++) {
-             int y = yg0 + j;
-            *P(x+1, y) = grey;
-        }
-        /*Drop shadow under the next green bar*/
-        *P(x+1, yg0-1) = grey;
+    const int      y0[3]    = { yr0, yg0, yb0 };
+    const uint32_t color[3] = { red, green, blue },
+                   peak[3]  = { pred, pgreen, pblue };
 
-        /*Paint blue bar*/
-        for (uint32_t j=0; j <= histo->bins[B][bin]; j++) {
-           int y = yb0 + j;
-           *P(x, y) = blue;
-        }
-        /*Drop shadow, 1 pel right - 1 pel below blue bar*/
-        for (uint32_t j = jsb0; j < histo->bins[B][bin]; j++) {
-           int y = yb0 + j;
-           *P(x+1, y) = grey;
-        }
-        /*Drop shadow under the next blue bar*/
-        *P(x+1, yb0-1) = grey;
-    }
-#undef P
+    /*For each changed column of the R/G/B histograms, repaint bar and shadow*/
+    for (int c = R; c <= B; c++)
+        for (int x = 0; x <= histo->num_bins; x++)
+            if (histo->dirty[x] & 1<<c)
+                histogram_paintColumnRGBA( histo, &p_bgra->p[RGB_PLANE], histo->heights[c], x, y0[c],
+                                           color[c], grey,
+                                           histo->peak ? histo->peak->heights[c] : NULL, peak[c] );
 
     return HIST_SUCCESS;
 }
@@ -1922,15 +6266,86 @@ void picture_ZeroPixels( picture_t *p_pic )
     }
 }
 
+/**
+ * The horizontal and vertical subsampling of plane i of p_pic against the
+ * first plane, as right shifts of the first plane coordinates: 1 and 1 for
+ * the chroma of 4:2:0, 0 and 0 for packed formats. The chroma of odd sized
+ * pictures has half the luma size rounded down or up, either way the shift
+ * is the one that brings the luma size down to the chroma size.
+ */
+void picture_PlaneShift( const picture_t *p_pic, int i, int *x_shift, int *y_shift )
+{
+    const plane_t *p0 = &p_pic->p[0], *p = &p_pic->p[i];
+    const int width  = p0->i_visible_pitch / p0->i_pixel_pitch,
+              height = p0->i_visible_lines;
+
+    *x_shift = *y_shift = 0;
+    while ((width >> *x_shift) > p->i_visible_pitch / p->i_pixel_pitch)
+        (*x_shift)++;
+    while ((height >> *y_shift) > p->i_visible_lines)
+        (*y_shift)++;
+}
+
+/**
+ * Make p_view a shallow view on a rectangle of p_pic.
+ *
+ * No pixels are copied, the planes of p_view point into p_pic, so p_view
+ * must not be released or outlive p_pic. x, y, width and height are in
+ * pixels of the first plane and should be aligned to the chroma subsampling.
+ * Every plane starts at x and y shifted by its own subsampling, in whole
+ * samples, which keeps subsampled and packed chroma co-sited with the luma
+ * on odd sized pictures too. Only the format and the planes are copied,
+ * the reference count of p_pic is never touched.
+ */
+void picture_CropView( picture_t *p_view, const picture_t *p_pic, int x, int y, int width, int height )
+{
+    memset( p_view, 0, sizeof(picture_t) );
+    p_view->format   = p_pic->format;
+    p_view->i_planes = p_pic->i_planes;
+    for (int i=0; i<p_pic->i_planes; i++) {
+        const plane_t *src = &p_pic->p[i];
+        plane_t *dst = &p_view->p[i];
+        int x_shift, y_shift;
+
+        picture_PlaneShift( p_pic, i, &x_shift, &y_shift );
+        const int samples = src->i_visible_pitch / src->i_pixel_pitch,
+                  x0 = __MIN( x >> x_shift, samples ),
+                  x1 = __MIN( (x + width) >> x_shift, samples ),
+                  y0 = __MIN( y >> y_shift, src->i_visible_lines ),
+                  y1 = __MIN( (y + height) >> y_shift, src->i_visible_lines );
+
+        *dst = *src;
+        dst->p_pixels        = src->p_pixels + y0 * src->i_pitch + x0 * src->i_pixel_pitch;
+        dst->i_visible_pitch = (x1 - x0) * src->i_pixel_pitch;
+        dst->i_visible_lines = y1 - y0;
+        dst->i_lines         = y1 - y0;
+    }
+}
+
 picture_t* picture_CopyAndRelease(filter_t *p_filter, picture_t *p_pic)
 {
     picture_t *p_outpic = filter_NewPicture( p_filter );
-    picture_Copy( p_outpic, p_pic );
+    if (p_outpic)
+        picture_Copy( p_outpic, p_pic );
     picture_Release( p_pic );
 
     return p_outpic;
 }
 
+/**
+ * Return a picture the histogram can be blended into.
+ *
+ * That is p_pic itself when nobody else holds a reference to it. Otherwise
+ * the pixels have to be copied to a new picture and p_pic is released.
+ */
+picture_t* picture_MakeWritable( filter_t *p_filter, picture_t *p_pic )
+{
+    if (!picture_IsReferenced( p_pic ))
+        return p_pic;
+
+    return picture_CopyAndRelease( p_filter, p_pic );
+}
+
 #ifdef HISTOGRAM_DEBUG
 void dump_format( video_format_t *fmt )
 {
@@ -1956,7 +6371,7 @@ void dump_histogram( histogram_t *histo )
 
     for (int i=0; i<histo->num_channels; i++) {
         for (int bin=0; bin<histo->num_bins; bin++)
-            fprintf(out, "%d\n", histo->bins[i][bin]);
+            fprintf(out, "%d\n", histo->heights[i][bin]);
         fprintf(out, "\n\n");
     }
     fclose( out );